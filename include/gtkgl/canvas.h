@@ -101,6 +101,81 @@ typedef enum _GtkGLProfile {
 } GtkGLProfile;
 
 
+/**
+ * GtkGLContextFlags:
+ * @GTK_GL_CONTEXT_FLAGS_NONE: No flags
+ * @GTK_GL_CONTEXT_DEBUG: Create a debug context, for which the driver may
+ *      perform additional validation and report through GL_KHR_debug
+ * @GTK_GL_CONTEXT_FORWARD_COMPATIBLE: Remove deprecated functionality
+ *      (OpenGL 3.0 and later only)
+ * @GTK_GL_CONTEXT_NO_ERROR: Create a context without error checking, where
+ *      errors result in undefined behavior instead of GL errors. Ignored
+ *      together with #GTK_GL_CONTEXT_DEBUG. All contexts of a
+ *      #GtkGLShareGroup must agree on this flag
+ * @GTK_GL_CONTEXT_NO_FLUSH_ON_RELEASE: Do not flush implicitly when the
+ *      context is released from a thread, e.g. when switching canvases
+ *
+ * Optional properties of contexts created by
+ * #gtk_gl_canvas_create_context_with_flags(). Flags the display does not
+ * support (see #GtkGLDisplayCaps) are dropped silently, since none of them
+ * change the results of correct programs.
+ */
+typedef enum _GtkGLContextFlags {
+    GTK_GL_CONTEXT_FLAGS_NONE = 0,
+    GTK_GL_CONTEXT_DEBUG = 1 << 0,
+    GTK_GL_CONTEXT_FORWARD_COMPATIBLE = 1 << 1,
+    GTK_GL_CONTEXT_NO_ERROR = 1 << 2,
+    GTK_GL_CONTEXT_NO_FLUSH_ON_RELEASE = 1 << 3
+} GtkGLContextFlags;
+
+
+/**
+ * GtkGLDisplayCaps:
+ * @GTK_GL_DISPLAY_FBCONFIG: Framebuffer configurations can be enumerated
+ *      (GLX 1.3, WGL_ARB_pixel_format). Without it, no visuals are reported
+ * @GTK_GL_DISPLAY_MULTISAMPLE: Multisampled visuals are described (GLX 1.4,
+ *      GLX_ARB_multisample or WGL_ARB_multisample)
+ * @GTK_GL_DISPLAY_CREATE_CONTEXT: Contexts of a specific version can be
+ *      created (GLX_ARB_create_context, WGL_ARB_create_context)
+ * @GTK_GL_DISPLAY_CREATE_CONTEXT_PROFILE: Core and compatibility profiles
+ *      can be requested (GLX_ARB_create_context_profile,
+ *      WGL_ARB_create_context_profile)
+ * @GTK_GL_DISPLAY_CREATE_CONTEXT_ES_PROFILE: The OpenGL ES profile can be
+ *      requested (GLX_EXT_create_context_es_profile,
+ *      WGL_EXT_create_context_es_profile)
+ * @GTK_GL_DISPLAY_SWAP_METHOD: Visuals report their swap method
+ *      (GLX_OML_swap_method, WGL_ARB_pixel_format)
+ * @GTK_GL_DISPLAY_FRAMEBUFFER_SRGB: Visuals report sRGB capability
+ *      (GLX_ARB_framebuffer_sRGB, GLX_EXT_framebuffer_sRGB,
+ *      WGL_ARB_framebuffer_sRGB)
+ * @GTK_GL_DISPLAY_BUFFER_AGE: Buffer age can be queried (GLX_EXT_buffer_age)
+ * @GTK_GL_DISPLAY_RELEASE_BUFFERS: Ancillary buffers of destroyed windows are
+ *      released explicitly (GLX_MESA_release_buffers)
+ * @GTK_GL_DISPLAY_CREATE_CONTEXT_NO_ERROR: #GTK_GL_CONTEXT_NO_ERROR is
+ *      supported (GLX_ARB_create_context_no_error,
+ *      WGL_ARB_create_context_no_error)
+ * @GTK_GL_DISPLAY_CONTEXT_FLUSH_CONTROL: #GTK_GL_CONTEXT_NO_FLUSH_ON_RELEASE
+ *      is supported (GLX_ARB_context_flush_control,
+ *      WGL_ARB_context_flush_control)
+ *
+ * Window system capabilities of the display and screen a #GtkGLCanvas lives
+ * on, see #gtk_gl_canvas_get_display_caps().
+ */
+typedef enum _GtkGLDisplayCaps {
+    GTK_GL_DISPLAY_FBCONFIG = 1 << 0,
+    GTK_GL_DISPLAY_MULTISAMPLE = 1 << 1,
+    GTK_GL_DISPLAY_CREATE_CONTEXT = 1 << 2,
+    GTK_GL_DISPLAY_CREATE_CONTEXT_PROFILE = 1 << 3,
+    GTK_GL_DISPLAY_CREATE_CONTEXT_ES_PROFILE = 1 << 4,
+    GTK_GL_DISPLAY_SWAP_METHOD = 1 << 5,
+    GTK_GL_DISPLAY_FRAMEBUFFER_SRGB = 1 << 6,
+    GTK_GL_DISPLAY_BUFFER_AGE = 1 << 7,
+    GTK_GL_DISPLAY_RELEASE_BUFFERS = 1 << 8,
+    GTK_GL_DISPLAY_CREATE_CONTEXT_NO_ERROR = 1 << 9,
+    GTK_GL_DISPLAY_CONTEXT_FLUSH_CONTROL = 1 << 10
+} GtkGLDisplayCaps;
+
+
 /**
  * GtkGLCanvas:
  * The GLCanvas Widget type.
@@ -136,6 +211,11 @@ GtkWidget *gtk_gl_canvas_new(void);
  * Use #gtk_gl_choose_visuals() to filter and sort the visuals returned by this
  * function.
  *
+ * The visuals are enumerated and described only once per screen and parent
+ * visual type; subsequent calls for canvases on the same screen return the
+ * cached visuals. The returned list is shared with the cache; release it with
+ * #gtk_gl_visual_list_unref().
+ *
  * Returns: A list of supported visuals
  */
 GtkGLVisualList *gtk_gl_canvas_enumerate_visuals(GtkGLCanvas *canvas);
@@ -184,6 +264,51 @@ gboolean gtk_gl_canvas_create_context_with_version(GtkGLCanvas *canvas,
         GtkGLProfile profile);
 
 
+/**
+ * gtk_gl_canvas_create_context_with_flags:
+ * @canvas: The canvas
+ * @visual: The visual selecting the frame buffer configuration
+ * @ver_major: The OpenGL major version, e.g. 3
+ * @ver_minor: The OpenGL minor version, e.g. 1
+ * @profile: The OpenGL profile (ignored if the version is < 3.1)
+ * @flags: A combination of #GtkGLContextFlags
+ *
+ * Like #gtk_gl_canvas_create_context_with_version(), but additionally
+ * requests the given context flags. Flags that the display does not support
+ * are ignored.
+ *
+ * Returns: Whether the context was created successfully
+ */
+gboolean gtk_gl_canvas_create_context_with_flags(GtkGLCanvas *canvas,
+        const GtkGLVisual *visual, guint ver_major, guint ver_minor,
+        GtkGLProfile profile, GtkGLContextFlags flags);
+
+
+/**
+ * gtk_gl_canvas_create_best_context:
+ * @canvas: The canvas
+ * @visual: The visual selecting the frame buffer configuration
+ * @profile: The OpenGL profile (ignored for versions < 3.1)
+ * @min_major: The minimum acceptable OpenGL major version
+ * @min_minor: The minimum acceptable OpenGL minor version
+ *
+ * Creates a context with the highest OpenGL version (up to 4.6) the driver
+ * supports for the given profile, making the context current to the calling
+ * thread. Versions are tried in descending order down to the minimum. The
+ * version found is remembered per display, frame buffer configuration and
+ * profile, so that later calls for other canvases usually succeed on the
+ * first attempt. If the canvas
+ * already has a context, it is destroyed first.
+ *
+ * Query GL_VERSION or GL_MAJOR_VERSION to find out which version was created.
+ *
+ * Returns: Whether a context of at least the minimum version was created
+ */
+gboolean gtk_gl_canvas_create_best_context(GtkGLCanvas *canvas,
+        const GtkGLVisual *visual, GtkGLProfile profile, guint min_major,
+        guint min_minor);
+
+
 /**
  * gtk_gl_canvas_auto_create_context:
  * @canvas: The canvas
@@ -235,6 +360,101 @@ gboolean gtk_gl_canvas_auto_create_context_with_version(GtkGLCanvas *canvas,
         GtkGLProfile profile);
 
 
+/**
+ * gtk_gl_set_persistent_cache_enabled:
+ * @enabled: Whether to use the cache
+ *
+ * Enables or disables the persistent visual cache, which is disabled by
+ * default. When enabled, the described framebuffer configurations of each
+ * screen and the visual last chosen by
+ * #gtk_gl_canvas_auto_create_context_with_version() and
+ * #gtk_gl_canvas_auto_create_context() are stored in the user's cache
+ * directory, so later runs can create their context without enumerating
+ * and describing all visuals first. If a cached configuration is no longer
+ * accepted, visuals are enumerated as usual and the cache is rewritten.
+ * Both X11 backends (see #gtk_gl_get_backend_name()) keep the cache; on
+ * Windows, enabling it has no effect yet.
+ */
+void gtk_gl_set_persistent_cache_enabled(gboolean enabled);
+
+
+/**
+ * gtk_gl_set_context_pool_size:
+ * @size: The number of released contexts to keep per screen, or 0
+ *
+ * Sets how many destroyed contexts are kept for reuse instead of being
+ * released to the driver. Pooling is disabled (a size of 0) by default.
+ * Creating a context with the same #GtkGLVisual, version and profile as a
+ * pooled one hands out the pooled context, which is much cheaper than
+ * creating a new one. A reused context keeps the OpenGL objects and state of
+ * its previous owner. When the pool is full, the least recently released
+ * context is destroyed. Pooling is implemented by both X11 backends (see
+ * #gtk_gl_get_backend_name()), but not yet on Windows.
+ */
+void gtk_gl_set_context_pool_size(guint size);
+
+
+/**
+ * gtk_gl_set_threaded_context_creation:
+ * @enabled: Whether asynchronous operations may use worker threads
+ *
+ * Allows #gtk_gl_canvas_create_context_async() and
+ * #gtk_gl_canvas_destroy_context_async() to create and destroy contexts on a
+ * worker thread. The worker talks to the window system through the same
+ * display connection as GTK, so on X11 only enable this if XInitThreads()
+ * was called before GTK opened the display, e.g. first thing in main().
+ * Disabled by default, in which case asynchronous operations run from an
+ * idle callback on the main thread. Has no effect on Windows.
+ */
+void gtk_gl_set_threaded_context_creation(gboolean enabled);
+
+
+/**
+ * gtk_gl_get_make_current_stats:
+ * @performed: (out) (allow-none): Number of context switches issued
+ * @skipped: (out) (allow-none): Number of switches skipped as redundant
+ *
+ * Reports how often #gtk_gl_canvas_make_current() had to switch the current
+ * context of the calling thread, and how often it found the canvas' context
+ * to be current already. The counters are global and cover all threads.
+ */
+void gtk_gl_get_make_current_stats(guint *performed, guint *skipped);
+
+
+/**
+ * gtk_gl_reset_make_current_stats:
+ *
+ * Resets the counters reported by #gtk_gl_get_make_current_stats() to zero.
+ */
+void gtk_gl_reset_make_current_stats(void);
+
+
+/**
+ * gtk_gl_get_backend_name:
+ *
+ * Returns the name of the window system binding used for all canvases:
+ * "glx" or "egl" on X11, "wgl" on Windows. X11 builds with EGL support
+ * prefer EGL if the default display supports it and fall back to GLX. The
+ * choice is made once, when the first canvas is created, and can be forced
+ * by setting the GTK_GL_BACKEND environment variable to "glx" or "egl".
+ *
+ * Returns: The backend name, owned by the library
+ */
+const gchar *gtk_gl_get_backend_name(void);
+
+
+/**
+ * gtk_gl_canvas_get_display_caps:
+ * @canvas: A realized canvas
+ *
+ * Returns the window system capabilities of the canvas' display and screen.
+ * They are determined once per screen and cached, so this is cheap to call.
+ *
+ * Returns: The capabilities, or 0 if the canvas is not realized
+ */
+GtkGLDisplayCaps gtk_gl_canvas_get_display_caps(GtkGLCanvas *canvas);
+
+
 /**
  * gtk_gl_canvas_destroy_context:
  * @canvas: The canvas
@@ -245,6 +465,87 @@ gboolean gtk_gl_canvas_auto_create_context_with_version(GtkGLCanvas *canvas,
 void gtk_gl_canvas_destroy_context(GtkGLCanvas *canvas);
 
 
+/**
+ * gtk_gl_canvas_create_context_async:
+ * @canvas: The canvas
+ * @visual: The visual selecting the frame buffer configuration. It is not
+ *          copied and must stay alive until @callback has been called.
+ * @ver_major: The OpenGL major version, or 0 for a legacy context
+ * @ver_minor: The OpenGL minor version
+ * @profile: The OpenGL profile (ignored if the version is < 3.1)
+ * @flags: A combination of #GtkGLContextFlags (ignored for a legacy context)
+ * @cancellable: (allow-none): A #GCancellable
+ * @callback: Called on the thread-default main context when done
+ * @user_data: Data passed to @callback
+ *
+ * Starts creating an OpenGL context on a #GtkGLCanvas and returns
+ * immediately. An existing context is destroyed first, and the canvas draws
+ * its placeholder until the operation completes. If enabled with
+ * #gtk_gl_set_threaded_context_creation(), the context is created on a
+ * worker thread without blocking the main loop. Otherwise it is created
+ * from an idle callback on the thread-default main context, which then
+ * blocks while the driver creates the context.
+ *
+ * When the operation succeeds, the new context is current to the main
+ * thread. The canvas can only have one pending operation at a time; no
+ * synchronous context functions must be called on it meanwhile.
+ */
+void gtk_gl_canvas_create_context_async(GtkGLCanvas *canvas,
+        const GtkGLVisual *visual, guint ver_major, guint ver_minor,
+        GtkGLProfile profile, GtkGLContextFlags flags,
+        GCancellable *cancellable, GAsyncReadyCallback callback,
+        gpointer user_data);
+
+
+/**
+ * gtk_gl_canvas_create_context_finish:
+ * @canvas: The canvas
+ * @result: The #GAsyncResult passed to the callback
+ * @error: (allow-none): Return location for a #GError
+ *
+ * Finishes an operation started by #gtk_gl_canvas_create_context_async().
+ * Fails with #G_IO_ERROR_CANCELLED if the operation was cancelled or the
+ * canvas was unrealized meanwhile, and with #G_IO_ERROR_PENDING if another
+ * operation was still pending on the canvas.
+ *
+ * Returns: Whether the context was created successfully
+ */
+gboolean gtk_gl_canvas_create_context_finish(GtkGLCanvas *canvas,
+        GAsyncResult *result, GError **error);
+
+
+/**
+ * gtk_gl_canvas_destroy_context_async:
+ * @canvas: The canvas
+ * @cancellable: (allow-none): A #GCancellable
+ * @callback: Called on the thread-default main context when done
+ * @user_data: Data passed to @callback
+ *
+ * Starts destroying the context of a #GtkGLCanvas and returns immediately.
+ * The canvas draws its placeholder meanwhile. Like
+ * #gtk_gl_canvas_create_context_async(), the context is destroyed on a worker
+ * thread or from an idle callback. If the canvas does not have a context, the
+ * operation succeeds trivially.
+ */
+void gtk_gl_canvas_destroy_context_async(GtkGLCanvas *canvas,
+        GCancellable *cancellable, GAsyncReadyCallback callback,
+        gpointer user_data);
+
+
+/**
+ * gtk_gl_canvas_destroy_context_finish:
+ * @canvas: The canvas
+ * @result: The #GAsyncResult passed to the callback
+ * @error: (allow-none): Return location for a #GError
+ *
+ * Finishes an operation started by #gtk_gl_canvas_destroy_context_async().
+ *
+ * Returns: Whether the context was destroyed
+ */
+gboolean gtk_gl_canvas_destroy_context_finish(GtkGLCanvas *canvas,
+        GAsyncResult *result, GError **error);
+
+
 /**
  * gtk_gl_canvas_has_context:
  * @canvas: The canvas
@@ -255,23 +556,159 @@ void gtk_gl_canvas_destroy_context(GtkGLCanvas *canvas);
 gboolean gtk_gl_canvas_has_context(const GtkGLCanvas *canvas);
 
 
+/**
+ * GtkGLShareGroup:
+ *
+ * A reference-counted group of canvases whose contexts share OpenGL objects
+ * such as textures, buffers and shaders. Objects created in the context of
+ * one member are usable from all members and live as long as at least one
+ * member has a context.
+ */
+typedef struct _GtkGLShareGroup GtkGLShareGroup;
+
+
+/**
+ * gtk_gl_share_group_new:
+ *
+ * Creates an empty share group.
+ *
+ * Returns: The new group, release it with #gtk_gl_share_group_unref()
+ */
+GtkGLShareGroup *gtk_gl_share_group_new(void);
+
+
+/**
+ * gtk_gl_share_group_ref:
+ * @group: The group
+ *
+ * Acquires a reference on a share group.
+ *
+ * Returns: The group
+ */
+GtkGLShareGroup *gtk_gl_share_group_ref(GtkGLShareGroup *group);
+
+
+/**
+ * gtk_gl_share_group_unref:
+ * @group: The group
+ *
+ * Releases a reference on a share group, freeing it once the last reference
+ * is gone. Canvases hold a reference on their group.
+ */
+void gtk_gl_share_group_unref(GtkGLShareGroup *group);
+
+
+/**
+ * gtk_gl_share_group_set_single_context:
+ * @group: The group
+ * @single_context: Whether members render through one context
+ *
+ * Enables or disables single-context mode, which is disabled by default. In
+ * single-context mode, a member creating a context with the same
+ * #GtkGLVisual, version and profile as another member adopts that member's
+ * context instead of creating its own. This saves a driver context per
+ * canvas and makes switching between the canvases with
+ * #gtk_gl_canvas_make_current() cheap. As members then share all context
+ * state as well, each canvas must set up its viewport and bindings before
+ * drawing. The mode applies to contexts created afterwards.
+ *
+ * On X11, the members within one toplevel window also share one drawable
+ * covering the toplevel: each member renders into its own framebuffer
+ * object (see #gtk_gl_canvas_get_framebuffer()), and
+ * #gtk_gl_canvas_display_frame() only queues a present, which copies the
+ * frames of all members into the drawable and swaps it once per main loop
+ * iteration instead of once per canvas. This requires a double-buffered,
+ * single-sampled visual and OpenGL 3.0, GL_ARB_framebuffer_object or OpenGL
+ * ES 3.0; otherwise, each member renders to its own surface. The drawable
+ * covers the members' allocations, so members must not be overlapped by
+ * other widgets or clipped by scrolled windows. Contexts of such members are
+ * always created on the main thread. Backends without support for the mode
+ * only share objects.
+ */
+void gtk_gl_share_group_set_single_context(GtkGLShareGroup *group,
+        gboolean single_context);
+
+
+/**
+ * gtk_gl_share_group_get_single_context:
+ * @group: The group
+ *
+ * Returns: Whether single-context mode is enabled on the group
+ */
+gboolean gtk_gl_share_group_get_single_context(GtkGLShareGroup *group);
+
+
+/**
+ * gtk_gl_share_group_list_canvases:
+ * @group: The group
+ *
+ * Lists the canvases whose current context shares objects with the group.
+ * Objects uploaded in any of their contexts can be drawn in all of them.
+ *
+ * Returns: (transfer container): A #GList of #GtkGLCanvas, free it with
+ *         g_list_free()
+ */
+GList *gtk_gl_share_group_list_canvases(GtkGLShareGroup *group);
+
+
+/**
+ * gtk_gl_canvas_set_share_group:
+ * @canvas: The canvas
+ * @group: The group to join, or %NULL to not share
+ *
+ * Sets the share group for contexts created on the canvas afterwards. A
+ * context that already exists keeps sharing with the group it was created
+ * in. All members of a group must reside on the same screen.
+ */
+void gtk_gl_canvas_set_share_group(GtkGLCanvas *canvas,
+        GtkGLShareGroup *group);
+
+
+/**
+ * gtk_gl_canvas_get_share_group:
+ * @canvas: The canvas
+ *
+ * Returns: (transfer none): The share group set on the canvas, or %NULL
+ */
+GtkGLShareGroup *gtk_gl_canvas_get_share_group(GtkGLCanvas *canvas);
+
+
 /**
  * gtk_gl_canvas_make_current:
  * @canvas: The canvas
  *
  * Makes the OpenGL context of a #GtkGLCanvas current to the calling thread.
  * After this, any calls to gl* functions will refer to the context of this
- * canvas. If the canvas does not have a context, this is a no-op.
+ * canvas. If the canvas does not have a context, this is a no-op. In
+ * single-context mode, this also binds the canvas' framebuffer object, see
+ * #gtk_gl_share_group_set_single_context().
  */
 void gtk_gl_canvas_make_current(GtkGLCanvas* canvas);
 
 
+/**
+ * gtk_gl_canvas_get_framebuffer:
+ * @canvas: The canvas
+ *
+ * Returns the framebuffer object a canvas in single-context mode renders to.
+ * Applications that bind framebuffers of their own must rebind this one
+ * instead of framebuffer zero to draw to the canvas.
+ *
+ * Returns: The framebuffer object name, or zero if the canvas renders to its
+ *          window or has no context
+ */
+guint gtk_gl_canvas_get_framebuffer(GtkGLCanvas *canvas);
+
+
 /**
  * gtk_gl_canvas_display_frame:
  * @canvas: The canvas
  *
  * Swaps the front and back buffer in a double-buffered GL context or flushes
- * all GL draw calls in a single-buffered context.
+ * all GL draw calls in a single-buffered context. Canvases sharing a
+ * toplevel drawable in single-context mode are presented together once
+ * control returns to the main loop, see
+ * #gtk_gl_share_group_set_single_context().
  *
  * Call this function after rendering a frame.
  */
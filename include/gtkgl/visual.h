@@ -93,6 +93,22 @@ typedef enum _GtkGLCaveat {
 } GtkGLCaveat;
 
 
+/**
+ * GtkGLSwapMethod:
+ * @GTK_GL_SWAP_UNDEFINED: The back buffer contents are undefined after a swap
+ * @GTK_GL_SWAP_EXCHANGE: Front and back buffer are exchanged (a page flip)
+ * @GTK_GL_SWAP_COPY: The back buffer is copied to the front buffer and keeps
+ *         its contents
+ *
+ * How a double-buffered framebuffer configuration presents its back buffer.
+ */
+typedef enum _GtkGLSwapMethod {
+    GTK_GL_SWAP_UNDEFINED,
+    GTK_GL_SWAP_EXCHANGE,
+    GTK_GL_SWAP_COPY
+} GtkGLSwapMethod;
+
+
 /**
  * GtkGLVisual:
  * The backend-dependent handle of a framebuffer configurations.
@@ -106,7 +122,16 @@ typedef struct _GtkGLVisual GtkGLVisual;
  * @count: The number of list entries
  * @entries: The array of list entries
  *
- * A list of backend handles to framebuffer configurations.
+ * A reference-counted list of backend handles to framebuffer configurations.
+ * Lists created with #gtk_gl_visual_list_new() are not to be modified once
+ * they have been passed to #gtk_gl_choose_visuals() or shared with
+ * #gtk_gl_visual_list_ref().
+ *
+ * A GtkGLVisualList filled in by the caller is still accepted as a pool by
+ * the choosing functions, but it is described anew on every call and
+ * #gtk_gl_choose_visuals_cached() does not memoise its results. It must not be
+ * passed to #gtk_gl_visual_list_ref() or #gtk_gl_visual_list_unref(), and it
+ * must outlive slices and filtered views made from it.
  */
 typedef struct _GtkGLVisualList {
     gboolean is_owner;
@@ -117,7 +142,9 @@ typedef struct _GtkGLVisualList {
 
 /**
  * GtkGLFramebufferConfig:
- * @accelerated: Whether the framebuffer supports hardware-acceleration
+ * @accelerated: Whether the framebuffer supports hardware-acceleration. This
+ *         is %FALSE for software and indirect renderers; if no visual is
+ *         accelerated, only software rendering is available.
  * @color_types: The color types supported (combination of values in
  *         GtkGLColorType)
  * @color_bpp: The number of bits per pixel in the color buffer (for RGBA
@@ -162,7 +189,15 @@ typedef struct _GtkGLVisualList {
  *         framebuffers)
  * @sample_buffers: The number of sample buffers available
  * @samples_per_pixel: The number of samples per pixel possible
- * @caveat: The framebuffer configuration's caveat, if any
+ * @caveat: The framebuffer configuration's caveat, if any. Configurations
+ *         served by a software or indirect renderer are at least
+ *         %GTK_GL_CAVEAT_SLOW.
+ * @swap_method: How buffer swaps are performed; %GTK_GL_SWAP_UNDEFINED if the
+ *         backend cannot tell
+ * @srgb_capable: Whether the framebuffer can perform sRGB-encoded writes
+ * @float_color: Whether the color buffer stores floating-point components
+ * @buffer_age: Whether the age of the back buffer can be queried after a
+ *         swap, allowing partial redraws
  *
  * A structure describing framebuffer configurations platform-independently.
  */
@@ -193,6 +228,10 @@ typedef struct _GtkGLFramebufferConfig {
     guint sample_buffers;
     guint samples_per_pixel;
     GtkGLCaveat caveat;
+    GtkGLSwapMethod swap_method;
+    gboolean srgb_capable;
+    gboolean float_color;
+    gboolean buffer_age;
 } GtkGLFramebufferConfig;
 
 
@@ -226,6 +265,10 @@ typedef struct _GtkGLFramebufferConfig {
  * @GTK_GL_SAMPLE_BUFFERS: Marks #GtkGLFramebufferConfig.sample_buffers
  * @GTK_GL_SAMPLES_PER_PIXEL: Marks #GtkGLFramebufferConfig.samples_per_pixel
  * @GTK_GL_CAVEAT: Marks #GtkGLFramebufferConfig.caveat
+ * @GTK_GL_SWAP_METHOD: Marks #GtkGLFramebufferConfig.swap_method
+ * @GTK_GL_SRGB_CAPABLE: Marks #GtkGLFramebufferConfig.srgb_capable
+ * @GTK_GL_FLOAT_COLOR: Marks #GtkGLFramebufferConfig.float_color
+ * @GTK_GL_BUFFER_AGE: Marks #GtkGLFramebufferConfig.buffer_age
  *
  * Tokens to mark framebuffer attributes in #gtk_gl_choose_visuals()
  */
@@ -256,7 +299,11 @@ typedef enum _GtkGLAttribute {
     GTK_GL_TRANSPARENT_ALPHA,
     GTK_GL_SAMPLE_BUFFERS,
     GTK_GL_SAMPLES_PER_PIXEL,
-    GTK_GL_CAVEAT
+    GTK_GL_CAVEAT,
+    GTK_GL_SWAP_METHOD,
+    GTK_GL_SRGB_CAPABLE,
+    GTK_GL_FLOAT_COLOR,
+    GTK_GL_BUFFER_AGE
 } GtkGLAttribute;
 
 
@@ -311,12 +358,192 @@ typedef struct _GtkGLRequirement {
  *
  * Filters and sorts a GtkGLVisualList by the criteria provided in
  * the requirements parameter.
+ *
+ * Only the attributes read by the requirements and the tie-break order are
+ * queried from the backend, each once on first use. They are cached with the
+ * pool, so repeated calls on the same pool do not query the backend again.
  * Returns: A filtered and sorted #GtkGLVisualList, owned by the caller
  */
 GtkGLVisualList *gtk_gl_choose_visuals(const GtkGLVisualList *pool,
         const GtkGLRequirement *requirements);
 
 
+/**
+ * GtkGLCostTerm:
+ * @attr: The attribute
+ * @target: The preferred value of the attribute
+ * @weight: The cost per unit of distance between the value and @target
+ *
+ * A per-attribute term of a #GtkGLCostModel.
+ */
+typedef struct _GtkGLCostTerm {
+    GtkGLAttribute attr;
+    gint target;
+    gdouble weight;
+} GtkGLCostTerm;
+
+
+/**
+ * GtkGLCostModel:
+ * @memory_weight: The cost per byte of estimated framebuffer memory per pixel
+ * @bandwidth_weight: The cost per byte of estimated memory traffic per pixel
+ *         and frame
+ * @terms: An array of #GtkGLCostTerm, terminated by an entry with attribute
+ *         #GTK_GL_NONE, or %NULL
+ *
+ * Scoring for #gtk_gl_choose_visuals_by_cost(). The memory and bandwidth
+ * estimates are derived from the color, depth, stencil, accumulation and
+ * auxiliary buffer sizes, the number of samples and the buffering mode.
+ *
+ * For example, a term preferring 4 samples with a weight below the bandwidth
+ * cost of a wider depth buffer selects 4x multisampling unless it requires a
+ * 32-bit depth buffer.
+ */
+typedef struct _GtkGLCostModel {
+    gdouble memory_weight;
+    gdouble bandwidth_weight;
+    const GtkGLCostTerm *terms;
+} GtkGLCostModel;
+
+
+/**
+ * gtk_gl_framebuffer_config_cost:
+ * @config: The framebuffer configuration
+ * @model: The cost model
+ *
+ * Returns: The score of @config under @model, lower is better
+ */
+gdouble gtk_gl_framebuffer_config_cost(const GtkGLFramebufferConfig *config,
+        const GtkGLCostModel *model);
+
+
+/**
+ * gtk_gl_choose_visuals_by_cost:
+ * @pool: The list of visuals to choose from
+ * @requirements: An array of #GtkGLRequirement, terminated by #GTK_GL_LIST_END
+ * @model: The cost model
+ *
+ * Filters a GtkGLVisualList like #gtk_gl_choose_visuals(), but sorts the
+ * result by ascending cost under @model instead of lexicographically.
+ * Visuals of equal cost keep the order of #gtk_gl_choose_visuals().
+ *
+ * Returns: A filtered and sorted #GtkGLVisualList, owned by the caller
+ */
+GtkGLVisualList *gtk_gl_choose_visuals_by_cost(const GtkGLVisualList *pool,
+        const GtkGLRequirement *requirements, const GtkGLCostModel *model);
+
+
+/**
+ * gtk_gl_choose_visuals_cached:
+ * @pool: The list of visuals to choose from
+ * @requirements: An array of #GtkGLRequirement, terminated by #GTK_GL_LIST_END
+ *
+ * Like #gtk_gl_choose_visuals(), but remembers the result for each distinct
+ * requirement list with the pool. Repeated calls with an equal requirement
+ * list return the same list again without filtering or sorting.
+ *
+ * The returned list is shared between all callers and must not be modified.
+ * Each caller releases its reference with #gtk_gl_visual_list_free(). The
+ * remembered results are released together with the pool. This function is
+ * thread-safe.
+ *
+ * Returns: A shared, filtered and sorted #GtkGLVisualList
+ */
+GtkGLVisualList *gtk_gl_choose_visuals_cached(const GtkGLVisualList *pool,
+        const GtkGLRequirement *requirements);
+
+
+/**
+ * gtk_gl_choose_best_visual:
+ * @pool: The list of visuals to choose from
+ * @requirements: An array of #GtkGLRequirement, terminated by #GTK_GL_LIST_END
+ *
+ * Finds the visual that #gtk_gl_choose_visuals() would return first, using a
+ * single linear scan over the pool and without allocating a result list.
+ *
+ * Returns: The best suitable visual, or %NULL if no visual fulfills the
+ *         requirements
+ */
+GtkGLVisual *gtk_gl_choose_best_visual(const GtkGLVisualList *pool,
+        const GtkGLRequirement *requirements);
+
+
+/**
+ * gtk_gl_choose_best_visuals:
+ * @pool: The list of visuals to choose from
+ * @requirements: An array of #GtkGLRequirement, terminated by #GTK_GL_LIST_END
+ * @best: An array of at least @k entries receiving the best visuals
+ * @k: The maximum number of visuals to return
+ *
+ * Finds the first @k visuals in the order of #gtk_gl_choose_visuals() in a
+ * single scan over the pool. This is cheaper than a full sort for small @k.
+ *
+ * Returns: The number of visuals written to @best, at most @k
+ */
+gsize gtk_gl_choose_best_visuals(const GtkGLVisualList *pool,
+        const GtkGLRequirement *requirements, GtkGLVisual **best, gsize k);
+
+
+/**
+ * GtkGLRequirementProgram:
+ *
+ * A requirement list compiled for repeated evaluation against one or more
+ * visual pools. Compiling normalizes every requirement once, so choosing
+ * visuals with a program skips the per-call interpretation of the list.
+ */
+typedef struct _GtkGLRequirementProgram GtkGLRequirementProgram;
+
+
+/**
+ * gtk_gl_requirement_program_new:
+ * @requirements: An array of #GtkGLRequirement, terminated by #GTK_GL_LIST_END
+ *
+ * Compiles a requirement list. The list is not referenced after the call.
+ *
+ * Returns: A new #GtkGLRequirementProgram, to be freed with
+ *         #gtk_gl_requirement_program_free()
+ */
+GtkGLRequirementProgram *gtk_gl_requirement_program_new(
+        const GtkGLRequirement *requirements);
+
+
+/**
+ * gtk_gl_requirement_program_free:
+ * @program: The program, may be %NULL
+ *
+ * Frees a program returned by #gtk_gl_requirement_program_new().
+ */
+void gtk_gl_requirement_program_free(GtkGLRequirementProgram *program);
+
+
+/**
+ * gtk_gl_choose_visuals_compiled:
+ * @pool: The list of visuals to choose from
+ * @program: The compiled requirements
+ *
+ * Like #gtk_gl_choose_visuals(), but with a precompiled requirement list.
+ *
+ * Returns: A filtered and sorted #GtkGLVisualList, owned by the caller
+ */
+GtkGLVisualList *gtk_gl_choose_visuals_compiled(const GtkGLVisualList *pool,
+        const GtkGLRequirementProgram *program);
+
+
+/**
+ * gtk_gl_choose_best_visuals_compiled:
+ * @pool: The list of visuals to choose from
+ * @program: The compiled requirements
+ * @best: An array of at least @k entries receiving the best visuals
+ * @k: The maximum number of visuals to return
+ *
+ * Like #gtk_gl_choose_best_visuals(), but with a precompiled requirement list.
+ *
+ * Returns: The number of visuals written to @best, at most @k
+ */
+gsize gtk_gl_choose_best_visuals_compiled(const GtkGLVisualList *pool,
+        const GtkGLRequirementProgram *program, GtkGLVisual **best, gsize k);
+
+
 /**
  * gtk_gl_visual_free:
  * @vis: The visual
@@ -324,7 +551,9 @@ GtkGLVisualList *gtk_gl_choose_visuals(const GtkGLVisualList *pool,
  * Frees a visual that was returned by #gtk_gl_canvas_enumerate_visuals()
  * before.
  *
- * You should consider using #gtk_gl_visual_list_free instead.
+ * You should consider using #gtk_gl_visual_list_free instead. Backends that
+ * cache their visuals return lists that do not own their entries, in which
+ * case the entries must not be freed at all.
  */
 void gtk_gl_visual_free(GtkGLVisual *vis);
 
@@ -342,16 +571,71 @@ GtkGLVisualList *gtk_gl_visual_list_new(gboolean is_owner, gsize count);
 
 
 /**
- * gtk_gl_visual_list_free:
+ * gtk_gl_visual_list_ref:
  * @visuals: The list
  *
- * Frees a #GtkGLVisualList.
+ * Acquires a reference on a #GtkGLVisualList. Lists start out with a single
+ * reference held by their creator.
  *
- * Optionally frees the entries if the list structure owns them.
+ * Returns: The list
+ */
+GtkGLVisualList *gtk_gl_visual_list_ref(GtkGLVisualList *visuals);
+
+
+/**
+ * gtk_gl_visual_list_unref:
+ * @visuals: The list, may be %NULL
+ *
+ * Releases a reference on a #GtkGLVisualList. Dropping the last reference
+ * frees the list, its entries if the list owns them, and the reference it
+ * holds on the list it is a view of.
+ */
+void gtk_gl_visual_list_unref(GtkGLVisualList *visuals);
+
+
+/**
+ * gtk_gl_visual_list_free:
+ * @visuals: The list
+ *
+ * Equivalent to #gtk_gl_visual_list_unref(). Lists returned by
+ * #gtk_gl_choose_visuals_cached() are shared, and only the last reference
+ * frees them.
  */
 void gtk_gl_visual_list_free(GtkGLVisualList *visuals);
 
 
+/**
+ * gtk_gl_visual_list_slice:
+ * @visuals: The list
+ * @offset: The index of the first entry of the view
+ * @count: The number of entries in the view
+ *
+ * Creates a view of a contiguous range of a list. The view shares the entries
+ * array of @visuals instead of copying it and keeps @visuals alive until the
+ * view is released.
+ *
+ * Returns: A new view, to be released with #gtk_gl_visual_list_unref()
+ */
+GtkGLVisualList *gtk_gl_visual_list_slice(GtkGLVisualList *visuals,
+        gsize offset, gsize count);
+
+
+/**
+ * gtk_gl_visual_list_filter:
+ * @visuals: The list
+ * @requirements: An array of #GtkGLRequirement, terminated by #GTK_GL_LIST_END
+ *
+ * Creates a view of all visuals in a list that fulfill the filtering
+ * requirements (#GTK_GL_EXACTLY, #GTK_GL_AT_MOST, #GTK_GL_AT_LEAST), in list
+ * order. Unlike #gtk_gl_choose_visuals(), the result is not sorted and keeps
+ * @visuals alive until the view is released.
+ *
+ * Returns: A new view, to be released with #gtk_gl_visual_list_unref()
+ */
+GtkGLVisualList *gtk_gl_visual_list_filter(GtkGLVisualList *visuals,
+        const GtkGLRequirement *requirements);
+
+
 /**
  * gtk_gl_describe_visual:
  * @visual: The visual
@@ -362,4 +646,19 @@ void gtk_gl_describe_visual(const GtkGLVisual *visual,
         GtkGLFramebufferConfig *out);
 
 
+/**
+ * gtk_gl_describe_visuals:
+ * @visuals: The list of visuals
+ * @out: An array of at least @visuals->count framebuffer configurations to
+ *         write to
+ *
+ * Fills a #GtkGLFramebufferConfig structure for every entry of a visual list.
+ *
+ * Unlike calling #gtk_gl_describe_visual() for each entry, the backend's
+ * version and extension support is only resolved once for the whole list.
+ */
+void gtk_gl_describe_visuals(const GtkGLVisualList *visuals,
+        GtkGLFramebufferConfig *out);
+
+
 G_END_DECLS
@@ -0,0 +1,162 @@
+/**
+ * Copyright (c) 2014-2015, Fabian Knorr
+ *
+ * This file is part of libgtkglcanvas.
+ *
+ * libgtkglcanvas is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libgtkglcanvas is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libgtkglcanvas. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Compares the window system backends (see gtk_gl_get_backend_name()):
+ * reports the time of destroying and recreating a context, of switching the
+ * current context between two canvases, and of presenting a frame. The
+ * backend is chosen once per process, so "make bench-backend" runs this once
+ * with GTK_GL_BACKEND=glx and once with GTK_GL_BACKEND=egl. Requires a
+ * display; without a GPU, run it on Xvfb with Mesa's llvmpipe:
+ *
+ *     xvfb-run -a env LIBGL_ALWAYS_SOFTWARE=1 make bench-backend
+ *
+ * The results depend on the driver and the server, so none are kept in the
+ * tree; quote them together with the renderer printed below the table.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+
+#include <epoxy/gl.h>
+#include <gtkgl/canvas.h>
+
+
+// Minimum wall time per measurement
+#define MIN_DURATION_US 500000
+
+#define CANVAS_SIZE 256
+
+
+static const GtkGLRequirement requirements[] = {
+    { GTK_GL_COLOR_TYPES, GTK_GL_EXACTLY, GTK_GL_COLOR_RGBA },
+    { GTK_GL_DOUBLE_BUFFERED, GTK_GL_EXACTLY, TRUE },
+    GTK_GL_LIST_END
+};
+
+
+typedef struct _Result {
+    double create_ms;  // Destroying and recreating the context of one canvas
+    double switch_us;  // Making the context of the other canvas current
+    double swap_us;  // Clearing and presenting one frame
+    gchar *renderer;  // GL_RENDERER of the measured context
+} Result;
+
+
+static void
+process_events(void) {
+    while (gtk_events_pending()) gtk_main_iteration();
+}
+
+
+static gboolean
+measure(Result *result) {
+    GtkWidget *window, *box;
+    GtkGLCanvas *canvases[2];
+    gint64 start, elapsed;
+    gboolean success = TRUE;
+    guint count, performed;
+    gsize i;
+
+    window = gtk_window_new(GTK_WINDOW_TOPLEVEL);
+    box = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 0);
+    gtk_container_add(GTK_CONTAINER(window), box);
+    for (i = 0; i < G_N_ELEMENTS(canvases); ++i) {
+        canvases[i] = GTK_GL_CANVAS(gtk_gl_canvas_new());
+        gtk_widget_set_size_request(GTK_WIDGET(canvases[i]), CANVAS_SIZE,
+                CANVAS_SIZE);
+        gtk_box_pack_start(GTK_BOX(box), GTK_WIDGET(canvases[i]), TRUE, TRUE,
+                0);
+    }
+    gtk_widget_show_all(window);
+    process_events();
+
+    for (i = 0; i < G_N_ELEMENTS(canvases) && success; ++i) {
+        success = gtk_gl_canvas_auto_create_context(canvases[i],
+                requirements);
+    }
+
+    if (success) {
+        count = 0;
+        start = g_get_monotonic_time();
+        do {
+            gtk_gl_canvas_destroy_context(canvases[0]);
+            success = gtk_gl_canvas_auto_create_context(canvases[0],
+                    requirements);
+            ++count;
+            elapsed = g_get_monotonic_time() - start;
+        } while (success && elapsed < MIN_DURATION_US);
+        result->create_ms = elapsed / 1000.0 / count;
+    }
+
+    if (success) {
+        // Every call switches, so none is skipped as redundant
+        gtk_gl_reset_make_current_stats();
+        count = 0;
+        start = g_get_monotonic_time();
+        do {
+            gtk_gl_canvas_make_current(canvases[count++ % 2]);
+            elapsed = g_get_monotonic_time() - start;
+        } while (elapsed < MIN_DURATION_US);
+        gtk_gl_get_make_current_stats(&performed, NULL);
+        result->switch_us = (double) elapsed / MAX(performed, 1);
+
+        gtk_gl_canvas_make_current(canvases[0]);
+        result->renderer = g_strdup((const gchar*) glGetString(GL_RENDERER));
+        glViewport(0, 0, CANVAS_SIZE, CANVAS_SIZE);
+        count = 0;
+        start = g_get_monotonic_time();
+        do {
+            float shade = (float) (count++ % 64) / 64;
+            glClearColor(shade, 0.5f, 1 - shade, 1);
+            glClear(GL_COLOR_BUFFER_BIT);
+            gtk_gl_canvas_display_frame(canvases[0]);
+            elapsed = g_get_monotonic_time() - start;
+        } while (elapsed < MIN_DURATION_US);
+        glFinish();
+        result->swap_us = (double) (g_get_monotonic_time() - start) / count;
+    }
+
+    gtk_widget_destroy(window);
+    process_events();
+    return success;
+}
+
+
+int
+main(int argc, char **argv) {
+    Result result;
+
+    // Measure the library, not the display's refresh rate (honored by Mesa)
+    g_setenv("vblank_mode", "0", FALSE);
+    gtk_init(&argc, &argv);
+
+    printf("%10s %15s %15s %15s\n", "backend", "create (ms)",
+            "switch (us)", "swap (us)");
+    printf("%10s", gtk_gl_get_backend_name());
+    if (measure(&result)) {
+        printf(" %15.3f %15.3f %15.3f\n", result.create_ms, result.switch_us,
+                result.swap_us);
+        printf("renderer: %s\n", result.renderer);
+        g_free(result.renderer);
+        return EXIT_SUCCESS;
+    } else {
+        printf(" %15s\n", "failed");
+        return EXIT_FAILURE;
+    }
+}
@@ -0,0 +1,201 @@
+/**
+ * Copyright (c) 2014-2015, Fabian Knorr
+ *
+ * This file is part of libgtkglcanvas.
+ *
+ * libgtkglcanvas is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libgtkglcanvas is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libgtkglcanvas. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Renders a frame on every canvas of a window with many small canvases and
+ * reports the time per frame, comparing one context and swap per canvas
+ * against a share group in single-context mode, which renders into
+ * framebuffer objects and swaps once for the whole window. Also reports the
+ * latency of destroying and recreating a context, which is dominated by
+ * server round trips when run against a remote display. Requires a display.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
+
+#include <epoxy/gl.h>
+#include <gtkgl/canvas.h>
+
+
+// Minimum wall time per measurement
+#define MIN_DURATION_US 500000
+
+#define CANVAS_SIZE 64
+
+
+static const GtkGLRequirement requirements[] = {
+    { GTK_GL_COLOR_TYPES, GTK_GL_EXACTLY, GTK_GL_COLOR_RGBA },
+    { GTK_GL_DOUBLE_BUFFERED, GTK_GL_EXACTLY, TRUE },
+    GTK_GL_LIST_END
+};
+
+
+typedef enum _Mode {
+    MODE_PER_CANVAS,  // Every canvas has its own context
+    MODE_SINGLE_CONTEXT,  // All canvases in one single-context share group
+    N_MODES
+} Mode;
+
+
+static const char *const mode_names[N_MODES] = {
+    "per-canvas", "single-context"
+};
+
+
+typedef struct _Result {
+    double create_ms;  // Creating the contexts of all canvases
+    double frame_ms;  // Drawing and presenting one frame on all canvases
+    double cycle_ms;  // Destroying and recreating the context of one canvas
+} Result;
+
+
+static void
+process_events(void) {
+    while (gtk_events_pending()) gtk_main_iteration();
+}
+
+
+static void
+render_frame(GtkGLCanvas **canvases, gsize count, guint frame) {
+    gsize i;
+
+    for (i = 0; i < count; ++i) {
+        float shade = (float) ((frame + i) % 64) / 64;
+        gtk_gl_canvas_make_current(canvases[i]);
+        // Canvases in single-context mode share the viewport state
+        glViewport(0, 0, CANVAS_SIZE, CANVAS_SIZE);
+        glClearColor(shade, 0.5f, 1 - shade, 1);
+        glClear(GL_COLOR_BUFFER_BIT);
+        gtk_gl_canvas_display_frame(canvases[i]);
+    }
+    // Single-context groups present from the main loop
+    process_events();
+}
+
+
+static gboolean
+measure(gsize count, Mode mode, Result *result) {
+    GtkWidget *window, *grid;
+    GtkGLCanvas **canvases = g_new(GtkGLCanvas*, count);
+    GtkGLShareGroup *group = NULL;
+    gsize columns = (gsize) ceil(sqrt((double) count));
+    gint64 start, elapsed;
+    gboolean success = TRUE;
+    guint frames = 0, cycles = 0;
+    gsize i;
+
+    window = gtk_window_new(GTK_WINDOW_TOPLEVEL);
+    grid = gtk_grid_new();
+    gtk_container_add(GTK_CONTAINER(window), grid);
+    if (mode == MODE_SINGLE_CONTEXT) {
+        group = gtk_gl_share_group_new();
+        gtk_gl_share_group_set_single_context(group, TRUE);
+    }
+    for (i = 0; i < count; ++i) {
+        canvases[i] = GTK_GL_CANVAS(gtk_gl_canvas_new());
+        gtk_widget_set_size_request(GTK_WIDGET(canvases[i]), CANVAS_SIZE,
+                CANVAS_SIZE);
+        if (group) gtk_gl_canvas_set_share_group(canvases[i], group);
+        gtk_grid_attach(GTK_GRID(grid), GTK_WIDGET(canvases[i]),
+                (gint) (i % columns), (gint) (i / columns), 1, 1);
+    }
+    gtk_widget_show_all(window);
+    process_events();
+
+    start = g_get_monotonic_time();
+    for (i = 0; i < count && success; ++i) {
+        success = gtk_gl_canvas_auto_create_context(canvases[i],
+                requirements);
+    }
+    result->create_ms = (g_get_monotonic_time() - start) / 1000.0;
+
+    if (success) {
+        // Warm up
+        render_frame(canvases, count, frames++);
+        glFinish();
+
+        start = g_get_monotonic_time();
+        do {
+            render_frame(canvases, count, frames++);
+            elapsed = g_get_monotonic_time() - start;
+        } while (elapsed < MIN_DURATION_US);
+        glFinish();
+        result->frame_ms = (g_get_monotonic_time() - start) / 1000.0
+                / (frames - 1);
+
+        start = g_get_monotonic_time();
+        do {
+            gtk_gl_canvas_destroy_context(canvases[0]);
+            success = gtk_gl_canvas_auto_create_context(canvases[0],
+                    requirements);
+            ++cycles;
+            elapsed = g_get_monotonic_time() - start;
+        } while (success && elapsed < MIN_DURATION_US);
+        result->cycle_ms = elapsed / 1000.0 / cycles;
+    }
+
+    gtk_widget_destroy(window);
+    process_events();
+    if (group) gtk_gl_share_group_unref(group);
+    g_free(canvases);
+    return success;
+}
+
+
+int
+main(int argc, char **argv) {
+    static const gsize default_counts[] = { 1, 8, 32, 128 };
+    gsize n_counts = argc > 1 ? (gsize) argc - 1
+            : G_N_ELEMENTS(default_counts);
+    gsize i;
+    int mode;
+
+    // Measure the library, not the display's refresh rate (honored by Mesa)
+    g_setenv("vblank_mode", "0", FALSE);
+    gtk_init(&argc, &argv);
+
+    printf("%10s", "canvases");
+    for (mode = 0; mode < N_MODES; ++mode) {
+        printf(" %15s %15s %15s", mode_names[mode], "", "");
+    }
+    printf("\n%10s", "");
+    for (mode = 0; mode < N_MODES; ++mode) {
+        printf(" %15s %15s %15s", "create (ms)", "frame (ms)",
+                "cycle (ms)");
+    }
+    printf("\n");
+
+    for (i = 0; i < n_counts; ++i) {
+        gsize count = argc > 1 ? strtoul(argv[i + 1], NULL, 10)
+                : default_counts[i];
+
+        printf("%10zu", count);
+        for (mode = 0; mode < N_MODES; ++mode) {
+            Result result;
+            if (measure(count, mode, &result)) {
+                printf(" %15.3f %15.3f %15.3f", result.create_ms,
+                        result.frame_ms, result.cycle_ms);
+            } else {
+                printf(" %15s %15s %15s", "failed", "", "");
+            }
+        }
+        printf("\n");
+    }
+    return EXIT_SUCCESS;
+}
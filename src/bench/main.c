@@ -0,0 +1,183 @@
+/**
+ * Copyright (c) 2014-2015, Fabian Knorr
+ *
+ * This file is part of libgtkglcanvas.
+ *
+ * libgtkglcanvas is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libgtkglcanvas is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libgtkglcanvas. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+
+#include <gtkgl/visual.h>
+#include "mock.h"
+
+
+// Minimum wall time per measurement
+#define MIN_DURATION_US 200000
+
+
+static const GtkGLRequirement requirements[] = {
+    { GTK_GL_COLOR_TYPES, GTK_GL_EXACTLY, GTK_GL_COLOR_RGBA },
+    { GTK_GL_DOUBLE_BUFFERED, GTK_GL_EXACTLY, TRUE },
+    { GTK_GL_COLOR_BPP, GTK_GL_AT_LEAST, 24 },
+    { GTK_GL_DEPTH_BPP, GTK_GL_AT_LEAST, 16 },
+    { GTK_GL_STENCIL_BPP, GTK_GL_AT_LEAST, 8 },
+    { GTK_GL_SAMPLES_PER_PIXEL, GTK_GL_PREFERABLY, 4 },
+    GTK_GL_LIST_END
+};
+
+
+// Prefer 4x multisampling, but not at the price of much wider buffers
+static const GtkGLCostTerm cost_terms[] = {
+    { GTK_GL_SAMPLES_PER_PIXEL, 4, 4.0 },
+    { GTK_GL_NONE, 0, 0 }
+};
+
+static const GtkGLCostModel cost_model = { 0.25, 1.0, cost_terms };
+
+// Scores the per-frame memory traffic only
+static const GtkGLCostModel fill_cost_model = { 0.0, 1.0, NULL };
+
+
+typedef enum _Operation {
+    OP_DESCRIBE,  // Attribute table construction on a fresh pool
+    OP_FILTER,    // gtk_gl_visual_list_filter()
+    OP_CHOOSE,    // gtk_gl_choose_visuals(), filtering and sorting
+    OP_BEST,      // gtk_gl_choose_best_visual(), filtering and top-1 ranking
+    OP_COST,      // gtk_gl_choose_visuals_by_cost()
+    N_OPERATIONS
+} Operation;
+
+
+static const char *const operation_names[N_OPERATIONS] = {
+    "describe", "filter", "choose", "best", "cost"
+};
+
+
+static void
+run_operation(Operation op, GtkGLVisualList *pool) {
+    GtkGLVisualList *list;
+
+    switch (op) {
+        case OP_DESCRIBE:
+            // A slice has its own attribute table, built by the first filter
+            list = gtk_gl_visual_list_slice(pool, 0, pool->count);
+            gtk_gl_visual_list_unref(gtk_gl_visual_list_filter(list,
+                    (const GtkGLRequirement[]) { GTK_GL_LIST_END }));
+            gtk_gl_visual_list_unref(list);
+            break;
+
+        case OP_FILTER:
+            gtk_gl_visual_list_unref(gtk_gl_visual_list_filter(pool,
+                    requirements));
+            break;
+
+        case OP_CHOOSE:
+            gtk_gl_visual_list_unref(gtk_gl_choose_visuals(pool,
+                    requirements));
+            break;
+
+        case OP_BEST:
+            gtk_gl_choose_best_visual(pool, requirements);
+            break;
+
+        case OP_COST:
+            gtk_gl_visual_list_unref(gtk_gl_choose_visuals_by_cost(pool,
+                    requirements, &cost_model));
+            break;
+
+        default:
+            break;
+    }
+}
+
+
+// Returns the average time per configuration in nanoseconds
+static double
+measure(Operation op, GtkGLVisualList *pool) {
+    gint64 start, elapsed;
+    gsize iterations = 0;
+
+    // Warm up, this also builds the attribute table of the pool
+    run_operation(op, pool);
+
+    start = g_get_monotonic_time();
+    do {
+        run_operation(op, pool);
+        ++iterations;
+        elapsed = g_get_monotonic_time() - start;
+    } while (elapsed < MIN_DURATION_US);
+
+    return 1000.0 * elapsed / iterations / MAX(pool->count, 1);
+}
+
+
+// Returns the fill cost of the first visual of a list, or 0 if it is empty
+static double
+first_fill_cost(GtkGLVisualList *list) {
+    GtkGLFramebufferConfig config;
+    double cost = 0;
+
+    if (list->count) {
+        gtk_gl_describe_visual(list->entries[0], &config);
+        cost = gtk_gl_framebuffer_config_cost(&config, &fill_cost_model);
+    }
+    gtk_gl_visual_list_unref(list);
+    return cost;
+}
+
+
+int
+main(int argc, char **argv) {
+    static const gsize default_sizes[] = { 10, 100, 1000, 10000, 100000 };
+    gsize n_sizes = argc > 1 ? (gsize) argc - 1 : G_N_ELEMENTS(default_sizes);
+    gsize i;
+    int op;
+
+    printf("%10s", "configs");
+    for (op = 0; op < N_OPERATIONS; ++op) {
+        printf(" %12s", operation_names[op]);
+    }
+    printf("   (ns/config)\n");
+
+    for (i = 0; i < n_sizes; ++i) {
+        gsize count = argc > 1 ? strtoul(argv[i + 1], NULL, 10)
+                : default_sizes[i];
+        GtkGLVisualList *pool = mock_visual_pool_new(count, 42);
+
+        printf("%10zu", count);
+        for (op = 0; op < N_OPERATIONS; ++op) {
+            printf(" %12.2f", measure(op, pool));
+        }
+        printf("\n");
+        gtk_gl_visual_list_unref(pool);
+    }
+
+    // Compare the per-frame fill cost of the visual chosen by either ranking
+    printf("\n%10s %14s %14s   (bytes/pixel/frame)\n", "configs",
+            "lexicographic", "cost model");
+    for (i = 0; i < n_sizes; ++i) {
+        gsize count = argc > 1 ? strtoul(argv[i + 1], NULL, 10)
+                : default_sizes[i];
+        GtkGLVisualList *pool = mock_visual_pool_new(count, 42);
+
+        printf("%10zu %14.2f %14.2f\n", count,
+                first_fill_cost(gtk_gl_choose_visuals(pool, requirements)),
+                first_fill_cost(gtk_gl_choose_visuals_by_cost(pool,
+                        requirements, &cost_model)));
+        gtk_gl_visual_list_unref(pool);
+    }
+    return EXIT_SUCCESS;
+}
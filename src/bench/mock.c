@@ -0,0 +1,159 @@
+/**
+ * Copyright (c) 2014-2015, Fabian Knorr
+ *
+ * This file is part of libgtkglcanvas.
+ *
+ * libgtkglcanvas is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libgtkglcanvas is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libgtkglcanvas. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "mock.h"
+#include "canvas_impl.h"
+#include <assert.h>
+
+
+struct _GtkGLVisual {
+    GtkGLFramebufferConfig config;
+};
+
+
+void
+gtk_gl_visual_free(GtkGLVisual *visual) {
+    g_free(visual);
+}
+
+
+void
+gtk_gl_describe_visual(const GtkGLVisual *visual, GtkGLFramebufferConfig *out) {
+    assert(visual);
+    assert(out);
+
+    *out = visual->config;
+}
+
+
+void
+gtk_gl_describe_visuals(const GtkGLVisualList *visuals,
+        GtkGLFramebufferConfig *out) {
+    gsize i;
+
+    assert(visuals);
+    assert(out || !visuals->count);
+
+    for (i = 0; i < visuals->count; ++i) {
+        out[i] = visuals->entries[i]->config;
+    }
+}
+
+
+void
+gtk_gl_describe_visuals_attribute(const GtkGLVisualList *visuals,
+        GtkGLAttribute attr, gint *out) {
+    gsize i;
+
+    assert(visuals);
+    assert(out || !visuals->count);
+
+    for (i = 0; i < visuals->count; ++i) {
+        out[i] = gtk_gl_framebuffer_config_get(&visuals->entries[i]->config,
+                attr);
+    }
+}
+
+
+// Picks one of the values, weighted by the given probabilities in percent
+static gint
+pick(GRand *rand, gsize n, const gint *values, const gint *weights) {
+    gint roll = g_rand_int_range(rand, 0, 100);
+    gsize i;
+
+    for (i = 0; i + 1 < n; ++i) {
+        if (roll < weights[i]) return values[i];
+        roll -= weights[i];
+    }
+    return values[n - 1];
+}
+
+
+#define PICK(rand, values, weights) \
+    pick(rand, G_N_ELEMENTS(values), values, weights)
+
+
+static void
+generate_config(GRand *rand, GtkGLFramebufferConfig *cfg) {
+    static const gint color[] = { 16, 24, 32 }, color_w[] = { 10, 40, 50 };
+    static const gint depth[] = { 0, 16, 24, 32 }, depth_w[] = { 20, 20, 50, 10 };
+    static const gint stencil[] = { 0, 8 }, stencil_w[] = { 50, 50 };
+    static const gint samples[] = { 0, 2, 4, 8, 16 },
+            samples_w[] = { 60, 10, 15, 10, 5 };
+    static const gint accum[] = { 0, 16 }, accum_w[] = { 80, 20 };
+    static const gint aux[] = { 0, 1, 2, 4 }, aux_w[] = { 85, 5, 5, 5 };
+    static const gint caveat[] = { GTK_GL_CAVEAT_NONE, GTK_GL_CAVEAT_SLOW,
+            GTK_GL_CAVEAT_NONCONFORMANT }, caveat_w[] = { 90, 8, 2 };
+    static const gint swap[] = { GTK_GL_SWAP_UNDEFINED, GTK_GL_SWAP_EXCHANGE,
+            GTK_GL_SWAP_COPY }, swap_w[] = { 40, 40, 20 };
+    gint samples_per_pixel;
+
+    cfg->color_types = g_rand_int_range(rand, 0, 100) < 95
+            ? GTK_GL_COLOR_RGBA : GTK_GL_COLOR_INDEXED;
+    cfg->color_bpp = PICK(rand, color, color_w);
+    if (cfg->color_bpp == 16) {
+        cfg->red_color_bpp = cfg->blue_color_bpp = 5;
+        cfg->green_color_bpp = 6;
+        cfg->alpha_color_bpp = 0;
+    } else {
+        cfg->red_color_bpp = cfg->green_color_bpp = cfg->blue_color_bpp = 8;
+        cfg->alpha_color_bpp = cfg->color_bpp - 24;
+    }
+
+    cfg->accelerated = g_rand_int_range(rand, 0, 100) < 90;
+    cfg->fb_level = g_rand_int_range(rand, 0, 100) < 98 ? 0 : 1;
+    cfg->double_buffered = g_rand_boolean(rand);
+    cfg->stereo_buffered = g_rand_int_range(rand, 0, 100) < 2;
+    cfg->aux_buffers = PICK(rand, aux, aux_w);
+    cfg->depth_bpp = PICK(rand, depth, depth_w);
+    cfg->stencil_bpp = PICK(rand, stencil, stencil_w);
+    cfg->red_accum_bpp = cfg->green_accum_bpp = cfg->blue_accum_bpp
+            = cfg->alpha_accum_bpp = PICK(rand, accum, accum_w);
+
+    cfg->transparent_type = GTK_GL_TRANSPARENT_NONE;
+    cfg->transparent_index = cfg->transparent_red = cfg->transparent_green
+            = cfg->transparent_blue = cfg->transparent_alpha = 0;
+
+    samples_per_pixel = PICK(rand, samples, samples_w);
+    cfg->sample_buffers = samples_per_pixel ? 1 : 0;
+    cfg->samples_per_pixel = samples_per_pixel;
+    cfg->caveat = PICK(rand, caveat, caveat_w);
+
+    cfg->swap_method = cfg->double_buffered
+            ? PICK(rand, swap, swap_w) : GTK_GL_SWAP_UNDEFINED;
+    cfg->srgb_capable = cfg->color_bpp >= 24
+            && g_rand_int_range(rand, 0, 100) < 50;
+    cfg->float_color = g_rand_int_range(rand, 0, 100) < 5;
+    cfg->buffer_age = TRUE;
+}
+
+
+GtkGLVisualList *
+mock_visual_pool_new(gsize count, guint32 seed) {
+    GtkGLVisualList *pool = gtk_gl_visual_list_new_inline(count,
+            sizeof(GtkGLVisual));
+    GRand *rand = g_rand_new_with_seed(seed);
+    gsize i;
+
+    for (i = 0; i < count; ++i) {
+        generate_config(rand, &pool->entries[i]->config);
+    }
+    g_rand_free(rand);
+    return pool;
+}
@@ -0,0 +1,35 @@
+/**
+ * Copyright (c) 2014-2015, Fabian Knorr
+ *
+ * This file is part of libgtkglcanvas.
+ *
+ * libgtkglcanvas is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libgtkglcanvas is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libgtkglcanvas. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include <gtkgl/visual.h>
+
+
+/* In-process visual provider for running the visual selection code without a
+ * window system. It implements the backend part of the visual API
+ * (GtkGLVisual, gtk_gl_describe_visual*(), gtk_gl_visual_free) and must be
+ * linked instead of a platform backend.
+ */
+
+// Creates an owning pool of "count" synthetic visuals. The attribute
+// distribution resembles the fbconfig lists of common Mesa and vendor
+// drivers, the same seed always produces the same pool.
+GtkGLVisualList *mock_visual_pool_new(gsize count, guint32 seed);
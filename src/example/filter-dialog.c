@@ -33,7 +33,8 @@ typedef enum _AttrType {
 	ATTR_UNSIGNED,
 	ATTR_COLOR_TYPES,
 	ATTR_TRANSP_TYPE,
-	ATTR_CAVEAT
+	ATTR_CAVEAT,
+	ATTR_SWAP_METHOD
 } AttrType;
 
 
@@ -70,7 +71,11 @@ static const AttrDescriptor attrs[] = {
 	{ GTK_GL_TRANSPARENT_ALPHA, "Transparent Alpha", ATTR_UNSIGNED },
 	{ GTK_GL_SAMPLE_BUFFERS, "Sample Buffers", ATTR_UNSIGNED },
 	{ GTK_GL_SAMPLES_PER_PIXEL, "Samples per Pixel", ATTR_UNSIGNED },
-	{ GTK_GL_CAVEAT, "Caveat", ATTR_CAVEAT }
+	{ GTK_GL_CAVEAT, "Caveat", ATTR_CAVEAT },
+	{ GTK_GL_SWAP_METHOD, "Swap Method", ATTR_SWAP_METHOD },
+	{ GTK_GL_SRGB_CAPABLE, "sRGB Capable", ATTR_BOOL },
+	{ GTK_GL_FLOAT_COLOR, "Floating-Point Color", ATTR_BOOL },
+	{ GTK_GL_BUFFER_AGE, "Buffer Age", ATTR_BOOL }
 };
 
 
@@ -156,6 +161,17 @@ example_init_filter_dialog(void) {
 				selector = GTK_WIDGET(cave_box);
 				break;
 			}
+
+			case ATTR_SWAP_METHOD: {
+				GtkComboBoxText *swap_box = GTK_COMBO_BOX_TEXT(
+						gtk_combo_box_text_new());
+				gtk_combo_box_text_append_text(swap_box, "Undefined");
+				gtk_combo_box_text_append_text(swap_box, "Exchange");
+				gtk_combo_box_text_append_text(swap_box, "Copy");
+				gtk_combo_box_set_active(GTK_COMBO_BOX(swap_box), 0);
+				selector = GTK_WIDGET(swap_box);
+				break;
+			}
 		}
 
 		gtk_grid_attach(example_filter_grid, GTK_WIDGET(name_label), 0, i,
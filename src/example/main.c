@@ -428,16 +428,19 @@ static void
 update_visual_list(void) {
 	// Initialize the context chooser dialog with existing visuals
 	static const GtkGLRequirement no_requirements[] = { GTK_GL_LIST_END };
+	GtkGLFramebufferConfig *configs;
 	size_t i;
 
 	if (example_choice) gtk_gl_visual_list_free(example_choice);
-	example_choice = gtk_gl_choose_visuals(example_visuals,
+	example_choice = gtk_gl_choose_visuals_cached(example_visuals,
 			example_requirements ? example_requirements : no_requirements);
 
+	configs = g_new(GtkGLFramebufferConfig, example_choice->count);
+	gtk_gl_describe_visuals(example_choice, configs);
+
 	gtk_list_store_clear(visual_list_store);
 	for (i = 0; i < example_choice->count; ++i) {
-		GtkGLFramebufferConfig cfg;
-		gtk_gl_describe_visual(example_choice->entries[i], &cfg);
+		const GtkGLFramebufferConfig cfg = configs[i];
 		gtk_list_store_insert_with_values(visual_list_store, NULL, -1,
 			0, cfg.accelerated,
 			1, cfg.color_types & GTK_GL_COLOR_RGBA ? "RGBA" : "Indexed",
@@ -466,6 +469,7 @@ update_visual_list(void) {
 					? "Non-conformant": "-",
 			-1);
 	}
+	g_free(configs);
 }
 
 
@@ -0,0 +1,220 @@
+/**
+ * Copyright (c) 2014-2015, Fabian Knorr
+ *
+ * This file is part of libgtkglcanvas.
+ *
+ * libgtkglcanvas is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libgtkglcanvas is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libgtkglcanvas. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/* Runtime selection between the GLX and EGL backends, see backend.h. The
+ * backend is chosen once per process, before the first canvas is created:
+ * GTK_GL_BACKEND=glx or =egl forces one, otherwise EGL is used where the
+ * default display supports it, and GLX everywhere else.
+ */
+
+#include <string.h>
+
+#include <gtk/gtk.h>
+
+#include <gtkgl/visual.h>
+#include <gtkgl/canvas.h>
+#include <gtkgl/ext.h>
+#include "backend.h"
+
+
+static const GtkGLBackend *
+select_backend(void) {
+    static const GtkGLBackend *const backends[] = {
+        &gtk_gl_egl_backend, &gtk_gl_glx_backend
+    };
+    const gchar *name = g_getenv("GTK_GL_BACKEND");
+    GdkDisplay *display = gdk_display_get_default();
+    size_t i;
+
+    if (name && *name) {
+        for (i = 0; i < G_N_ELEMENTS(backends); ++i) {
+            if (!strcmp(name, backends[i]->name)) {
+                if (display && backends[i]->is_available(display)) {
+                    return backends[i];
+                }
+                g_warning("GL backend \"%s\" is not available", name);
+                break;
+            }
+        }
+        if (i == G_N_ELEMENTS(backends)) {
+            g_warning("Unknown GL backend \"%s\"", name);
+        }
+    }
+
+    for (i = 0; display && i < G_N_ELEMENTS(backends); ++i) {
+        if (backends[i]->is_available(display)) return backends[i];
+    }
+    return &gtk_gl_glx_backend;
+}
+
+
+static const GtkGLBackend *
+get_backend(void) {
+    static gsize backend = 0;
+
+    if (g_once_init_enter(&backend)) {
+        g_once_init_leave(&backend, (gsize) select_backend());
+    }
+    return (const GtkGLBackend*) backend;
+}
+
+
+const gchar *
+gtk_gl_get_backend_name(void) {
+    return get_backend()->name;
+}
+
+
+GtkGLCanvas_NativePriv *
+gtk_gl_canvas_native_new(void) {
+    return get_backend()->native_new();
+}
+
+
+void
+gtk_gl_canvas_native_realize(GtkGLCanvas *canvas) {
+    get_backend()->native_realize(canvas);
+}
+
+
+void
+gtk_gl_canvas_native_unrealize(GtkGLCanvas *canvas) {
+    get_backend()->native_unrealize(canvas);
+}
+
+
+gboolean
+gtk_gl_canvas_native_create_context(GtkGLCanvas *canvas,
+        const GtkGLVisual *visual) {
+    return get_backend()->native_create_context(canvas, visual);
+}
+
+
+gboolean
+gtk_gl_canvas_native_create_context_with_version(GtkGLCanvas *canvas,
+        const GtkGLVisual *visual, guint ver_major, guint ver_minor,
+        GtkGLProfile profile, GtkGLContextFlags flags) {
+    return get_backend()->native_create_context_with_version(canvas, visual,
+            ver_major, ver_minor, profile, flags);
+}
+
+
+void
+gtk_gl_canvas_native_destroy_context(GtkGLCanvas *canvas) {
+    get_backend()->native_destroy_context(canvas);
+}
+
+
+void
+gtk_gl_canvas_native_swap_buffers(GtkGLCanvas *canvas) {
+    get_backend()->native_swap_buffers(canvas);
+}
+
+
+void
+gtk_gl_canvas_native_make_current(GtkGLCanvas *canvas) {
+    get_backend()->native_make_current(canvas);
+}
+
+
+void
+gtk_gl_canvas_native_resize(GtkGLCanvas *canvas, gint width, gint height) {
+    get_backend()->native_resize(canvas, width, height);
+}
+
+
+guint
+gtk_gl_canvas_native_get_framebuffer(GtkGLCanvas *canvas) {
+    return get_backend()->native_get_framebuffer(canvas);
+}
+
+
+GtkGLDisplayCaps
+gtk_gl_canvas_native_get_display_caps(GtkGLCanvas *canvas) {
+    return get_backend()->native_get_display_caps(canvas);
+}
+
+
+gboolean
+gtk_gl_canvas_native_prepare_async(GtkGLCanvas *canvas) {
+    return get_backend()->native_prepare_async(canvas);
+}
+
+
+void
+gtk_gl_canvas_native_clear_current(GtkGLCanvas *canvas) {
+    get_backend()->native_clear_current(canvas);
+}
+
+
+GtkGLVisual *
+gtk_gl_canvas_native_lookup_decision(GtkGLCanvas *canvas,
+        const GtkGLRequirement *requirements, guint ver_major,
+        guint ver_minor, GtkGLProfile profile) {
+    return get_backend()->native_lookup_decision(canvas, requirements,
+            ver_major, ver_minor, profile);
+}
+
+
+void
+gtk_gl_canvas_native_store_decision(GtkGLCanvas *canvas,
+        const GtkGLRequirement *requirements, const GtkGLVisual *visual,
+        guint ver_major, guint ver_minor, GtkGLProfile profile) {
+    get_backend()->native_store_decision(canvas, requirements, visual,
+            ver_major, ver_minor, profile);
+}
+
+
+void
+gtk_gl_describe_visuals_attribute(const GtkGLVisualList *visuals,
+        GtkGLAttribute attr, gint *out) {
+    get_backend()->describe_visuals_attribute(visuals, attr, out);
+}
+
+
+GtkGLVisualList *
+gtk_gl_canvas_enumerate_visuals(GtkGLCanvas *canvas) {
+    return get_backend()->enumerate_visuals(canvas);
+}
+
+
+void
+gtk_gl_describe_visual(const GtkGLVisual *visual, GtkGLFramebufferConfig *out) {
+    get_backend()->describe_visual(visual, out);
+}
+
+
+void
+gtk_gl_describe_visuals(const GtkGLVisualList *visuals,
+        GtkGLFramebufferConfig *out) {
+    get_backend()->describe_visuals(visuals, out);
+}
+
+
+void
+gtk_gl_visual_free(GtkGLVisual *visual) {
+    get_backend()->visual_free(visual);
+}
+
+
+GtkGLProc *
+gtk_gl_get_proc_address(const char *name) {
+    return get_backend()->get_proc_address(name);
+}
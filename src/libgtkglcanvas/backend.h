@@ -0,0 +1,152 @@
+/**
+ * Copyright (c) 2014-2015, Fabian Knorr
+ *
+ * This file is part of libgtkglcanvas.
+ *
+ * libgtkglcanvas is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libgtkglcanvas is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libgtkglcanvas. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+/* X11 builds with EGL support (HAVE_EGL) contain two native backends, glx.c
+ * and egl.c, and pick one at runtime (see backend.c). Each backend defines
+ * BACKEND_NAME before including this header, which renames its
+ * implementations of the native functions and of the backend-specific public
+ * functions to gtk_gl_<BACKEND_NAME>_*, and exports them as a GtkGLBackend
+ * table via DEFINE_BACKEND(). backend.c implements the original names by
+ * forwarding to the selected table.
+ */
+
+
+// Renaming must precede the declarations in the included headers
+#ifdef BACKEND_NAME
+
+#define BACKEND_PASTE_(name, symbol) gtk_gl_##name##_##symbol
+#define BACKEND_PASTE(name, symbol) BACKEND_PASTE_(name, symbol)
+#define BACKEND_SYMBOL(symbol) BACKEND_PASTE(BACKEND_NAME, symbol)
+
+#define gtk_gl_canvas_native_new BACKEND_SYMBOL(native_new)
+#define gtk_gl_canvas_native_realize BACKEND_SYMBOL(native_realize)
+#define gtk_gl_canvas_native_unrealize BACKEND_SYMBOL(native_unrealize)
+#define gtk_gl_canvas_native_create_context \
+    BACKEND_SYMBOL(native_create_context)
+#define gtk_gl_canvas_native_create_context_with_version \
+    BACKEND_SYMBOL(native_create_context_with_version)
+#define gtk_gl_canvas_native_destroy_context \
+    BACKEND_SYMBOL(native_destroy_context)
+#define gtk_gl_canvas_native_swap_buffers BACKEND_SYMBOL(native_swap_buffers)
+#define gtk_gl_canvas_native_make_current BACKEND_SYMBOL(native_make_current)
+#define gtk_gl_canvas_native_resize BACKEND_SYMBOL(native_resize)
+#define gtk_gl_canvas_native_get_framebuffer \
+    BACKEND_SYMBOL(native_get_framebuffer)
+#define gtk_gl_canvas_native_get_display_caps \
+    BACKEND_SYMBOL(native_get_display_caps)
+#define gtk_gl_canvas_native_prepare_async \
+    BACKEND_SYMBOL(native_prepare_async)
+#define gtk_gl_canvas_native_clear_current \
+    BACKEND_SYMBOL(native_clear_current)
+#define gtk_gl_canvas_native_lookup_decision \
+    BACKEND_SYMBOL(native_lookup_decision)
+#define gtk_gl_canvas_native_store_decision \
+    BACKEND_SYMBOL(native_store_decision)
+#define gtk_gl_describe_visuals_attribute \
+    BACKEND_SYMBOL(describe_visuals_attribute)
+#define gtk_gl_canvas_enumerate_visuals BACKEND_SYMBOL(enumerate_visuals)
+#define gtk_gl_describe_visual BACKEND_SYMBOL(describe_visual)
+#define gtk_gl_describe_visuals BACKEND_SYMBOL(describe_visuals)
+#define gtk_gl_visual_free BACKEND_SYMBOL(visual_free)
+#define gtk_gl_get_proc_address BACKEND_SYMBOL(get_proc_address)
+
+#endif
+
+#include "canvas_impl.h"
+#include <gtkgl/ext.h>
+
+
+typedef struct _GtkGLBackend {
+    const gchar *name;
+
+    // Whether the backend can render on a display, probed once
+    gboolean (*is_available)(GdkDisplay *display);
+
+    GtkGLCanvas_NativePriv *(*native_new)(void);
+    void (*native_realize)(GtkGLCanvas *canvas);
+    void (*native_unrealize)(GtkGLCanvas *canvas);
+    gboolean (*native_create_context)(GtkGLCanvas *canvas,
+            const GtkGLVisual *visual);
+    gboolean (*native_create_context_with_version)(GtkGLCanvas *canvas,
+            const GtkGLVisual *visual, guint ver_major, guint ver_minor,
+            GtkGLProfile profile, GtkGLContextFlags flags);
+    void (*native_destroy_context)(GtkGLCanvas *canvas);
+    void (*native_swap_buffers)(GtkGLCanvas *canvas);
+    void (*native_make_current)(GtkGLCanvas *canvas);
+    void (*native_resize)(GtkGLCanvas *canvas, gint width, gint height);
+    guint (*native_get_framebuffer)(GtkGLCanvas *canvas);
+    GtkGLDisplayCaps (*native_get_display_caps)(GtkGLCanvas *canvas);
+    gboolean (*native_prepare_async)(GtkGLCanvas *canvas);
+    void (*native_clear_current)(GtkGLCanvas *canvas);
+    GtkGLVisual *(*native_lookup_decision)(GtkGLCanvas *canvas,
+            const GtkGLRequirement *requirements, guint ver_major,
+            guint ver_minor, GtkGLProfile profile);
+    void (*native_store_decision)(GtkGLCanvas *canvas,
+            const GtkGLRequirement *requirements, const GtkGLVisual *visual,
+            guint ver_major, guint ver_minor, GtkGLProfile profile);
+    void (*describe_visuals_attribute)(const GtkGLVisualList *visuals,
+            GtkGLAttribute attr, gint *out);
+
+    GtkGLVisualList *(*enumerate_visuals)(GtkGLCanvas *canvas);
+    void (*describe_visual)(const GtkGLVisual *visual,
+            GtkGLFramebufferConfig *out);
+    void (*describe_visuals)(const GtkGLVisualList *visuals,
+            GtkGLFramebufferConfig *out);
+    void (*visual_free)(GtkGLVisual *visual);
+    GtkGLProc *(*get_proc_address)(const char *name);
+} GtkGLBackend;
+
+
+extern const GtkGLBackend gtk_gl_glx_backend;
+extern const GtkGLBackend gtk_gl_egl_backend;
+
+
+#ifdef BACKEND_NAME
+
+#define DEFINE_BACKEND(is_available) \
+    const GtkGLBackend BACKEND_SYMBOL(backend) = { \
+        G_STRINGIFY(BACKEND_NAME), \
+        is_available, \
+        gtk_gl_canvas_native_new, \
+        gtk_gl_canvas_native_realize, \
+        gtk_gl_canvas_native_unrealize, \
+        gtk_gl_canvas_native_create_context, \
+        gtk_gl_canvas_native_create_context_with_version, \
+        gtk_gl_canvas_native_destroy_context, \
+        gtk_gl_canvas_native_swap_buffers, \
+        gtk_gl_canvas_native_make_current, \
+        gtk_gl_canvas_native_resize, \
+        gtk_gl_canvas_native_get_framebuffer, \
+        gtk_gl_canvas_native_get_display_caps, \
+        gtk_gl_canvas_native_prepare_async, \
+        gtk_gl_canvas_native_clear_current, \
+        gtk_gl_canvas_native_lookup_decision, \
+        gtk_gl_canvas_native_store_decision, \
+        gtk_gl_describe_visuals_attribute, \
+        gtk_gl_canvas_enumerate_visuals, \
+        gtk_gl_describe_visual, \
+        gtk_gl_describe_visuals, \
+        gtk_gl_visual_free, \
+        gtk_gl_get_proc_address \
+    }
+
+#endif
@@ -0,0 +1,290 @@
+/**
+ * Copyright (c) 2014-2015, Fabian Knorr
+ *
+ * This file is part of libgtkglcanvas.
+ *
+ * libgtkglcanvas is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libgtkglcanvas is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libgtkglcanvas. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <gtkgl/canvas.h>
+#include "cache.h"
+#include <assert.h>
+#include <errno.h>
+#include <string.h>
+
+
+// Bumped whenever the layout of the file or of GtkGLFramebufferConfig changes
+#define CACHE_FORMAT 4
+
+static const gchar cache_magic[8] = "GTKGLFC";
+
+
+typedef struct _CacheHeader {
+    gchar magic[8];
+    guint32 format;
+    guint32 record_size;   // sizeof(GtkGLCacheRecord) of the writer
+    guint32 key_size;      // Including NUL and padding
+    guint32 record_count;
+    guint32 has_decision;
+    guint32 requirement_count;  // Of the decision, without the terminator
+    GtkGLCacheDecision decision;
+} CacheHeader;
+
+
+// A GtkGLRequirement with fixed-size fields
+typedef struct _CacheRequirement {
+    gint32 attr;
+    gint32 req;
+    gint32 value;
+} CacheRequirement;
+
+
+struct _GtkGLCacheFile {
+    GMappedFile *mapping;
+    const CacheHeader *header;
+    const GtkGLCacheRecord *records;
+    const CacheRequirement *requirements;  // Of the decision
+};
+
+
+static volatile gint cache_enabled;
+
+
+void
+gtk_gl_set_persistent_cache_enabled(gboolean enabled) {
+    g_atomic_int_set(&cache_enabled, !!enabled);
+}
+
+
+gboolean
+gtk_gl_cache_is_enabled(void) {
+    return g_atomic_int_get(&cache_enabled);
+}
+
+
+static gchar *
+get_cache_path(const gchar *key) {
+    gchar *name, *path;
+    gchar *digest = g_compute_checksum_for_string(G_CHECKSUM_SHA1, key, -1);
+
+    name = g_strconcat(digest, ".fbconfigs", NULL);
+    path = g_build_filename(g_get_user_cache_dir(), "gtkglcanvas", name,
+            NULL);
+    g_free(name);
+    g_free(digest);
+    return path;
+}
+
+
+static gsize
+get_key_size(const gchar *key) {
+    return (strlen(key) + 1 + 7) / 8 * 8;
+}
+
+
+GtkGLCacheFile *
+gtk_gl_cache_file_open(const gchar *key) {
+    GtkGLCacheFile *file;
+    GMappedFile *mapping;
+    const CacheHeader *header;
+    const gchar *contents;
+    gsize length, key_size = get_key_size(key);
+    gchar *path;
+
+    assert(key);
+
+    if (!gtk_gl_cache_is_enabled()) return NULL;
+
+    path = get_cache_path(key);
+    mapping = g_mapped_file_new(path, FALSE, NULL);
+    g_free(path);
+    if (!mapping) return NULL;
+
+    // Validate everything before trusting any offset read from the file
+    contents = g_mapped_file_get_contents(mapping);
+    length = g_mapped_file_get_length(mapping);
+    header = (const CacheHeader*) contents;
+    if (length < sizeof *header
+            || memcmp(header->magic, cache_magic, sizeof cache_magic)
+            || header->format != CACHE_FORMAT
+            || header->record_size != sizeof(GtkGLCacheRecord)
+            || header->key_size != key_size
+            || length != sizeof *header + key_size
+                    + header->record_count * sizeof(GtkGLCacheRecord)
+                    + header->requirement_count * sizeof(CacheRequirement)
+            || strcmp(contents + sizeof *header, key)) {
+        g_mapped_file_unref(mapping);
+        return NULL;
+    }
+
+    file = g_malloc(sizeof *file);
+    file->mapping = mapping;
+    file->header = header;
+    file->records = (const GtkGLCacheRecord*) (contents + sizeof *header
+            + key_size);
+    file->requirements = (const CacheRequirement*) (file->records
+            + header->record_count);
+    return file;
+}
+
+
+void
+gtk_gl_cache_file_close(GtkGLCacheFile *file) {
+    if (!file) return;
+
+    g_mapped_file_unref(file->mapping);
+    g_free(file);
+}
+
+
+gsize
+gtk_gl_cache_file_get_records(const GtkGLCacheFile *file,
+        const GtkGLCacheRecord **records) {
+    assert(file);
+    assert(records);
+
+    *records = file->records;
+    return file->header->record_count;
+}
+
+
+const GtkGLCacheRecord *
+gtk_gl_cache_file_find_record(const GtkGLCacheFile *file, gint32 id) {
+    gsize i;
+
+    assert(file);
+
+    for (i = 0; i < file->header->record_count; ++i) {
+        if (file->records[i].id == id) return &file->records[i];
+    }
+    return NULL;
+}
+
+
+static gsize
+count_requirements(const GtkGLRequirement *requirements) {
+    gsize count = 0;
+    while (requirements[count].attr != GTK_GL_NONE) ++count;
+    return count;
+}
+
+
+const GtkGLCacheDecision *
+gtk_gl_cache_file_get_decision(const GtkGLCacheFile *file,
+        const GtkGLRequirement *requirements) {
+    gsize i;
+
+    assert(file);
+    assert(requirements);
+
+    if (!file->header->has_decision
+            || file->header->requirement_count
+                    != count_requirements(requirements)) {
+        return NULL;
+    }
+    for (i = 0; i < file->header->requirement_count; ++i) {
+        const CacheRequirement *r = &file->requirements[i];
+        if (r->attr != (gint32) requirements[i].attr
+                || r->req != (gint32) requirements[i].req
+                || r->value != (gint32) requirements[i].value) {
+            return NULL;
+        }
+    }
+    return &file->header->decision;
+}
+
+
+static void
+write_cache_file(const gchar *key, const GtkGLCacheRecord *records,
+        gsize count, const GtkGLCacheDecision *decision,
+        const GtkGLRequirement *requirements) {
+    gsize key_size = get_key_size(key);
+    gsize n_requirements = decision ? count_requirements(requirements) : 0;
+    gsize length = sizeof(CacheHeader) + key_size + count * sizeof *records
+            + n_requirements * sizeof(CacheRequirement);
+    gchar *contents = g_malloc0(length);
+    CacheHeader *header = (CacheHeader*) contents;
+    CacheRequirement *stored;
+    gsize i;
+    gchar *path = get_cache_path(key), *dir = g_path_get_dirname(path);
+    GError *error = NULL;
+
+    memcpy(header->magic, cache_magic, sizeof cache_magic);
+    header->format = CACHE_FORMAT;
+    header->record_size = sizeof *records;
+    header->key_size = key_size;
+    header->record_count = count;
+    if (decision) {
+        header->has_decision = TRUE;
+        header->requirement_count = n_requirements;
+        header->decision = *decision;
+    }
+    strcpy(contents + sizeof *header, key);
+    memcpy(contents + sizeof *header + key_size, records,
+            count * sizeof *records);
+    stored = (CacheRequirement*) (contents + sizeof *header + key_size
+            + count * sizeof *records);
+    for (i = 0; i < n_requirements; ++i) {
+        stored[i].attr = requirements[i].attr;
+        stored[i].req = requirements[i].req;
+        stored[i].value = requirements[i].value;
+    }
+
+    // g_file_set_contents() renames atomically, readers keep their mapping
+    if (g_mkdir_with_parents(dir, 0700) < 0
+            || !g_file_set_contents(path, contents, length, &error)) {
+        g_warning("Unable to write visual cache %s: %s", path,
+                error ? error->message : g_strerror(errno));
+        g_clear_error(&error);
+    }
+
+    g_free(dir);
+    g_free(path);
+    g_free(contents);
+}
+
+
+void
+gtk_gl_cache_store_records(const gchar *key, const GtkGLCacheRecord *records,
+        gsize count) {
+    assert(key);
+    assert(records || !count);
+
+    if (!gtk_gl_cache_is_enabled()) return;
+
+    write_cache_file(key, records, count, NULL, NULL);
+}
+
+
+void
+gtk_gl_cache_store_decision(const gchar *key,
+        const GtkGLCacheDecision *decision,
+        const GtkGLRequirement *requirements) {
+    GtkGLCacheFile *file;
+    const GtkGLCacheDecision *current;
+
+    assert(key);
+    assert(decision);
+    assert(requirements);
+
+    file = gtk_gl_cache_file_open(key);
+    if (!file) return;
+
+    current = gtk_gl_cache_file_get_decision(file, requirements);
+    if (!current || memcmp(current, decision, sizeof *decision)) {
+        write_cache_file(key, file->records, file->header->record_count,
+                decision, requirements);
+    }
+    gtk_gl_cache_file_close(file);
+}
@@ -0,0 +1,76 @@
+/**
+ * Copyright (c) 2014-2015, Fabian Knorr
+ *
+ * This file is part of libgtkglcanvas.
+ *
+ * libgtkglcanvas is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libgtkglcanvas is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libgtkglcanvas. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include <gtkgl/visual.h>
+
+
+/* Persistent cache of described framebuffer configurations and of the last
+ * visual chosen by gtk_gl_canvas_auto_create_context*(), one file per key
+ * in $XDG_CACHE_HOME/gtkglcanvas. Backends build the key from everything
+ * that determines their configuration list and identify configurations by a
+ * backend-specific integer ID. The file layout is:
+ *
+ *   CacheHeader | key, NUL-padded to a multiple of 8 | GtkGLCacheRecord[]
+ *       | GtkGLCacheRequirement[] of the decision
+ *
+ * in host byte order, so files are only valid on the machine that wrote them.
+ * Files are replaced atomically and read through a memory mapping.
+ */
+
+typedef struct _GtkGLCacheRecord {
+    gint32 id;
+    GtkGLFramebufferConfig config;
+} GtkGLCacheRecord;
+
+
+typedef struct _GtkGLCacheDecision {
+    gint32 id;
+    guint32 ver_major;  // Zero for contexts created without a version
+    guint32 ver_minor;
+    gint32 profile;
+} GtkGLCacheDecision;
+
+
+typedef struct _GtkGLCacheFile GtkGLCacheFile;
+
+
+gboolean gtk_gl_cache_is_enabled(void);
+
+// Returns NULL if the cache is disabled or has no valid file for the key
+GtkGLCacheFile *gtk_gl_cache_file_open(const gchar *key);
+void gtk_gl_cache_file_close(GtkGLCacheFile *file);
+gsize gtk_gl_cache_file_get_records(const GtkGLCacheFile *file,
+        const GtkGLCacheRecord **records);
+const GtkGLCacheRecord *gtk_gl_cache_file_find_record(
+        const GtkGLCacheFile *file, gint32 id);
+// Returns NULL if the file holds no decision, or one that was made for a
+// different requirement list
+const GtkGLCacheDecision *gtk_gl_cache_file_get_decision(
+        const GtkGLCacheFile *file, const GtkGLRequirement *requirements);
+
+// Replaces the file for the key, dropping any previous decision
+void gtk_gl_cache_store_records(const gchar *key,
+        const GtkGLCacheRecord *records, gsize count);
+// Records a decision and its requirement list in the existing file for the key
+void gtk_gl_cache_store_decision(const gchar *key,
+        const GtkGLCacheDecision *decision,
+        const GtkGLRequirement *requirements);
@@ -51,6 +51,7 @@
 #include "canvas_impl.h"
 
 #include <epoxy/gl.h>
+#include <string.h>
 
 
 struct _GtkGLCanvas {
@@ -88,11 +89,177 @@ gtk_gl_canvas_draw(GtkWidget *wid, cairo_t *cr) {
 }
 
 
+/* Share groups track which canvases currently have a context created in the
+ * group, so that new contexts can share objects with any of them.
+ */
+struct _GtkGLShareGroup {
+    volatile gint ref_count;
+    volatile gint single_context;
+    GList *canvases;  // Members with a context, guarded by share_group_mutex
+};
+
+
+static GMutex share_group_mutex;
+
+
+GtkGLShareGroup *
+gtk_gl_share_group_new(void) {
+    GtkGLShareGroup *group = g_malloc0(sizeof *group);
+    group->ref_count = 1;
+    return group;
+}
+
+
+GtkGLShareGroup *
+gtk_gl_share_group_ref(GtkGLShareGroup *group) {
+    g_assert(group);
+    g_atomic_int_inc(&group->ref_count);
+    return group;
+}
+
+
+void
+gtk_gl_share_group_unref(GtkGLShareGroup *group) {
+    g_assert(group);
+    if (g_atomic_int_dec_and_test(&group->ref_count)) {
+        // Members hold a reference, so the group is empty by now
+        g_assert(!group->canvases);
+        g_free(group);
+    }
+}
+
+
+void
+gtk_gl_share_group_set_single_context(GtkGLShareGroup *group,
+        gboolean single_context) {
+    g_assert(group);
+    g_atomic_int_set(&group->single_context, !!single_context);
+}
+
+
+gboolean
+gtk_gl_share_group_get_single_context(GtkGLShareGroup *group) {
+    g_assert(group);
+    return g_atomic_int_get(&group->single_context);
+}
+
+
+GList *
+gtk_gl_share_group_list_canvases(GtkGLShareGroup *group) {
+    GList *canvases;
+
+    g_assert(group);
+
+    g_mutex_lock(&share_group_mutex);
+    canvases = g_list_copy(group->canvases);
+    g_mutex_unlock(&share_group_mutex);
+    return canvases;
+}
+
+
+void
+gtk_gl_canvas_set_share_group(GtkGLCanvas *canvas, GtkGLShareGroup *group) {
+    GtkGLCanvas_Priv *priv = GTK_GL_CANVAS_GET_PRIV(canvas);
+
+    if (group) gtk_gl_share_group_ref(group);
+    if (priv->share_group) gtk_gl_share_group_unref(priv->share_group);
+    priv->share_group = group;
+}
+
+
+GtkGLShareGroup *
+gtk_gl_canvas_get_share_group(GtkGLCanvas *canvas) {
+    return GTK_GL_CANVAS_GET_PRIV(canvas)->share_group;
+}
+
+
+GtkGLCanvas *
+gtk_gl_canvas_get_share_peer(GtkGLCanvas *canvas) {
+    GtkGLCanvas_Priv *priv = GTK_GL_CANVAS_GET_PRIV(canvas);
+    GtkGLCanvas *peer = NULL;
+    GList *it;
+
+    if (!priv->context_group) return NULL;
+
+    g_mutex_lock(&share_group_mutex);
+    for (it = priv->context_group->canvases; it && !peer; it = it->next) {
+        if (it->data != canvas) peer = it->data;
+    }
+    g_mutex_unlock(&share_group_mutex);
+    return peer;
+}
+
+
+// Fixes the group the next context is created in. The backend shares with,
+// pools and adopts by context_group only, so a gtk_gl_canvas_set_share_group()
+// call while an asynchronous creation is pending takes effect on the next one.
+static void
+enter_share_group(GtkGLCanvas *canvas) {
+    GtkGLCanvas_Priv *priv = GTK_GL_CANVAS_GET_PRIV(canvas);
+
+    g_assert(!priv->context_group);
+    if (priv->share_group) {
+        priv->context_group = gtk_gl_share_group_ref(priv->share_group);
+    }
+}
+
+
+// Called once the canvas has a new context
+static void
+join_share_group(GtkGLCanvas *canvas) {
+    GtkGLCanvas_Priv *priv = GTK_GL_CANVAS_GET_PRIV(canvas);
+
+    if (!priv->context_group) return;
+
+    g_mutex_lock(&share_group_mutex);
+    priv->context_group->canvases = g_list_prepend(
+            priv->context_group->canvases, canvas);
+    g_mutex_unlock(&share_group_mutex);
+}
+
+
+// Stops offering the canvas' context to other members. The canvas keeps its
+// reference on the group until drop_share_group().
+static void
+leave_share_group(GtkGLCanvas *canvas) {
+    GtkGLCanvas_Priv *priv = GTK_GL_CANVAS_GET_PRIV(canvas);
+
+    if (priv->context_group) {
+        g_mutex_lock(&share_group_mutex);
+        priv->context_group->canvases = g_list_remove(
+                priv->context_group->canvases, canvas);
+        g_mutex_unlock(&share_group_mutex);
+    }
+}
+
+
+static void
+drop_share_group(GtkGLCanvas *canvas) {
+    GtkGLCanvas_Priv *priv = GTK_GL_CANVAS_GET_PRIV(canvas);
+
+    if (priv->context_group) {
+        gtk_gl_share_group_unref(priv->context_group);
+        priv->context_group = NULL;
+    }
+}
+
+
+static void
+destroy_context(GtkGLCanvas *canvas) {
+    leave_share_group(canvas);
+    // The backend may still read context_group, e.g. for pooling
+    gtk_gl_canvas_native_destroy_context(canvas);
+    drop_share_group(canvas);
+}
+
+
 static void
 gtk_gl_canvas_finalize(GObject *obj) {
 	GtkGLCanvas *canvas = GTK_GL_CANVAS(obj);
 	GtkGLCanvas_Priv *priv = GTK_GL_CANVAS_GET_PRIV(canvas);
 	g_free(priv->native);
+    if (priv->share_group) gtk_gl_share_group_unref(priv->share_group);
+    g_mutex_clear(&priv->native_mutex);
 
     G_OBJECT_CLASS(gtk_gl_canvas_parent_class)->finalize(obj);
 }
@@ -163,10 +330,14 @@ gtk_gl_canvas_unrealize(GtkWidget *wid) {
     GtkGLCanvas *canvas = GTK_GL_CANVAS(wid);
     GtkGLCanvas_Priv *priv = GTK_GL_CANVAS_GET_PRIV(canvas);
 
-	if (!priv->is_dummy) 	{
-		gtk_gl_canvas_native_destroy_context(canvas);
+    // Wait for a running asynchronous creation or destruction and undo it
+    g_mutex_lock(&priv->native_mutex);
+	if (!priv->is_dummy || priv->busy) 	{
+		destroy_context(canvas);
 		priv->is_dummy = TRUE;
+        priv->async_aborted = priv->busy;
 	}
+    g_mutex_unlock(&priv->native_mutex);
 
     gtk_gl_canvas_native_unrealize(canvas);
 
@@ -180,6 +351,7 @@ gtk_gl_canvas_init(GtkGLCanvas *canvas) {
 
 	priv->native = gtk_gl_canvas_native_new();
 	priv->is_dummy = TRUE;
+    g_mutex_init(&priv->native_mutex);
 
     gtk_widget_set_can_focus(GTK_WIDGET(canvas), TRUE);
     gtk_widget_set_receives_default(GTK_WIDGET(canvas), TRUE);
@@ -215,6 +387,8 @@ gtk_gl_canvas_send_configure(GtkWidget *wid) {
 
 static void
 gtk_gl_canvas_size_allocate(GtkWidget *wid, GtkAllocation *allocation) {
+    GtkGLCanvas_Priv *priv;
+
     g_return_if_fail(GTK_GL_IS_CANVAS(wid));
     g_return_if_fail(allocation != NULL);
 
@@ -227,11 +401,71 @@ gtk_gl_canvas_size_allocate(GtkWidget *wid, GtkAllocation *allocation) {
                     allocation->x, allocation->y,
                     allocation->width, allocation->height);
         }
+        // A worker owns the native state meanwhile, the size is applied once
+        // the asynchronous operation completes
+        priv = GTK_GL_CANVAS_GET_PRIV(GTK_GL_CANVAS(wid));
+        if (!priv->busy) {
+            gtk_gl_canvas_native_resize(GTK_GL_CANVAS(wid), allocation->width,
+                    allocation->height);
+        }
 
         gtk_gl_canvas_send_configure(wid);
     }
 }
 
+static volatile gint context_pool_size;
+
+
+void
+gtk_gl_set_context_pool_size(guint size) {
+    g_atomic_int_set(&context_pool_size, (gint) size);
+}
+
+
+guint
+gtk_gl_context_pool_get_size(void) {
+    return (guint) g_atomic_int_get(&context_pool_size);
+}
+
+
+static volatile gint threaded_context_creation;
+
+
+void
+gtk_gl_set_threaded_context_creation(gboolean enabled) {
+    g_atomic_int_set(&threaded_context_creation, !!enabled);
+}
+
+
+gboolean
+gtk_gl_threaded_context_creation_is_enabled(void) {
+    return g_atomic_int_get(&threaded_context_creation);
+}
+
+
+static volatile gint make_current_performed, make_current_skipped;
+
+
+void
+gtk_gl_count_make_current(gboolean skipped) {
+    g_atomic_int_inc(skipped ? &make_current_skipped : &make_current_performed);
+}
+
+
+void
+gtk_gl_get_make_current_stats(guint *performed, guint *skipped) {
+    if (performed) *performed = (guint) g_atomic_int_get(&make_current_performed);
+    if (skipped) *skipped = (guint) g_atomic_int_get(&make_current_skipped);
+}
+
+
+void
+gtk_gl_reset_make_current_stats(void) {
+    g_atomic_int_set(&make_current_performed, 0);
+    g_atomic_int_set(&make_current_skipped, 0);
+}
+
+
 GtkWidget*
 gtk_gl_canvas_new(void) {
     return GTK_WIDGET(g_object_new(GTK_GL_TYPE_CANVAS, NULL));
@@ -242,8 +476,9 @@ static void
 gtk_gl_canvas_before_create_context(GtkGLCanvas *canvas) {
     GtkGLCanvas_Priv *priv = GTK_GL_CANVAS_GET_PRIV(canvas);
 	if (!priv->is_dummy) {
-		gtk_gl_canvas_native_destroy_context(canvas);
+		destroy_context(canvas);
     }
+    enter_share_group(canvas);
 }
 
 
@@ -251,6 +486,11 @@ static void
 gtk_gl_canvas_after_create_context(GtkGLCanvas *canvas, gboolean success) {
     GtkGLCanvas_Priv *priv = GTK_GL_CANVAS_GET_PRIV(canvas);
     priv->is_dummy = !success;
+    if (success) {
+        join_share_group(canvas);
+    } else {
+        drop_share_group(canvas);
+    }
 	gtk_widget_queue_draw(GTK_WIDGET(canvas));
 }
 
@@ -258,6 +498,7 @@ gtk_gl_canvas_after_create_context(GtkGLCanvas *canvas, gboolean success) {
 gboolean
 gtk_gl_canvas_create_context(GtkGLCanvas *canvas, const GtkGLVisual *visual) {
     gboolean success;
+    g_return_val_if_fail(!GTK_GL_CANVAS_GET_PRIV(canvas)->busy, FALSE);
     gtk_gl_canvas_before_create_context(canvas);
 	success = gtk_gl_canvas_native_create_context(canvas, visual);
     gtk_gl_canvas_after_create_context(canvas, success);
@@ -269,22 +510,46 @@ gboolean
 gtk_gl_canvas_create_context_with_version(GtkGLCanvas *canvas,
        const GtkGLVisual *visual, guint ver_major, guint ver_minor,
        GtkGLProfile profile) {
+    return gtk_gl_canvas_create_context_with_flags(canvas, visual, ver_major,
+            ver_minor, profile, GTK_GL_CONTEXT_FLAGS_NONE);
+}
+
+
+gboolean
+gtk_gl_canvas_create_context_with_flags(GtkGLCanvas *canvas,
+       const GtkGLVisual *visual, guint ver_major, guint ver_minor,
+       GtkGLProfile profile, GtkGLContextFlags flags) {
     gboolean success;
+    g_return_val_if_fail(!GTK_GL_CANVAS_GET_PRIV(canvas)->busy, FALSE);
     gtk_gl_canvas_before_create_context(canvas);
     success = gtk_gl_canvas_native_create_context_with_version(canvas, visual,
-            ver_major, ver_minor, profile);
+            ver_major, ver_minor, profile, flags);
     gtk_gl_canvas_after_create_context(canvas, success);
     return success;
 }
 
 
-#define AUTO_CREATE_CONTEXT(create_expr) \
-    GtkGLVisualList *visuals, *choice; \
+/* Tries the visual recorded by the persistent cache first and falls back to
+ * enumerating and choosing if there is none or context creation fails.
+ */
+#define AUTO_CREATE_CONTEXT(create_expr, ver_major, ver_minor, profile) \
+    GtkGLVisualList *visuals; \
+    GtkGLVisual *best; \
     gboolean success; \
+    best = gtk_gl_canvas_native_lookup_decision(canvas, requirements, \
+            ver_major, ver_minor, profile); \
+    if (best) { \
+        success = (create_expr); \
+        gtk_gl_visual_free(best); \
+        if (success) return TRUE; \
+    } \
     visuals = gtk_gl_canvas_enumerate_visuals(canvas); \
-    choice = gtk_gl_choose_visuals(visuals, requirements); \
-    success = choice->count && (create_expr); \
-    gtk_gl_visual_list_free(choice); \
+    best = gtk_gl_choose_best_visual(visuals, requirements); \
+    success = best && (create_expr); \
+    if (success) { \
+        gtk_gl_canvas_native_store_decision(canvas, requirements, best, \
+                ver_major, ver_minor, profile); \
+    } \
     gtk_gl_visual_list_free(visuals); \
     return success;
 
@@ -292,8 +557,8 @@ gtk_gl_canvas_create_context_with_version(GtkGLCanvas *canvas,
 gboolean
 gtk_gl_canvas_auto_create_context(GtkGLCanvas *canvas,
         const GtkGLRequirement *requirements) {
-    AUTO_CREATE_CONTEXT(gtk_gl_canvas_create_context(canvas,
-            choice->entries[0]))
+    AUTO_CREATE_CONTEXT(gtk_gl_canvas_create_context(canvas, best),
+            0, 0, GTK_GL_COMPATIBILITY_PROFILE)
 }
 
 
@@ -302,7 +567,119 @@ gtk_gl_canvas_auto_create_context_with_version(GtkGLCanvas *canvas,
         const GtkGLRequirement *requirements, guint ver_major, guint ver_minor,
         GtkGLProfile profile) {
     AUTO_CREATE_CONTEXT(gtk_gl_canvas_create_context_with_version(canvas,
-            choice->entries[0], ver_major, ver_minor, profile))
+            best, ver_major, ver_minor, profile), ver_major, ver_minor, profile)
+}
+
+
+/* Context versions tried by gtk_gl_canvas_create_best_context(), newest
+ * first. The highest version that worked is remembered per GdkDisplay, visual
+ * and profile (as major << 16 | minor, zero if unknown). The display's qdata
+ * holds a table from the visual's GtkGLFramebufferConfig to the versions of
+ * each profile, since drivers may offer different versions per
+ * configuration, e.g. none above 2.1 for indirect or software visuals.
+ */
+static const guint context_versions[][2] = {
+    { 4, 6 }, { 4, 5 }, { 4, 4 }, { 4, 3 }, { 4, 2 }, { 4, 1 }, { 4, 0 },
+    { 3, 3 }, { 3, 2 }, { 3, 1 }, { 3, 0 }, { 2, 1 }, { 2, 0 },
+    { 1, 5 }, { 1, 4 }, { 1, 3 }, { 1, 2 }, { 1, 1 }, { 1, 0 }
+};
+
+#define N_PROFILES (GTK_GL_ES_PROFILE + 1)
+#define PACK_VERSION(major, minor) ((major) << 16 | (minor))
+
+static GMutex best_version_mutex;
+
+
+static guint
+hash_fb_config(gconstpointer key) {
+    const guint32 *words = key;
+    guint hash = 5381;
+    size_t i;
+
+    for (i = 0; i < sizeof(GtkGLFramebufferConfig) / sizeof *words; ++i) {
+        hash = hash * 33 + words[i];
+    }
+    return hash;
+}
+
+
+static gboolean
+equal_fb_config(gconstpointer a, gconstpointer b) {
+    return memcmp(a, b, sizeof(GtkGLFramebufferConfig)) == 0;
+}
+
+
+// Must be called with best_version_mutex held
+static guint *
+get_best_versions(GtkGLCanvas *canvas, const GtkGLFramebufferConfig *config) {
+    GdkDisplay *display = gtk_widget_get_display(GTK_WIDGET(canvas));
+    GQuark quark = g_quark_from_static_string("gtk-gl-best-context-versions");
+    GHashTable *table = g_object_get_qdata(G_OBJECT(display), quark);
+    guint *versions;
+
+    if (!table) {
+        table = g_hash_table_new_full(hash_fb_config, equal_fb_config, g_free,
+                g_free);
+        g_object_set_qdata_full(G_OBJECT(display), quark, table,
+                (GDestroyNotify) g_hash_table_unref);
+    }
+
+    versions = g_hash_table_lookup(table, config);
+    if (!versions) {
+        versions = g_new0(guint, N_PROFILES);
+        g_hash_table_insert(table, g_memdup(config, sizeof *config), versions);
+    }
+    return versions;
+}
+
+
+gboolean
+gtk_gl_canvas_create_best_context(GtkGLCanvas *canvas,
+        const GtkGLVisual *visual, GtkGLProfile profile, guint min_major,
+        guint min_minor) {
+    guint min = PACK_VERSION(min_major, min_minor), best, version;
+    GtkGLFramebufferConfig config;
+    gboolean success = FALSE;
+    guint *versions;
+    size_t i;
+
+    g_return_val_if_fail(profile < N_PROFILES, FALSE);
+    g_return_val_if_fail(!GTK_GL_CANVAS_GET_PRIV(canvas)->busy, FALSE);
+
+    memset(&config, 0, sizeof config);
+    gtk_gl_describe_visual(visual, &config);
+    g_mutex_lock(&best_version_mutex);
+    best = get_best_versions(canvas, &config)[profile];
+    g_mutex_unlock(&best_version_mutex);
+
+    gtk_gl_canvas_before_create_context(canvas);
+
+    // Another canvas has found the version for this visual already. If it
+    // fails now, search all versions again.
+    if (best && best >= min) {
+        success = gtk_gl_canvas_native_create_context_with_version(canvas,
+                visual, best >> 16, best & 0xffff, profile,
+                GTK_GL_CONTEXT_FLAGS_NONE);
+    }
+
+    for (i = 0; !success && i < G_N_ELEMENTS(context_versions); ++i) {
+        version = PACK_VERSION(context_versions[i][0], context_versions[i][1]);
+        if (version < min) break;
+        if (version == best) continue;  // Failed above
+        if (gtk_gl_canvas_native_create_context_with_version(canvas, visual,
+                context_versions[i][0], context_versions[i][1], profile,
+                GTK_GL_CONTEXT_FLAGS_NONE)) {
+            // Never replace a higher version found by another canvas
+            g_mutex_lock(&best_version_mutex);
+            versions = get_best_versions(canvas, &config);
+            if (version > versions[profile]) versions[profile] = version;
+            g_mutex_unlock(&best_version_mutex);
+            success = TRUE;
+        }
+    }
+
+    gtk_gl_canvas_after_create_context(canvas, success);
+    return success;
 }
 
 
@@ -310,13 +687,219 @@ void
 gtk_gl_canvas_destroy_context(GtkGLCanvas *canvas) {
     GtkGLCanvas_Priv *priv = GTK_GL_CANVAS_GET_PRIV(canvas);
 	g_assert(!priv->is_dummy);
-	gtk_gl_canvas_native_destroy_context(canvas);
+    g_return_if_fail(!priv->busy);
+	destroy_context(canvas);
 
 	priv->is_dummy = TRUE;
 	gtk_widget_queue_draw(GTK_WIDGET(canvas));
 }
 
 
+GtkGLDisplayCaps
+gtk_gl_canvas_get_display_caps(GtkGLCanvas *canvas) {
+    g_return_val_if_fail(gtk_widget_get_realized(GTK_WIDGET(canvas)), 0);
+    return gtk_gl_canvas_native_get_display_caps(canvas);
+}
+
+
+/* Asynchronous creation and destruction run the native functions on a GTask
+ * worker thread if the application enabled it and the backend allows it (see
+ * gtk_gl_canvas_native_prepare_async()), and otherwise from an idle source on
+ * the task's main context, after the _async() call has returned. The canvas
+ * is busy until the result has been applied on the main thread,
+ * and draws its placeholder meanwhile.
+ */
+typedef struct _AsyncContextData {
+    const GtkGLVisual *visual;  // NULL for destruction
+    guint ver_major, ver_minor;  // ver_major is 0 for a legacy context
+    GtkGLProfile profile;
+    GtkGLContextFlags flags;
+    gboolean success;
+} AsyncContextData;
+
+
+static gboolean
+complete_async_on_main(gpointer user) {
+    GTask *task = user;
+    GtkGLCanvas *canvas = g_task_get_source_object(task);
+    GtkGLCanvas_Priv *priv = GTK_GL_CANVAS_GET_PRIV(canvas);
+    AsyncContextData *data = g_task_get_task_data(task);
+    gboolean aborted = priv->async_aborted;
+    GtkAllocation allocation;
+
+    priv->busy = FALSE;
+    priv->async_aborted = FALSE;
+
+    if (!aborted) {
+        // Catch up with size allocations made while busy
+        gtk_widget_get_allocation(GTK_WIDGET(canvas), &allocation);
+        gtk_gl_canvas_native_resize(canvas, allocation.width,
+                allocation.height);
+    }
+
+    if (aborted) {
+        // gtk_gl_canvas_unrealize() has cleaned up already
+        g_task_return_new_error(task, G_IO_ERROR, G_IO_ERROR_CANCELLED,
+                "The canvas was unrealized");
+    } else if (!data->visual) {
+        drop_share_group(canvas);
+        g_task_return_boolean(task, TRUE);
+    } else {
+        if (data->success) gtk_gl_canvas_native_make_current(canvas);
+        gtk_gl_canvas_after_create_context(canvas, data->success);
+        if (data->success) {
+            g_task_return_boolean(task, TRUE);
+        } else {
+            g_task_return_new_error(task, G_IO_ERROR, G_IO_ERROR_FAILED,
+                    "Unable to create OpenGL context");
+        }
+    }
+    return G_SOURCE_REMOVE;
+}
+
+
+static void
+run_async_context_task(GTask *task, gpointer source, gpointer task_data,
+        GCancellable *cancellable) {
+    GtkGLCanvas *canvas = source;
+    GtkGLCanvas_Priv *priv = GTK_GL_CANVAS_GET_PRIV(canvas);
+    AsyncContextData *data = task_data;
+
+    g_mutex_lock(&priv->native_mutex);
+    if (priv->async_aborted) {
+        // Unrealized before the worker started
+    } else if (!data->visual) {
+        gtk_gl_canvas_native_destroy_context(canvas);
+    } else if (!g_cancellable_is_cancelled(cancellable)) {
+        data->success = data->ver_major
+                ? gtk_gl_canvas_native_create_context_with_version(canvas,
+                    data->visual, data->ver_major, data->ver_minor,
+                    data->profile, data->flags)
+                : gtk_gl_canvas_native_create_context(canvas, data->visual);
+        // The main thread makes it current once the result is applied
+        if (data->success) gtk_gl_canvas_native_clear_current(canvas);
+    }
+    g_mutex_unlock(&priv->native_mutex);
+
+    g_main_context_invoke_full(g_task_get_context(task), G_PRIORITY_DEFAULT,
+            complete_async_on_main, g_object_ref(task), g_object_unref);
+}
+
+
+static gboolean
+run_async_context_task_on_idle(gpointer user) {
+    GTask *task = user;
+    run_async_context_task(task, g_task_get_source_object(task),
+            g_task_get_task_data(task), g_task_get_cancellable(task));
+    return G_SOURCE_REMOVE;
+}
+
+
+// Whether start_async_context_task() runs the task rather than failing it.
+// The _async() functions only touch the canvas' state if it does.
+static gboolean
+async_context_task_can_start(GtkGLCanvas *canvas) {
+    return !GTK_GL_CANVAS_GET_PRIV(canvas)->busy
+            && gtk_widget_get_realized(GTK_WIDGET(canvas));
+}
+
+
+static void
+start_async_context_task(GtkGLCanvas *canvas, AsyncContextData *data,
+        gpointer source_tag, GCancellable *cancellable,
+        GAsyncReadyCallback callback, gpointer user_data) {
+    GtkGLCanvas_Priv *priv = GTK_GL_CANVAS_GET_PRIV(canvas);
+    GTask *task = g_task_new(canvas, cancellable, callback, user_data);
+
+    g_task_set_source_tag(task, source_tag);
+    g_task_set_task_data(task, data, g_free);
+
+    if (priv->busy) {
+        g_task_return_new_error(task, G_IO_ERROR, G_IO_ERROR_PENDING,
+                "Another context operation is pending on the canvas");
+    } else if (!gtk_widget_get_realized(GTK_WIDGET(canvas))) {
+        g_task_return_new_error(task, G_IO_ERROR, G_IO_ERROR_FAILED,
+                "The canvas is not realized");
+    } else {
+        priv->busy = TRUE;
+        if (gtk_gl_threaded_context_creation_is_enabled()
+                && gtk_gl_canvas_native_prepare_async(canvas)) {
+            g_task_run_in_thread(task, run_async_context_task);
+        } else {
+            GSource *idle = g_idle_source_new();
+            g_source_set_callback(idle, run_async_context_task_on_idle,
+                    g_object_ref(task), g_object_unref);
+            g_source_attach(idle, g_task_get_context(task));
+            g_source_unref(idle);
+        }
+    }
+    g_object_unref(task);
+}
+
+
+void
+gtk_gl_canvas_create_context_async(GtkGLCanvas *canvas,
+        const GtkGLVisual *visual, guint ver_major, guint ver_minor,
+        GtkGLProfile profile, GtkGLContextFlags flags,
+        GCancellable *cancellable, GAsyncReadyCallback callback,
+        gpointer user_data) {
+    GtkGLCanvas_Priv *priv = GTK_GL_CANVAS_GET_PRIV(canvas);
+    AsyncContextData *data;
+
+    g_assert(visual);
+
+    if (async_context_task_can_start(canvas)) {
+        gtk_gl_canvas_before_create_context(canvas);
+        priv->is_dummy = TRUE;
+        gtk_widget_queue_draw(GTK_WIDGET(canvas));
+    }
+
+    data = g_malloc0(sizeof *data);
+    data->visual = visual;
+    data->ver_major = ver_major;
+    data->ver_minor = ver_minor;
+    data->profile = profile;
+    data->flags = flags;
+    start_async_context_task(canvas, data, gtk_gl_canvas_create_context_async,
+            cancellable, callback, user_data);
+}
+
+
+gboolean
+gtk_gl_canvas_create_context_finish(GtkGLCanvas *canvas,
+        GAsyncResult *result, GError **error) {
+    g_return_val_if_fail(g_task_is_valid(result, canvas), FALSE);
+    return g_task_propagate_boolean(G_TASK(result), error);
+}
+
+
+void
+gtk_gl_canvas_destroy_context_async(GtkGLCanvas *canvas,
+        GCancellable *cancellable, GAsyncReadyCallback callback,
+        gpointer user_data) {
+    GtkGLCanvas_Priv *priv = GTK_GL_CANVAS_GET_PRIV(canvas);
+
+    if (async_context_task_can_start(canvas) && !priv->is_dummy) {
+        // The context must not stay current on the main thread
+        gtk_gl_canvas_native_clear_current(canvas);
+        leave_share_group(canvas);
+        priv->is_dummy = TRUE;
+        gtk_widget_queue_draw(GTK_WIDGET(canvas));
+    }
+    start_async_context_task(canvas, g_malloc0(sizeof(AsyncContextData)),
+            gtk_gl_canvas_destroy_context_async, cancellable, callback,
+            user_data);
+}
+
+
+gboolean
+gtk_gl_canvas_destroy_context_finish(GtkGLCanvas *canvas,
+        GAsyncResult *result, GError **error) {
+    g_return_val_if_fail(g_task_is_valid(result, canvas), FALSE);
+    return g_task_propagate_boolean(G_TASK(result), error);
+}
+
+
 gboolean
 gtk_gl_canvas_has_context(const GtkGLCanvas *canvas) {
     GtkGLCanvas_Priv *priv = GTK_GL_CANVAS_GET_PRIV(canvas);
@@ -332,6 +915,14 @@ gtk_gl_canvas_make_current(GtkGLCanvas *wid) {
 }
 
 
+guint
+gtk_gl_canvas_get_framebuffer(GtkGLCanvas *canvas) {
+    g_return_val_if_fail(GTK_GL_IS_CANVAS(canvas), 0);
+    if (!gtk_gl_canvas_has_context(canvas)) return 0;
+    return gtk_gl_canvas_native_get_framebuffer(canvas);
+}
+
+
 void
 gtk_gl_canvas_display_frame(GtkGLCanvas *wid) {
     GtkGLCanvas_Priv *priv = GTK_GL_CANVAS_GET_PRIV(wid);
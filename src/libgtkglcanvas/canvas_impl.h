@@ -31,6 +31,16 @@ struct _GtkGLCanvas_Priv {
 	GtkGLCanvas_NativePriv *native;
 	gboolean is_dummy;
     gboolean double_buffered;
+    GtkGLShareGroup *share_group;  // For contexts created from now on
+    // Group the current or pending context is created in, if any. Backends
+    // share, pool and adopt contexts by this field only.
+    GtkGLShareGroup *context_group;
+
+    // Set while an asynchronous creation or destruction is running. The
+    // worker holds native_mutex while it accesses the native state.
+    gboolean busy;
+    gboolean async_aborted;  // The canvas was unrealized meanwhile
+    GMutex native_mutex;
 };
 
 
@@ -41,10 +51,69 @@ gboolean gtk_gl_canvas_native_create_context(GtkGLCanvas *canvas,
         const GtkGLVisual *visual);
 gboolean gtk_gl_canvas_native_create_context_with_version(GtkGLCanvas *canvas,
        const GtkGLVisual *visual, guint ver_major, guint ver_minor,
-       GtkGLProfile profile);
+       GtkGLProfile profile, GtkGLContextFlags flags);
 void gtk_gl_canvas_native_destroy_context(GtkGLCanvas *canvas);
 void gtk_gl_canvas_native_swap_buffers(GtkGLCanvas *canvas);
 void gtk_gl_canvas_native_make_current(GtkGLCanvas *canvas);
+void gtk_gl_canvas_native_resize(GtkGLCanvas *canvas, gint width,
+        gint height);
+
+// The framebuffer object the canvas renders to in single-context mode, zero
+// if it renders to its window, see gtk_gl_canvas_get_framebuffer()
+guint gtk_gl_canvas_native_get_framebuffer(GtkGLCanvas *canvas);
+
+// Capabilities of the canvas' display, see gtk_gl_canvas_get_display_caps().
+// Only called on realized canvases.
+GtkGLDisplayCaps gtk_gl_canvas_native_get_display_caps(GtkGLCanvas *canvas);
+
+// Asynchronous creation and destruction: if threaded creation is enabled (see
+// gtk_gl_set_threaded_context_creation()), prepare_async() is called on the
+// main thread and returns whether the native create and destroy functions
+// may run on a worker thread afterwards. clear_current() releases the
+// canvas' context from the calling thread if it is current there.
+gboolean gtk_gl_canvas_native_prepare_async(GtkGLCanvas *canvas);
+void gtk_gl_canvas_native_clear_current(GtkGLCanvas *canvas);
+
+// Returns another member of the canvas' share group that has a context, or
+// NULL. Backends create the canvas' context sharing with the peer's context.
+GtkGLCanvas *gtk_gl_canvas_get_share_peer(GtkGLCanvas *canvas);
+
+// The number of released contexts each screen keeps for reuse, zero if
+// pooling is disabled. See gtk_gl_set_context_pool_size().
+guint gtk_gl_context_pool_get_size(void);
+
+// Whether the application allowed worker threads, see
+// gtk_gl_set_threaded_context_creation().
+gboolean gtk_gl_threaded_context_creation_is_enabled(void);
+
+// Counts a make-current request for gtk_gl_get_make_current_stats(); skipped
+// is TRUE if the backend found the context to be current already.
+void gtk_gl_count_make_current(gboolean skipped);
+
+// Persistent decision cache. lookup_decision() returns a standalone visual
+// (freed with gtk_gl_visual_free) that was chosen for an equal requirement
+// list and version before, or NULL. store_decision() records a successful
+// choice. A ver_major of zero denotes a context created without a version.
+GtkGLVisual *gtk_gl_canvas_native_lookup_decision(GtkGLCanvas *canvas,
+        const GtkGLRequirement *requirements, guint ver_major,
+        guint ver_minor, GtkGLProfile profile);
+void gtk_gl_canvas_native_store_decision(GtkGLCanvas *canvas,
+        const GtkGLRequirement *requirements, const GtkGLVisual *visual,
+        guint ver_major, guint ver_minor, GtkGLProfile profile);
+
+// Fills out[i] with the value of one attribute of visuals->entries[i], as
+// gtk_gl_describe_visuals() would. Backends may query only this attribute.
+void gtk_gl_describe_visuals_attribute(const GtkGLVisualList *visuals,
+        GtkGLAttribute attr, gint *out);
+
+// Reads an attribute from a description, implemented in visual.c
+gint gtk_gl_framebuffer_config_get(const GtkGLFramebufferConfig *config,
+        GtkGLAttribute attr);
+
+// Creates a list with storage for "count" backend visuals of "visual_size"
+// bytes in the same allocation, entries[i] pointing to the i-th slot. The
+// visuals are released together with the list and not by gtk_gl_visual_free.
+GtkGLVisualList *gtk_gl_visual_list_new_inline(gsize count, gsize visual_size);
 
 
 #define GTK_GL_CANVAS_GET_PRIV(obj) \
@@ -0,0 +1,1979 @@
+/**
+ * Copyright (c) 2014-2015, Fabian Knorr
+ *
+ * This file is part of libgtkglcanvas.
+ *
+ * libgtkglcanvas is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libgtkglcanvas is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libgtkglcanvas. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/* EGL backend for X11, an alternative to glx.c selected at runtime (see
+ * backend.c). Contexts render to a child X window of the canvas window, as
+ * with GLX, through an EGL window surface. Unlike the GLX backend it keeps
+ * no pool of released contexts and no persistent visual cache: EGLConfigs
+ * are enumerated and described client-side, which is cheap enough to repeat
+ * once per screen and run.
+ */
+
+#define BACKEND_NAME egl
+#include "backend.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+
+#include <epoxy/gl.h>
+#include <epoxy/egl.h>
+
+#include <gtk/gtk.h>
+#include <gdk/gdkx.h>
+#include <glib-object.h>
+
+#include <gtkgl/visual.h>
+#include <gtkgl/canvas.h>
+#include <gtkgl/ext.h>
+#include "xerror.h"
+#include "cache.h"
+#include "toplevel.h"
+
+
+// Tokens of extensions newer than some epoxy releases
+#ifndef EGL_CONTEXT_OPENGL_NO_ERROR_KHR
+#define EGL_CONTEXT_OPENGL_NO_ERROR_KHR 0x31B3
+#endif
+#ifndef EGL_CONTEXT_RELEASE_BEHAVIOR_KHR
+#define EGL_CONTEXT_RELEASE_BEHAVIOR_KHR 0x2097
+#define EGL_CONTEXT_RELEASE_BEHAVIOR_NONE_KHR 0
+#endif
+
+
+// How the display's GL implementation renders, see probe_renderer()
+typedef enum _RendererClass {
+    RENDERER_UNKNOWN,  // Not probed yet or probing failed
+    RENDERER_ACCELERATED,
+    RENDERER_SOFTWARE,  // Rasterizing on the CPU
+} RendererClass;
+
+
+// Describes an EGLConfig for create_context / describe_visual.
+struct _GtkGLVisual {
+    EGLDisplay egl_dpy;
+    EGLConfig cfg;
+    GtkGLDisplayCaps caps;
+    RendererClass renderer;
+    gboolean float_color;  // EGL_EXT_pixel_format_float is supported
+    // Bit (1 << attr) is set once the attribute has been queried into
+    // "config", see describe_config_attribute()
+    volatile gint described;
+    GtkGLFramebufferConfig config;
+};
+
+
+#define ALL_ATTRIBUTES_DESCRIBED \
+    ((gint) (((1u << (GTK_GL_BUFFER_AGE + 1)) - 1) & ~(1u << GTK_GL_NONE)))
+
+
+// Serializes lazy description of visuals shared between canvases
+static GMutex describe_mutex;
+
+
+void
+gtk_gl_visual_free(GtkGLVisual *visual) {
+    g_free(visual);
+}
+
+
+// Whether a space-separated list (extensions, client APIs) contains a token
+static gboolean
+has_token(const gchar *list, const gchar *token) {
+    size_t len = strlen(token);
+    const gchar *it = list;
+
+    while (it && (it = strstr(it, token))) {
+        if ((it == list || it[-1] == ' ') && (it[len] == ' ' || !it[len])) {
+            return TRUE;
+        }
+        it += len;
+    }
+    return FALSE;
+}
+
+
+/* Takes the capability snapshot of an EGL display. This is the only place
+ * that scans the EGL extension strings; it runs once per screen, see
+ * get_display_caps().
+ */
+static GtkGLDisplayCaps
+query_display_caps(EGLDisplay egl_dpy, gint egl_version) {
+    const gchar *apis = eglQueryString(egl_dpy, EGL_CLIENT_APIS);
+    GtkGLDisplayCaps caps = GTK_GL_DISPLAY_FBCONFIG | GTK_GL_DISPLAY_MULTISAMPLE;
+
+#define HAS_EXTENSION(name) epoxy_has_egl_extension(egl_dpy, name)
+
+    // Profiles are part of EGL_KHR_create_context, which EGL 1.5 includes
+    if (egl_version >= 15 || HAS_EXTENSION("EGL_KHR_create_context")) {
+        caps |= GTK_GL_DISPLAY_CREATE_CONTEXT
+                | GTK_GL_DISPLAY_CREATE_CONTEXT_PROFILE;
+    }
+    if (has_token(apis, "OpenGL_ES")) {
+        caps |= GTK_GL_DISPLAY_CREATE_CONTEXT_ES_PROFILE;
+    }
+    if (egl_version >= 15 || HAS_EXTENSION("EGL_KHR_gl_colorspace")) {
+        caps |= GTK_GL_DISPLAY_FRAMEBUFFER_SRGB;
+    }
+    if (HAS_EXTENSION("EGL_EXT_buffer_age")) {
+        caps |= GTK_GL_DISPLAY_BUFFER_AGE;
+    }
+    if (HAS_EXTENSION("EGL_KHR_create_context_no_error")) {
+        caps |= GTK_GL_DISPLAY_CREATE_CONTEXT_NO_ERROR;
+    }
+    if (HAS_EXTENSION("EGL_KHR_context_flush_control")) {
+        caps |= GTK_GL_DISPLAY_CONTEXT_FLUSH_CONTROL;
+    }
+
+#undef HAS_EXTENSION
+
+    return caps;
+}
+
+
+/* Queries a single attribute of a visual's EGLConfig into visual->config,
+ * see describe_fbconfig_attribute() in glx.c. Must be called with
+ * describe_mutex held.
+ */
+static void
+describe_config_attribute(GtkGLVisual *visual, GtkGLAttribute attr) {
+    GtkGLFramebufferConfig *out = &visual->config;
+    EGLint value;
+
+#define QUERY(attr) \
+    (value = 0, eglGetConfigAttrib(visual->egl_dpy, visual->cfg, EGL_##attr, \
+            &value), value)
+
+    if (visual->described & (1 << attr)) return;
+
+    switch (attr) {
+        case GTK_GL_ACCELERATED:
+            out->accelerated = visual->renderer != RENDERER_SOFTWARE
+                    && QUERY(CONFIG_CAVEAT) != EGL_SLOW_CONFIG;
+            break;
+
+        case GTK_GL_COLOR_TYPES:
+            out->color_types = QUERY(COLOR_BUFFER_TYPE) == EGL_RGB_BUFFER
+                    ? GTK_GL_COLOR_RGBA : 0;
+            break;
+
+        case GTK_GL_COLOR_BPP: out->color_bpp = QUERY(BUFFER_SIZE); break;
+        case GTK_GL_FB_LEVEL: out->fb_level = QUERY(LEVEL); break;
+
+        // EGL window surfaces always render to a back buffer, and there is
+        // no stereo, auxiliary or accumulation buffers
+        case GTK_GL_DOUBLE_BUFFERED: out->double_buffered = TRUE; break;
+        case GTK_GL_STEREO_BUFFERED: out->stereo_buffered = FALSE; break;
+        case GTK_GL_AUX_BUFFERS: out->aux_buffers = 0; break;
+        case GTK_GL_RED_ACCUM_BPP: out->red_accum_bpp = 0; break;
+        case GTK_GL_GREEN_ACCUM_BPP: out->green_accum_bpp = 0; break;
+        case GTK_GL_BLUE_ACCUM_BPP: out->blue_accum_bpp = 0; break;
+        case GTK_GL_ALPHA_ACCUM_BPP: out->alpha_accum_bpp = 0; break;
+
+        case GTK_GL_RED_COLOR_BPP: out->red_color_bpp = QUERY(RED_SIZE); break;
+        case GTK_GL_GREEN_COLOR_BPP:
+            out->green_color_bpp = QUERY(GREEN_SIZE);
+            break;
+        case GTK_GL_BLUE_COLOR_BPP: out->blue_color_bpp = QUERY(BLUE_SIZE); break;
+        case GTK_GL_ALPHA_COLOR_BPP:
+            out->alpha_color_bpp = QUERY(ALPHA_SIZE);
+            break;
+        case GTK_GL_DEPTH_BPP: out->depth_bpp = QUERY(DEPTH_SIZE); break;
+        case GTK_GL_STENCIL_BPP: out->stencil_bpp = QUERY(STENCIL_SIZE); break;
+
+        case GTK_GL_TRANSPARENT_TYPE:
+            out->transparent_type = QUERY(TRANSPARENT_TYPE)
+                    == EGL_TRANSPARENT_RGB ? GTK_GL_TRANSPARENT_RGB
+                    : GTK_GL_TRANSPARENT_NONE;
+            break;
+
+        case GTK_GL_TRANSPARENT_INDEX_VALUE: out->transparent_index = 0; break;
+        case GTK_GL_TRANSPARENT_RED:
+            out->transparent_red = QUERY(TRANSPARENT_RED_VALUE);
+            break;
+        case GTK_GL_TRANSPARENT_GREEN:
+            out->transparent_green = QUERY(TRANSPARENT_GREEN_VALUE);
+            break;
+        case GTK_GL_TRANSPARENT_BLUE:
+            out->transparent_blue = QUERY(TRANSPARENT_BLUE_VALUE);
+            break;
+        case GTK_GL_TRANSPARENT_ALPHA: out->transparent_alpha = 0; break;
+
+        case GTK_GL_SAMPLE_BUFFERS:
+            out->sample_buffers = QUERY(SAMPLE_BUFFERS);
+            break;
+        case GTK_GL_SAMPLES_PER_PIXEL:
+            out->samples_per_pixel = QUERY(SAMPLES);
+            break;
+
+        case GTK_GL_CAVEAT:
+            QUERY(CONFIG_CAVEAT);
+            out->caveat
+                    = value == EGL_SLOW_CONFIG ? GTK_GL_CAVEAT_SLOW
+                    : value == EGL_NON_CONFORMANT_CONFIG
+                            ? GTK_GL_CAVEAT_NONCONFORMANT
+                    : GTK_GL_CAVEAT_NONE;
+            if (out->caveat == GTK_GL_CAVEAT_NONE
+                    && visual->renderer == RENDERER_SOFTWARE) {
+                // Drivers rarely mark their software fallback as slow
+                out->caveat = GTK_GL_CAVEAT_SLOW;
+            }
+            break;
+
+        case GTK_GL_SWAP_METHOD:
+            // The swap behavior is a property of the surface in EGL
+            out->swap_method = GTK_GL_SWAP_UNDEFINED;
+            break;
+
+        case GTK_GL_SRGB_CAPABLE:
+            // Window surfaces are created in sRGB colorspace if supported,
+            // see create_window_surface()
+            out->srgb_capable = (visual->caps & GTK_GL_DISPLAY_FRAMEBUFFER_SRGB)
+                    && QUERY(COLOR_BUFFER_TYPE) == EGL_RGB_BUFFER;
+            break;
+
+        case GTK_GL_FLOAT_COLOR:
+            out->float_color = visual->float_color
+                    && QUERY(COLOR_COMPONENT_TYPE_EXT)
+                        == EGL_COLOR_COMPONENT_TYPE_FLOAT_EXT;
+            break;
+
+        case GTK_GL_BUFFER_AGE:
+            // A property of the surface, available for every config
+            out->buffer_age = !!(visual->caps & GTK_GL_DISPLAY_BUFFER_AGE);
+            break;
+
+        default:
+            return;
+    }
+    g_atomic_int_or((volatile guint*) &visual->described, 1u << attr);
+
+#undef QUERY
+}
+
+
+// Makes sure all attributes of a visual are in visual->config
+static const GtkGLFramebufferConfig *
+describe_config(GtkGLVisual *visual) {
+    GtkGLAttribute attr;
+
+    if (g_atomic_int_get(&visual->described) != ALL_ATTRIBUTES_DESCRIBED) {
+        g_mutex_lock(&describe_mutex);
+        for (attr = GTK_GL_NONE + 1; attr <= GTK_GL_BUFFER_AGE; ++attr) {
+            describe_config_attribute(visual, attr);
+        }
+        g_mutex_unlock(&describe_mutex);
+    }
+    return &visual->config;
+}
+
+
+struct _GtkGLCanvas_NativePriv {
+    // Whether the struct has been initialized (in init_native())
+    gboolean initialized;
+
+    // "Location" of the GtkGLCanvas X window and the EGL display on it
+    Display *dpy;
+    gint screen;
+    EGLDisplay egl_dpy;
+
+    // The child X window of the GtkGLCanvas window the context renders to,
+    // its colormap and the EGL surface created on it. xwin and colormap are 0
+    // if the surface is created on the GtkGLCanvas window itself.
+    Window xwin;
+    Colormap colormap;
+    EGLSurface surface;
+
+    // The context once created and the client API it belongs to
+    EGLContext context;
+    EGLenum api;
+
+    // What the context was created with, keys adoption and the context pool
+    gint config_id;
+    guint ver_major, ver_minor;
+    GtkGLProfile profile;
+    GtkGLContextFlags flags;  // As applied, see get_supported_context_flags()
+
+    // Whether the context has been created successfully and may be adopted
+    // or pooled
+    gboolean adoptable;
+
+    // Set in single-context mode if the context renders into a framebuffer
+    // object, and xwin, colormap, surface and context are shared with the
+    // other members in the toplevel, see toplevel.h
+    GtkGLToplevel *toplevel;
+
+    // The XVisualInfo of the GtkGLCanvas window
+    XVisualInfo visual_info;
+
+    // The GdkDisplay, the GtkGLCanvas X window and its size, captured on the
+    // main thread so that creating the context on a worker needs no GDK calls
+    GdkDisplay *gdk_display;
+    Window parent;
+    gint width, height;
+
+    // Copy of the screen's capability snapshot, see get_display_caps()
+    gboolean caps_valid;
+    GtkGLDisplayCaps caps;
+};
+
+
+/* Per-thread record of the last eglMakeCurrent() issued by the library, see
+ * the equivalent in glx.c. Destroying a context or surface bumps
+ * current_generation, because the handles may be reused afterwards.
+ */
+typedef struct _CurrentRecord {
+    EGLDisplay egl_dpy;
+    EGLSurface surface;
+    EGLContext context;
+    gint generation;
+} CurrentRecord;
+
+static GPrivate current_record = G_PRIVATE_INIT(g_free);
+static volatile gint current_generation;
+
+
+static void
+invalidate_current_records(void) {
+    g_atomic_int_inc(&current_generation);
+}
+
+
+// eglMakeCurrent() and eglGetCurrentContext() act on the bound client API
+static void
+bind_api(EGLenum api) {
+    if (eglQueryAPI() != api) eglBindAPI(api);
+}
+
+
+static gboolean
+make_current(EGLDisplay egl_dpy, EGLSurface surface, EGLContext context,
+        EGLenum api) {
+    CurrentRecord *rec = g_private_get(&current_record);
+    gint generation = g_atomic_int_get(&current_generation);
+    gboolean success;
+
+    bind_api(api);
+    if (!rec) {
+        rec = g_malloc0(sizeof *rec);
+        g_private_set(&current_record, rec);
+    } else if (rec->generation == generation && rec->egl_dpy == egl_dpy
+            && rec->surface == surface && rec->context == context
+            && eglGetCurrentContext() == context
+            && eglGetCurrentSurface(EGL_DRAW) == surface
+            && eglGetCurrentDisplay() == egl_dpy) {
+        gtk_gl_count_make_current(TRUE);
+        return TRUE;
+    }
+
+    success = eglMakeCurrent(egl_dpy, surface, surface, context);
+    gtk_gl_count_make_current(FALSE);
+    rec->egl_dpy = success ? egl_dpy : EGL_NO_DISPLAY;
+    rec->surface = success ? surface : EGL_NO_SURFACE;
+    rec->context = success ? context : EGL_NO_CONTEXT;
+    rec->generation = generation;
+    return success;
+}
+
+
+static void
+release_current(EGLDisplay egl_dpy, EGLenum api) {
+    bind_api(api);
+    eglMakeCurrent(egl_dpy, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    invalidate_current_records();
+}
+
+
+/* Released contexts are kept per screen together with their surface and X
+ * window, as in glx.c (see gtk_gl_set_context_pool_size()).
+ */
+typedef struct _PooledContext {
+    gint config_id;
+    guint ver_major, ver_minor;
+    GtkGLProfile profile;
+    GtkGLContextFlags flags;
+    GtkGLShareGroup *share_group;  // Holds a reference
+    EGLenum api;
+    Window xwin;
+    Colormap colormap;
+    EGLSurface surface;
+    EGLContext context;
+} PooledContext;
+
+
+static void
+pooled_context_free(PooledContext *pooled) {
+    if (pooled->share_group) gtk_gl_share_group_unref(pooled->share_group);
+    g_free(pooled);
+}
+
+
+/* The EGL display, its capabilities and the enumerated EGLConfigs are kept
+ * per X screen and parent visual class. The EGL display is terminated once
+ * the GdkDisplay is closed.
+ */
+typedef struct _DisplayState {
+    GdkDisplay *gdk_display;
+    Display *dpy;
+    gint screen;
+    EGLDisplay egl_dpy;  // EGL_NO_DISPLAY if EGL is unusable on the screen
+    RendererClass renderer;  // RENDERER_UNKNOWN until probed
+    GtkGLDisplayCaps caps;  // See query_display_caps()
+    gboolean float_color;
+    GSList *visual_pools;  // of VisualPool
+    GQueue context_pool;  // of PooledContext, most recently released first
+} DisplayState;
+
+
+typedef struct _VisualPool {
+    gint visual_class;  // X visual class of the parent window
+    GtkGLVisualList *visuals;  // Owns the visuals
+} VisualPool;
+
+
+static GSList *display_states;
+static GMutex display_state_mutex;
+
+
+static void
+display_state_free(DisplayState *state) {
+    GSList *it;
+    for (it = state->visual_pools; it; it = it->next) {
+        VisualPool *pool = it->data;
+        gtk_gl_visual_list_free(pool->visuals);
+        g_free(pool);
+    }
+    g_slist_free(state->visual_pools);
+
+    // Terminating the display releases all pooled contexts and surfaces
+    g_queue_foreach(&state->context_pool, (GFunc) pooled_context_free, NULL);
+    g_queue_clear(&state->context_pool);
+    if (state->egl_dpy != EGL_NO_DISPLAY) eglTerminate(state->egl_dpy);
+    g_free(state);
+}
+
+
+static void
+on_display_closed(GdkDisplay *gdk_display, gboolean is_error,
+        gpointer user) {
+    GSList *closed = NULL, *it;
+
+    gtk_gl_forget_xerror_traps(gdk_x11_display_get_xdisplay(gdk_display));
+
+    g_mutex_lock(&display_state_mutex);
+    it = display_states;
+    while (it) {
+        DisplayState *state = it->data;
+        it = it->next;
+        if (state->gdk_display == gdk_display) {
+            display_states = g_slist_remove(display_states, state);
+            closed = g_slist_prepend(closed, state);
+        }
+    }
+    g_mutex_unlock(&display_state_mutex);
+
+    // eglTerminate() may talk to the server, see xerror.h for the lock order
+    g_slist_free_full(closed, (GDestroyNotify) display_state_free);
+}
+
+
+/* Opens the EGL display for an X screen. EGL_EXT_platform_x11 can address
+ * any screen, the legacy eglGetDisplay() only the default one.
+ */
+static EGLDisplay
+open_egl_display(Display *dpy, gint screen, gint *egl_version) {
+    const gchar *client_extensions;
+    EGLDisplay egl_dpy = EGL_NO_DISPLAY;
+    EGLint major, minor;
+
+    // NULL without EGL_EXT_client_extensions
+    client_extensions = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+    if (has_token(client_extensions, "EGL_EXT_platform_x11")) {
+        const EGLint attribs[] = { EGL_PLATFORM_X11_SCREEN_EXT, screen,
+                EGL_NONE };
+        egl_dpy = eglGetPlatformDisplayEXT(EGL_PLATFORM_X11_EXT, dpy,
+                attribs);
+    } else if (screen == DefaultScreen(dpy)) {
+        egl_dpy = eglGetDisplay((EGLNativeDisplayType) dpy);
+    }
+
+    if (egl_dpy == EGL_NO_DISPLAY) return EGL_NO_DISPLAY;
+    if (!eglInitialize(egl_dpy, &major, &minor)) {
+        g_warning("eglInitialize() failed with error 0x%x", eglGetError());
+        return EGL_NO_DISPLAY;
+    }
+
+    // Desktop OpenGL is required, OpenGL ES alone is not enough
+    if (!has_token(eglQueryString(egl_dpy, EGL_CLIENT_APIS), "OpenGL")) {
+        eglTerminate(egl_dpy);
+        return EGL_NO_DISPLAY;
+    }
+    *egl_version = major * 10 + minor;
+    return egl_dpy;
+}
+
+
+// Looks up the state of an X screen, creating it if necessary. Must be
+// called with display_state_mutex held, and with the display locked if the
+// state may not exist yet.
+static DisplayState *
+get_display_state(GdkDisplay *gdk_display, gint screen) {
+    Display *dpy = gdk_x11_display_get_xdisplay(gdk_display);
+    DisplayState *state;
+    GSList *it;
+    gint egl_version = 0;
+
+    for (it = display_states; it; it = it->next) {
+        state = it->data;
+        if (state->dpy == dpy && state->screen == screen) return state;
+    }
+
+    state = g_malloc0(sizeof *state);
+    state->gdk_display = gdk_display;
+    state->dpy = dpy;
+    state->screen = screen;
+    state->egl_dpy = open_egl_display(dpy, screen, &egl_version);
+    if (state->egl_dpy != EGL_NO_DISPLAY) {
+        state->caps = query_display_caps(state->egl_dpy, egl_version);
+        state->float_color = epoxy_has_egl_extension(state->egl_dpy,
+                "EGL_EXT_pixel_format_float");
+    }
+    display_states = g_slist_prepend(display_states, state);
+
+    // Only connect once per GdkDisplay, the handler drops all its screens
+    for (it = display_states->next; it; it = it->next) {
+        if (((DisplayState*) it->data)->gdk_display == gdk_display) {
+            return state;
+        }
+    }
+    g_signal_connect(gdk_display, "closed", G_CALLBACK(on_display_closed),
+            NULL);
+    return state;
+}
+
+
+static DisplayState *
+get_canvas_display_state(GtkGLCanvas *canvas) {
+    GtkGLCanvas_NativePriv *native = GTK_GL_CANVAS_GET_PRIV(canvas)->native;
+    return get_display_state(native->gdk_display, native->screen);
+}
+
+
+GtkGLCanvas_NativePriv*
+gtk_gl_canvas_native_new() {
+	return g_malloc0(sizeof(GtkGLCanvas_NativePriv));
+}
+
+
+static gboolean
+gtk_gl_canvas_init_native(GtkGLCanvas *canvas) {
+	GtkGLCanvas_Priv *priv = GTK_GL_CANVAS_GET_PRIV(canvas);
+    GtkGLCanvas_NativePriv *native = priv->native;
+    XWindowAttributes xattrs;
+    XVisualInfo template, *vi;
+    gint count;
+
+    if (native->initialized) return TRUE;
+
+    native->gdk_display = gdk_window_get_display(priv->win);
+    native->parent = gdk_x11_window_get_xid(priv->win);
+    native->width = gdk_window_get_width(priv->win);
+    native->height = gdk_window_get_height(priv->win);
+
+    native->dpy = gdk_x11_display_get_xdisplay(native->gdk_display);
+	if (!native->dpy) {
+        g_warning("Unable to get X11 display");
+        return FALSE;
+    }
+
+    native->screen = gdk_x11_screen_get_screen_number(gdk_window_get_screen(
+            priv->win));
+
+    // Opening the EGL display talks to the server, so lock the display first
+    // (see xerror.h)
+    XLockDisplay(native->dpy);
+    g_mutex_lock(&display_state_mutex);
+    native->egl_dpy = get_canvas_display_state(canvas)->egl_dpy;
+    g_mutex_unlock(&display_state_mutex);
+    XUnlockDisplay(native->dpy);
+    if (native->egl_dpy == EGL_NO_DISPLAY) {
+        g_warning("Unable to initialize EGL on X11 screen %d", native->screen);
+        return FALSE;
+    }
+
+    gtk_gl_begin_capture_xerrors(native->dpy);
+
+    // Get the XVIsualInfo of the GtkGLCanvas window in order to compare
+    // the visual type later
+    XGetWindowAttributes(native->dpy, native->parent, &xattrs);
+    template.visualid = XVisualIDFromVisual(xattrs.visual);
+    vi = XGetVisualInfo(native->dpy, VisualIDMask, &template, &count);
+    assert(count == 1);
+    native->visual_info = *vi;
+    XFree(vi);
+
+    if (gtk_gl_end_capture_xerrors(native->dpy)) {
+        g_warning("Received X window system error during native canvas"
+            " initialization");
+        return FALSE;
+    }
+
+    native->initialized = TRUE;
+    return TRUE;
+}
+
+
+void
+gtk_gl_canvas_native_realize(GtkGLCanvas *canvas) {
+	GtkGLCanvas_Priv *priv = GTK_GL_CANVAS_GET_PRIV(canvas);
+    GtkGLCanvas_NativePriv *native = priv->native;
+
+    native->initialized = FALSE;
+    native->dpy = NULL;
+    native->screen = 0;
+    native->egl_dpy = EGL_NO_DISPLAY;
+    native->xwin = 0;
+    native->colormap = 0;
+    native->surface = EGL_NO_SURFACE;
+    native->context = EGL_NO_CONTEXT;
+    native->adoptable = FALSE;
+    native->toplevel = NULL;
+    native->caps_valid = FALSE;
+    native->gdk_display = NULL;
+    native->parent = 0;
+}
+
+
+void
+gtk_gl_canvas_native_unrealize(GtkGLCanvas *canvas) {
+    // The canvas window and its children are gone, their XIDs may be reused
+    invalidate_current_records();
+}
+
+
+// Returns the capability snapshot of the canvas' screen, see glx.c. Must be
+// called with the native part initialized.
+static GtkGLDisplayCaps
+get_display_caps(GtkGLCanvas *canvas) {
+    GtkGLCanvas_NativePriv *native = GTK_GL_CANVAS_GET_PRIV(canvas)->native;
+
+    if (!native->caps_valid) {
+        g_mutex_lock(&display_state_mutex);
+        native->caps = get_canvas_display_state(canvas)->caps;
+        native->caps_valid = TRUE;
+        g_mutex_unlock(&display_state_mutex);
+    }
+    return native->caps;
+}
+
+
+GtkGLDisplayCaps
+gtk_gl_canvas_native_get_display_caps(GtkGLCanvas *canvas) {
+    if (!gtk_gl_canvas_init_native(canvas)) return 0;
+    return get_display_caps(canvas);
+}
+
+
+static VisualPool *
+find_visual_pool(DisplayState *state, gint visual_class) {
+    GSList *it;
+    for (it = state->visual_pools; it; it = it->next) {
+        VisualPool *pool = it->data;
+        if (pool->visual_class == visual_class) return pool;
+    }
+    return NULL;
+}
+
+
+static gboolean
+is_software_renderer(const gchar *renderer) {
+    static const gchar *const software_renderers[] = {
+        "llvmpipe", "softpipe", "swrast", "Software Rasterizer", "SWR",
+    };
+    size_t i;
+
+    for (i = 0; i < G_N_ELEMENTS(software_renderers); ++i) {
+        if (strstr(renderer, software_renderers[i])) return TRUE;
+    }
+    return FALSE;
+}
+
+
+/* EGL_CONFIG_CAVEAT is as unreliable as its GLX counterpart when Mesa falls
+ * back to llvmpipe, so the renderer is probed once per screen as in glx.c.
+ * EGL_KHR_surfaceless_context makes this possible without any drawable.
+ */
+static RendererClass
+probe_renderer(EGLDisplay egl_dpy) {
+    static const EGLint config_attribs[] = {
+        EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+        EGL_NONE
+    };
+    RendererClass renderer = RENDERER_UNKNOWN;
+    EGLenum old_api = eglQueryAPI();
+    EGLContext old_context, context;
+    EGLDisplay old_dpy;
+    EGLSurface old_draw, old_read;
+    EGLConfig cfg;
+    EGLint count = 0;
+
+    if (!epoxy_has_egl_extension(egl_dpy, "EGL_KHR_surfaceless_context")
+            || !eglChooseConfig(egl_dpy, config_attribs, &cfg, 1, &count)
+            || count < 1) {
+        return RENDERER_UNKNOWN;
+    }
+
+    eglBindAPI(EGL_OPENGL_API);
+    old_dpy = eglGetCurrentDisplay();
+    old_context = eglGetCurrentContext();
+    old_draw = eglGetCurrentSurface(EGL_DRAW);
+    old_read = eglGetCurrentSurface(EGL_READ);
+
+    context = eglCreateContext(egl_dpy, cfg, EGL_NO_CONTEXT, NULL);
+    if (context != EGL_NO_CONTEXT && eglMakeCurrent(egl_dpy, EGL_NO_SURFACE,
+                EGL_NO_SURFACE, context)) {
+        const gchar *string = (const gchar*) glGetString(GL_RENDERER);
+
+        renderer = string && is_software_renderer(string)
+                ? RENDERER_SOFTWARE : RENDERER_ACCELERATED;
+
+        if (old_context != EGL_NO_CONTEXT) {
+            eglMakeCurrent(old_dpy, old_draw, old_read, old_context);
+        } else {
+            eglMakeCurrent(egl_dpy, EGL_NO_SURFACE, EGL_NO_SURFACE,
+                    EGL_NO_CONTEXT);
+        }
+        invalidate_current_records();
+    }
+    if (context != EGL_NO_CONTEXT) eglDestroyContext(egl_dpy, context);
+
+    eglBindAPI(old_api);
+    return renderer;
+}
+
+
+// Returns the renderer class of the canvas' screen, probing it on first use
+static RendererClass
+get_renderer_class(GtkGLCanvas *canvas) {
+    GtkGLCanvas_NativePriv *native = GTK_GL_CANVAS_GET_PRIV(canvas)->native;
+    RendererClass renderer;
+
+    g_mutex_lock(&display_state_mutex);
+    renderer = get_canvas_display_state(canvas)->renderer;
+    g_mutex_unlock(&display_state_mutex);
+    if (renderer != RENDERER_UNKNOWN) return renderer;
+
+    // Probe without holding the lock, creating a context may take a while
+    renderer = probe_renderer(native->egl_dpy);
+
+    g_mutex_lock(&display_state_mutex);
+    get_canvas_display_state(canvas)->renderer = renderer;
+    g_mutex_unlock(&display_state_mutex);
+    return renderer;
+}
+
+
+static gint
+get_config_id(EGLDisplay egl_dpy, EGLConfig cfg) {
+    EGLint id = 0;
+    eglGetConfigAttrib(egl_dpy, cfg, EGL_CONFIG_ID, &id);
+    return id;
+}
+
+
+// Enumerates all EGLConfigs usable on the canvas window
+static GtkGLVisualList *
+enumerate_configs(GtkGLCanvas *canvas) {
+    GtkGLCanvas_NativePriv *native = GTK_GL_CANVAS_GET_PRIV(canvas)->native;
+    RendererClass renderer = get_renderer_class(canvas);
+    gboolean float_color;
+    EGLConfig *configs;
+    EGLint config_count = 0;
+    GtkGLVisualList *list;
+    size_t i, j;
+
+    g_mutex_lock(&display_state_mutex);
+    float_color = get_canvas_display_state(canvas)->float_color;
+    g_mutex_unlock(&display_state_mutex);
+
+    if (!eglGetConfigs(native->egl_dpy, NULL, 0, &config_count)
+            || config_count <= 0) {
+        return gtk_gl_visual_list_new(TRUE, 0);
+    }
+    configs = g_new(EGLConfig, config_count);
+    eglGetConfigs(native->egl_dpy, configs, config_count, &config_count);
+
+    /* Check for:
+     *   - Ability to render to an X window
+     *   - Correct visual type (must match the parent GtkGLCanvas window)
+     *   - Support for OpenGL or OpenGL ES 2+
+     * and move matching configs to the front, as in glx.c
+     */
+    for (i = 0, j = 0; i < (size_t) config_count; ++i) {
+        EGLint targets = 0, visual_id = 0, vtype = EGL_NONE, apis = 0;
+        eglGetConfigAttrib(native->egl_dpy, configs[i], EGL_SURFACE_TYPE,
+                &targets);
+        eglGetConfigAttrib(native->egl_dpy, configs[i], EGL_NATIVE_VISUAL_ID,
+                &visual_id);
+        eglGetConfigAttrib(native->egl_dpy, configs[i],
+                EGL_NATIVE_VISUAL_TYPE, &vtype);
+        eglGetConfigAttrib(native->egl_dpy, configs[i], EGL_RENDERABLE_TYPE,
+                &apis);
+        if ((targets & EGL_WINDOW_BIT) && visual_id
+                && vtype == native->visual_info.class
+                && (apis & (EGL_OPENGL_BIT | EGL_OPENGL_ES2_BIT))) {
+            configs[j++] = configs[i];
+        }
+    }
+
+    list = gtk_gl_visual_list_new_inline(j, sizeof(GtkGLVisual));
+    for (i = 0; i < list->count; ++i) {
+        GtkGLVisual *visual = list->entries[i];
+        visual->egl_dpy = native->egl_dpy;
+        visual->cfg = configs[i];
+        visual->caps = native->caps;
+        visual->renderer = renderer;
+        visual->float_color = float_color;
+        visual->described = 0;
+    }
+    g_free(configs);
+    return list;
+}
+
+
+/* The persistent cache (cache.h) identifies configurations by their
+ * EGL_CONFIG_ID. The key covers the EGL implementation and the environment
+ * variables that make Mesa fall back to software rendering, as in glx.c.
+ * Vendor and version strings may survive a driver change, so the key also
+ * contains the number of EGLConfigs, and cached records are checked against
+ * the live configuration before they are used (see record_matches()).
+ */
+#define NONNULL_STRING(s) ((s) ? (s) : "")
+
+static gchar *
+get_cache_key(GtkGLCanvas_NativePriv *native) {
+    EGLint config_count = 0;
+
+    eglGetConfigs(native->egl_dpy, NULL, 0, &config_count);
+    return g_strdup_printf("egl|%s|%s|%s|%s|%d|%d|%lu|%d|%s|%s",
+            NONNULL_STRING(DisplayString(native->dpy)),
+            NONNULL_STRING(eglQueryString(native->egl_dpy, EGL_VENDOR)),
+            NONNULL_STRING(eglQueryString(native->egl_dpy, EGL_VERSION)),
+            NONNULL_STRING(eglQueryString(native->egl_dpy, EGL_CLIENT_APIS)),
+            config_count, native->screen,
+            (unsigned long) native->visual_info.visualid,
+            native->visual_info.class,
+            NONNULL_STRING(g_getenv("LIBGL_ALWAYS_SOFTWARE")),
+            NONNULL_STRING(g_getenv("GALLIUM_DRIVER")));
+}
+
+#undef NONNULL_STRING
+
+
+// Re-queries a few attributes of a cached configuration, see glx.c
+static gboolean
+record_matches(EGLDisplay egl_dpy, EGLConfig cfg,
+        const GtkGLCacheRecord *record) {
+    EGLint color = -1, depth = -1, stencil = -1;
+
+    eglGetConfigAttrib(egl_dpy, cfg, EGL_BUFFER_SIZE, &color);
+    eglGetConfigAttrib(egl_dpy, cfg, EGL_DEPTH_SIZE, &depth);
+    eglGetConfigAttrib(egl_dpy, cfg, EGL_STENCIL_SIZE, &stencil);
+    return color == (EGLint) record->config.color_bpp
+            && depth == (EGLint) record->config.depth_bpp
+            && stencil == (EGLint) record->config.stencil_bpp;
+}
+
+
+static void
+store_configs(const gchar *key, const GtkGLVisualList *list) {
+    GtkGLCacheRecord *records;
+    size_t i;
+
+    if (!gtk_gl_cache_is_enabled()) return;
+
+    records = g_new(GtkGLCacheRecord, list->count);
+    for (i = 0; i < list->count; ++i) {
+        GtkGLVisual *visual = list->entries[i];
+        records[i].id = get_config_id(visual->egl_dpy, visual->cfg);
+        records[i].config = *describe_config(visual);
+    }
+    gtk_gl_cache_store_records(key, records, list->count);
+    g_free(records);
+}
+
+
+// Finds the EGLConfig with the given ID, returns NULL if there is none
+static EGLConfig
+find_config(EGLDisplay egl_dpy, gint id) {
+    const EGLint attribs[] = { EGL_CONFIG_ID, id, EGL_NONE };
+    EGLConfig cfg = NULL;
+    EGLint count = 0;
+
+    if (!eglChooseConfig(egl_dpy, attribs, &cfg, 1, &count) || count < 1) {
+        return NULL;
+    }
+    return cfg;
+}
+
+
+/* Rebuilds the visual list from the persistent cache, see load_fbconfigs() in
+ * glx.c. Returns NULL if there is no cache file or a cached configuration no
+ * longer exists or has changed.
+ */
+static GtkGLVisualList *
+load_configs(GtkGLCanvas_NativePriv *native, const gchar *key) {
+    GtkGLCacheFile *file;
+    const GtkGLCacheRecord *records;
+    GtkGLVisualList *list;
+    gboolean complete = TRUE;
+    size_t i;
+
+    file = gtk_gl_cache_file_open(key);
+    if (!file) return NULL;
+
+    list = gtk_gl_visual_list_new_inline(gtk_gl_cache_file_get_records(file,
+            &records), sizeof(GtkGLVisual));
+    for (i = 0; i < list->count && complete; ++i) {
+        GtkGLVisual *visual = list->entries[i];
+        visual->egl_dpy = native->egl_dpy;
+        visual->cfg = find_config(native->egl_dpy, records[i].id);
+        visual->caps = native->caps;
+        visual->config = records[i].config;
+        visual->described = ALL_ATTRIBUTES_DESCRIBED;
+        complete = visual->cfg != NULL
+                && record_matches(native->egl_dpy, visual->cfg, &records[i]);
+    }
+    gtk_gl_cache_file_close(file);
+
+    if (!complete) {
+        gtk_gl_visual_list_free(list);
+        return NULL;
+    }
+    return list;
+}
+
+
+GtkGLVisualList *
+gtk_gl_canvas_enumerate_visuals(GtkGLCanvas *canvas) {
+	GtkGLCanvas_Priv *priv = GTK_GL_CANVAS_GET_PRIV(canvas);
+    GtkGLCanvas_NativePriv *native = priv->native;
+    gint visual_class;
+    DisplayState *state;
+    VisualPool *pool;
+    GtkGLVisualList *visuals, *list;
+    gchar *key;
+
+    assert(canvas);
+
+    if (!gtk_gl_canvas_init_native(canvas)) {
+        return gtk_gl_visual_list_new(TRUE, 0);
+    }
+    get_display_caps(canvas);
+    visual_class = native->visual_info.class;
+
+    g_mutex_lock(&display_state_mutex);
+    pool = find_visual_pool(get_canvas_display_state(canvas), visual_class);
+    if (pool) {
+        list = gtk_gl_visual_list_ref(pool->visuals);
+    }
+    g_mutex_unlock(&display_state_mutex);
+    if (pool) return list;
+
+    key = get_cache_key(native);
+    visuals = load_configs(native, key);
+    if (!visuals) {
+        visuals = enumerate_configs(canvas);
+        store_configs(key, visuals);
+    }
+    g_free(key);
+
+    g_mutex_lock(&display_state_mutex);
+    state = get_canvas_display_state(canvas);
+    pool = find_visual_pool(state, visual_class);
+    if (pool) {
+        // Lost the race against another thread
+        gtk_gl_visual_list_free(visuals);
+    } else {
+        pool = g_malloc(sizeof *pool);
+        pool->visual_class = visual_class;
+        pool->visuals = visuals;
+        state->visual_pools = g_slist_prepend(state->visual_pools, pool);
+    }
+    list = gtk_gl_visual_list_ref(pool->visuals);
+    g_mutex_unlock(&display_state_mutex);
+    return list;
+}
+
+
+GtkGLVisual *
+gtk_gl_canvas_native_lookup_decision(GtkGLCanvas *canvas,
+        const GtkGLRequirement *requirements, guint ver_major,
+        guint ver_minor, GtkGLProfile profile) {
+	GtkGLCanvas_Priv *priv = GTK_GL_CANVAS_GET_PRIV(canvas);
+    GtkGLCanvas_NativePriv *native = priv->native;
+    const GtkGLCacheDecision *decision;
+    const GtkGLCacheRecord *record = NULL;
+    GtkGLCacheFile *file;
+    GtkGLVisual *visual = NULL;
+    EGLConfig cfg;
+    gchar *key;
+
+    if (!gtk_gl_cache_is_enabled() || !gtk_gl_canvas_init_native(canvas)) {
+        return NULL;
+    }
+
+    key = get_cache_key(native);
+    file = gtk_gl_cache_file_open(key);
+    g_free(key);
+    if (!file) return NULL;
+
+    decision = gtk_gl_cache_file_get_decision(file, requirements);
+    if (decision
+            && decision->ver_major == ver_major
+            && decision->ver_minor == ver_minor
+            && decision->profile == (gint32) profile) {
+        record = gtk_gl_cache_file_find_record(file, decision->id);
+    }
+
+    if (record) {
+        cfg = find_config(native->egl_dpy, record->id);
+        if (cfg && record_matches(native->egl_dpy, cfg, record)) {
+            visual = g_malloc0(sizeof *visual);
+            visual->egl_dpy = native->egl_dpy;
+            visual->cfg = cfg;
+            visual->caps = get_display_caps(canvas);
+            visual->config = record->config;
+            visual->described = ALL_ATTRIBUTES_DESCRIBED;
+        }
+    }
+
+    gtk_gl_cache_file_close(file);
+    return visual;
+}
+
+
+void
+gtk_gl_canvas_native_store_decision(GtkGLCanvas *canvas,
+        const GtkGLRequirement *requirements, const GtkGLVisual *visual,
+        guint ver_major, guint ver_minor, GtkGLProfile profile) {
+	GtkGLCanvas_Priv *priv = GTK_GL_CANVAS_GET_PRIV(canvas);
+    GtkGLCanvas_NativePriv *native = priv->native;
+    GtkGLCacheDecision decision;
+    gchar *key;
+
+    if (!gtk_gl_cache_is_enabled()) return;
+
+    decision.id = get_config_id(visual->egl_dpy, visual->cfg);
+    decision.ver_major = ver_major;
+    decision.ver_minor = ver_minor;
+    decision.profile = profile;
+
+    key = get_cache_key(native);
+    gtk_gl_cache_store_decision(key, &decision, requirements);
+    g_free(key);
+}
+
+
+void
+gtk_gl_describe_visual(const GtkGLVisual *visual, GtkGLFramebufferConfig *out) {
+    assert(visual);
+    assert(out);
+
+    *out = *describe_config((GtkGLVisual*) visual);
+}
+
+
+void
+gtk_gl_describe_visuals(const GtkGLVisualList *visuals,
+        GtkGLFramebufferConfig *out) {
+    size_t i;
+
+    assert(visuals);
+    assert(out || !visuals->count);
+
+    for (i = 0; i < visuals->count; ++i) {
+        out[i] = *describe_config(visuals->entries[i]);
+    }
+}
+
+
+void
+gtk_gl_describe_visuals_attribute(const GtkGLVisualList *visuals,
+        GtkGLAttribute attr, gint *out) {
+    size_t i;
+
+    assert(visuals);
+    assert(out || !visuals->count);
+
+    g_mutex_lock(&describe_mutex);
+    for (i = 0; i < visuals->count; ++i) {
+        describe_config_attribute(visuals->entries[i], attr);
+        out[i] = gtk_gl_framebuffer_config_get(&visuals->entries[i]->config,
+                attr);
+    }
+    g_mutex_unlock(&describe_mutex);
+}
+
+
+// Must be called while capturing X errors
+static void
+destroy_context_objects(GtkGLCanvas_NativePriv *native, gboolean context) {
+    if (context && native->context != EGL_NO_CONTEXT) {
+        bind_api(native->api);
+        // Context is not destroyed until it is no longer current
+        if (eglGetCurrentContext() == native->context) {
+            release_current(native->egl_dpy, native->api);
+        }
+        eglDestroyContext(native->egl_dpy, native->context);
+    } else if (native->surface != EGL_NO_SURFACE
+            && eglGetCurrentSurface(EGL_DRAW) == native->surface) {
+        release_current(native->egl_dpy, native->api);
+    }
+    invalidate_current_records();
+    if (native->surface != EGL_NO_SURFACE) {
+        eglDestroySurface(native->egl_dpy, native->surface);
+    }
+    if (native->xwin) XDestroyWindow(native->dpy, native->xwin);
+    if (native->colormap) XFreeColormap(native->dpy, native->colormap);
+
+    native->context = EGL_NO_CONTEXT;
+    native->surface = EGL_NO_SURFACE;
+    native->xwin = 0;
+    native->colormap = 0;
+    native->adoptable = FALSE;
+}
+
+
+// Returns the context to share objects with, see gtk_gl_canvas_set_share_group()
+static EGLContext
+get_share_context(GtkGLCanvas *canvas, EGLenum api) {
+    GtkGLCanvas *peer = gtk_gl_canvas_get_share_peer(canvas);
+    GtkGLCanvas_NativePriv *native = GTK_GL_CANVAS_GET_PRIV(canvas)->native;
+    GtkGLCanvas_NativePriv *peer_native;
+
+    if (!peer) return EGL_NO_CONTEXT;
+    peer_native = GTK_GL_CANVAS_GET_PRIV(peer)->native;
+    if (peer_native->egl_dpy != native->egl_dpy) {
+        g_warning("Unable to share objects between contexts on different"
+                " screens");
+        return EGL_NO_CONTEXT;
+    }
+    if (peer_native->api != api) {
+        g_warning("Unable to share objects between OpenGL and OpenGL ES"
+                " contexts");
+        return EGL_NO_CONTEXT;
+    }
+    return peer_native->context;
+}
+
+
+// Creates the EGL surface on the X window, in sRGB colorspace if supported
+static EGLSurface
+create_window_surface(GtkGLCanvas_NativePriv *native, Window xwin,
+        const GtkGLVisual *visual, EGLenum api) {
+    EGLSurface surface = EGL_NO_SURFACE;
+
+    // OpenGL ES would always encode to sRGB, whereas OpenGL honors
+    // GL_FRAMEBUFFER_SRGB as with GLX
+    if ((native->caps & GTK_GL_DISPLAY_FRAMEBUFFER_SRGB)
+            && api == EGL_OPENGL_API) {
+        const EGLint attribs[] = {
+            EGL_GL_COLORSPACE_KHR, EGL_GL_COLORSPACE_SRGB_KHR,
+            EGL_NONE
+        };
+        surface = eglCreateWindowSurface(native->egl_dpy, visual->cfg,
+                (EGLNativeWindowType) xwin, attribs);
+    }
+    if (surface == EGL_NO_SURFACE) {
+        surface = eglCreateWindowSurface(native->egl_dpy, visual->cfg,
+                (EGLNativeWindowType) xwin, NULL);
+    }
+    return surface;
+}
+
+
+static gboolean
+toplevel_make_current(GtkGLCanvas *member) {
+	GtkGLCanvas_NativePriv *native = GTK_GL_CANVAS_GET_PRIV(member)->native;
+    return make_current(native->egl_dpy, native->surface, native->context,
+            native->api);
+}
+
+
+static void
+toplevel_resize(GtkGLCanvas *member, gint width, gint height) {
+	GtkGLCanvas_NativePriv *native = GTK_GL_CANVAS_GET_PRIV(member)->native;
+    XResizeWindow(native->dpy, native->xwin, MAX(width, 1), MAX(height, 1));
+}
+
+
+static void
+toplevel_swap_buffers(GtkGLCanvas *member) {
+	GtkGLCanvas_NativePriv *native = GTK_GL_CANVAS_GET_PRIV(member)->native;
+    eglSwapBuffers(native->egl_dpy, native->surface);
+}
+
+
+static const GtkGLToplevelFuncs toplevel_funcs = {
+    toplevel_make_current,
+    toplevel_resize,
+    toplevel_swap_buffers
+};
+
+
+// Moves the canvas' new X window into a child window of its toplevel in
+// single-context mode, as in glx.c. Must be called with the context current.
+static void
+enter_toplevel(GtkGLCanvas *canvas, const GtkGLVisual *visual) {
+    GtkGLCanvas_Priv *priv = GTK_GL_CANVAS_GET_PRIV(canvas);
+    GtkGLCanvas_NativePriv *native = priv->native;
+    GtkGLFramebufferConfig config;
+    GtkGLToplevel *toplevel;
+    GdkWindow *window;
+
+    if (!native->xwin || !priv->context_group
+            || !gtk_gl_share_group_get_single_context(priv->context_group)) {
+        return;
+    }
+    gtk_gl_describe_visual(visual, &config);
+    if (!gtk_gl_toplevel_is_supported(&config)) return;
+    toplevel = gtk_gl_toplevel_new(canvas, &config, &toplevel_funcs);
+    if (!toplevel) return;
+
+    window = gtk_gl_toplevel_get_window(toplevel);
+    gtk_gl_begin_capture_xerrors(native->dpy);
+    XReparentWindow(native->dpy, native->xwin,
+            gdk_x11_window_get_xid(window), 0, 0);
+    XResizeWindow(native->dpy, native->xwin,
+            MAX(gdk_window_get_width(window), 1),
+            MAX(gdk_window_get_height(window), 1));
+    if (gtk_gl_end_capture_xerrors(native->dpy)) {
+        g_warning("Unable to move the drawable of a single-context canvas to"
+                " its toplevel");
+        XReparentWindow(native->dpy, native->xwin, native->parent, 0, 0);
+        gtk_gl_toplevel_free(toplevel);
+        return;
+    }
+
+    native->toplevel = toplevel;
+    gtk_gl_toplevel_add_member(toplevel, canvas);
+    gtk_gl_toplevel_bind(toplevel, canvas);
+}
+
+
+// Renders through the surface and context of a member in the same toplevel
+static gboolean
+join_toplevel(GtkGLCanvas *canvas, GtkGLCanvas_NativePriv *owner) {
+    GtkGLCanvas_NativePriv *native = GTK_GL_CANVAS_GET_PRIV(canvas)->native;
+
+    if (!make_current(owner->egl_dpy, owner->surface, owner->context,
+                owner->api)) {
+        g_warning("eglMakeCurrent() failed on a shared toplevel drawable");
+        return FALSE;
+    }
+    native->config_id = owner->config_id;
+    native->ver_major = owner->ver_major;
+    native->ver_minor = owner->ver_minor;
+    native->profile = owner->profile;
+    native->flags = owner->flags;
+    native->api = owner->api;
+    native->xwin = owner->xwin;
+    native->colormap = owner->colormap;
+    native->surface = owner->surface;
+    native->context = owner->context;
+    native->adoptable = TRUE;
+    native->toplevel = owner->toplevel;
+    GTK_GL_CANVAS_GET_PRIV(canvas)->double_buffered = TRUE;
+    gtk_gl_toplevel_add_member(native->toplevel, canvas);
+    gtk_gl_toplevel_bind(native->toplevel, canvas);
+    return TRUE;
+}
+
+
+static gboolean
+gtk_gl_canvas_native_before_create_context(GtkGLCanvas *canvas,
+        const GtkGLVisual *visual, EGLenum api) {
+    GtkGLCanvas_Priv *priv = GTK_GL_CANVAS_GET_PRIV(canvas);
+    GtkGLCanvas_NativePriv *native = priv->native;
+    Window drawable = native->parent;
+    XSetWindowAttributes xattrs;
+    XVisualInfo template, *vi = NULL;
+    EGLint visual_id = 0;
+    gint count = 0;
+
+    assert(visual);
+    assert(native->initialized);
+    get_display_caps(canvas);  // For create_window_surface()
+
+    // A child X window of the GtkGLCanvas window only where the surface may
+    // outlive the canvas, as in glx.c
+    if (gtk_gl_context_pool_get_size() || (priv->context_group
+                && gtk_gl_share_group_get_single_context(
+                    priv->context_group))) {
+        eglGetConfigAttrib(native->egl_dpy, visual->cfg,
+                EGL_NATIVE_VISUAL_ID, &visual_id);
+        template.visualid = (VisualID) visual_id;
+        template.screen = native->screen;
+        vi = XGetVisualInfo(native->dpy, VisualIDMask | VisualScreenMask,
+                &template, &count);
+        if (!vi) {
+            g_warning("Unable to get X visual from GtkGLVisual");
+            return FALSE;
+        }
+    }
+
+    native->config_id = get_config_id(native->egl_dpy, visual->cfg);
+    native->api = api;
+    native->adoptable = FALSE;
+
+    gtk_gl_begin_capture_xerrors(native->dpy);
+
+    if (vi) {
+        native->colormap = XCreateColormap(native->dpy, native->parent,
+                vi->visual, AllocNone);
+        xattrs.colormap = native->colormap;
+        xattrs.border_pixel = 0;
+        xattrs.background_pixmap = None;
+        native->xwin = XCreateWindow(native->dpy, native->parent, 0, 0,
+                MAX(native->width, 1), MAX(native->height, 1), 0, vi->depth,
+                InputOutput, vi->visual,
+                CWColormap | CWBorderPixel | CWBackPixmap, &xattrs);
+        XFree(vi);
+        XMapWindow(native->dpy, native->xwin);
+        drawable = native->xwin;
+    }
+
+    native->surface = create_window_surface(native, drawable, visual, api);
+    if (native->surface == EGL_NO_SURFACE
+            || gtk_gl_have_xerror(native->dpy)) {
+        g_warning("eglCreateWindowSurface() failed with error 0x%x",
+                eglGetError());
+        gtk_gl_end_capture_xerrors(native->dpy);
+        gtk_gl_canvas_native_destroy_context(canvas);
+        return FALSE;
+    }
+    return TRUE;
+}
+
+
+static gboolean
+gtk_gl_canvas_native_after_create_context(GtkGLCanvas *canvas,
+        const GtkGLVisual *visual) {
+    GtkGLCanvas_Priv *priv = GTK_GL_CANVAS_GET_PRIV(canvas);
+    GtkGLCanvas_NativePriv *native = priv->native;
+    gboolean failed = FALSE;
+
+    if (native->context == EGL_NO_CONTEXT) {
+        gtk_gl_end_capture_xerrors(native->dpy);
+        gtk_gl_canvas_native_destroy_context(canvas);
+        return FALSE;
+    }
+
+    // EGL window surfaces are back-buffered, so display_frame() swaps
+    priv->double_buffered = TRUE;
+
+    if (!make_current(native->egl_dpy, native->surface, native->context,
+                native->api)) {
+        g_warning("eglMakeCurrent() failed after successful context creation");
+        failed = TRUE;
+    }
+
+    if (gtk_gl_end_capture_xerrors(native->dpy)) {
+        g_warning("Received X error during context creation");
+        failed = TRUE;
+    }
+
+    if (failed) {
+        gtk_gl_canvas_native_destroy_context(canvas);
+    } else {
+        enter_toplevel(canvas, visual);
+    }
+    return !failed;
+}
+
+
+// Keeps the canvas' context, surface and X window for reuse instead of
+// destroying them. Must be called while capturing X errors.
+static gboolean
+release_to_context_pool(GtkGLCanvas *canvas) {
+    GtkGLCanvas_Priv *priv = GTK_GL_CANVAS_GET_PRIV(canvas);
+    GtkGLCanvas_NativePriv *native = priv->native;
+    guint pool_size = gtk_gl_context_pool_get_size();
+    GSList *evicted = NULL, *it;
+    PooledContext *pooled;
+    DisplayState *state;
+
+    // Only a surface in a child window can move between canvases
+    if (!pool_size || !native->adoptable || !native->xwin) return FALSE;
+
+    bind_api(native->api);
+    if (eglGetCurrentContext() == native->context) {
+        release_current(native->egl_dpy, native->api);
+    }
+    invalidate_current_records();
+    XUnmapWindow(native->dpy, native->xwin);
+    XReparentWindow(native->dpy, native->xwin,
+            RootWindow(native->dpy, native->screen), 0, 0);
+
+    pooled = g_malloc(sizeof *pooled);
+    pooled->config_id = native->config_id;
+    pooled->ver_major = native->ver_major;
+    pooled->ver_minor = native->ver_minor;
+    pooled->profile = native->profile;
+    pooled->flags = native->flags;
+    pooled->share_group = priv->context_group
+            ? gtk_gl_share_group_ref(priv->context_group) : NULL;
+    pooled->api = native->api;
+    pooled->xwin = native->xwin;
+    pooled->colormap = native->colormap;
+    pooled->surface = native->surface;
+    pooled->context = native->context;
+
+    g_mutex_lock(&display_state_mutex);
+    state = get_canvas_display_state(canvas);
+    g_queue_push_head(&state->context_pool, pooled);
+    while (g_queue_get_length(&state->context_pool) > pool_size) {
+        evicted = g_slist_prepend(evicted,
+                g_queue_pop_tail(&state->context_pool));
+    }
+    g_mutex_unlock(&display_state_mutex);
+
+    // Pooled contexts are never current, so they can be destroyed right away
+    for (it = evicted; it; it = it->next) {
+        pooled = it->data;
+        eglDestroyContext(native->egl_dpy, pooled->context);
+        eglDestroySurface(native->egl_dpy, pooled->surface);
+        XDestroyWindow(native->dpy, pooled->xwin);
+        XFreeColormap(native->dpy, pooled->colormap);
+        pooled_context_free(pooled);
+    }
+    g_slist_free(evicted);
+
+    native->context = EGL_NO_CONTEXT;
+    native->surface = EGL_NO_SURFACE;
+    native->xwin = 0;
+    native->colormap = 0;
+    native->adoptable = FALSE;
+    return TRUE;
+}
+
+
+// Takes a matching context from the pool and makes it current on the canvas
+static gboolean
+acquire_from_context_pool(GtkGLCanvas *canvas, const GtkGLVisual *visual,
+        guint ver_major, guint ver_minor, GtkGLProfile profile,
+        GtkGLContextFlags flags) {
+    GtkGLCanvas_Priv *priv = GTK_GL_CANVAS_GET_PRIV(canvas);
+    GtkGLCanvas_NativePriv *native = priv->native;
+    gint config_id = get_config_id(visual->egl_dpy, visual->cfg);
+    PooledContext *pooled = NULL;
+    DisplayState *state;
+    GList *it;
+    gboolean current;
+
+    g_mutex_lock(&display_state_mutex);
+    state = get_canvas_display_state(canvas);
+    for (it = state->context_pool.head; it; it = it->next) {
+        PooledContext *candidate = it->data;
+        if (candidate->config_id == config_id
+                && candidate->ver_major == ver_major
+                && candidate->ver_minor == ver_minor
+                && candidate->profile == profile
+                && candidate->flags == flags
+                && candidate->share_group == priv->context_group) {
+            pooled = candidate;
+            g_queue_delete_link(&state->context_pool, it);
+            break;
+        }
+    }
+    g_mutex_unlock(&display_state_mutex);
+    if (!pooled) return FALSE;
+
+    native->config_id = pooled->config_id;
+    native->ver_major = pooled->ver_major;
+    native->ver_minor = pooled->ver_minor;
+    native->profile = pooled->profile;
+    native->flags = pooled->flags;
+    native->api = pooled->api;
+    native->xwin = pooled->xwin;
+    native->colormap = pooled->colormap;
+    native->surface = pooled->surface;
+    native->context = pooled->context;
+    native->adoptable = TRUE;
+    priv->double_buffered = TRUE;
+    pooled_context_free(pooled);
+
+    gtk_gl_begin_capture_xerrors(native->dpy);
+    XReparentWindow(native->dpy, native->xwin, native->parent, 0, 0);
+    XResizeWindow(native->dpy, native->xwin, MAX(native->width, 1),
+            MAX(native->height, 1));
+    XMapWindow(native->dpy, native->xwin);
+    current = make_current(native->egl_dpy, native->surface, native->context,
+            native->api);
+    if (gtk_gl_end_capture_xerrors(native->dpy) || !current) {
+        g_warning("Unable to reuse pooled context");
+        native->adoptable = FALSE;
+        gtk_gl_canvas_native_destroy_context(canvas);
+        return FALSE;
+    }
+    enter_toplevel(canvas, visual);
+    return TRUE;
+}
+
+
+/* In single-context mode (see gtk_gl_share_group_set_single_context()),
+ * members with equal config, version, profile and flags render through one
+ * EGLContext, and members in the same toplevel through one surface, as in
+ * glx.c.
+ */
+static gboolean
+context_in_use_elsewhere(GtkGLCanvas *canvas) {
+    GtkGLCanvas_Priv *priv = GTK_GL_CANVAS_GET_PRIV(canvas);
+    GtkGLShareGroup *group = priv->context_group;
+    GList *members, *it;
+    gboolean in_use = FALSE;
+
+    if (priv->native->context == EGL_NO_CONTEXT || !group) return FALSE;
+
+    members = gtk_gl_share_group_list_canvases(group);
+    for (it = members; it && !in_use; it = it->next) {
+        in_use = it->data != canvas && GTK_GL_CANVAS_GET_PRIV(it->data)
+                ->native->context == priv->native->context;
+    }
+    g_list_free(members);
+    return in_use;
+}
+
+
+static gboolean
+adopt_group_context(GtkGLCanvas *canvas, const GtkGLVisual *visual,
+        guint ver_major, guint ver_minor, GtkGLProfile profile,
+        GtkGLContextFlags flags) {
+    GtkGLCanvas_Priv *priv = GTK_GL_CANVAS_GET_PRIV(canvas);
+    GtkGLCanvas_NativePriv *native = priv->native;
+    GtkGLCanvas_NativePriv *owner = NULL, *drawable_owner = NULL;
+    GList *members, *it;
+    gint config_id;
+
+    if (!priv->context_group
+            || !gtk_gl_share_group_get_single_context(priv->context_group)) {
+        return FALSE;
+    }
+
+    // Prefer a member whose drawable is in the same toplevel
+    config_id = get_config_id(visual->egl_dpy, visual->cfg);
+    members = gtk_gl_share_group_list_canvases(priv->context_group);
+    for (it = members; it && !drawable_owner; it = it->next) {
+        GtkGLCanvas_NativePriv *peer = GTK_GL_CANVAS_GET_PRIV(it->data)->native;
+        if (it->data != canvas && peer->adoptable
+                && peer->egl_dpy == native->egl_dpy
+                && peer->config_id == config_id
+                && peer->ver_major == ver_major
+                && peer->ver_minor == ver_minor && peer->profile == profile
+                && peer->flags == flags) {
+            if (!owner) owner = peer;
+            if (peer->toplevel
+                    && gtk_gl_toplevel_contains(peer->toplevel, canvas)) {
+                drawable_owner = peer;
+            }
+        }
+    }
+    g_list_free(members);
+    if (drawable_owner) return join_toplevel(canvas, drawable_owner);
+    if (!owner) return FALSE;
+
+    if (!gtk_gl_canvas_native_before_create_context(canvas, visual,
+                owner->api)) {
+        return FALSE;
+    }
+    native->context = owner->context;
+    if (!gtk_gl_canvas_native_after_create_context(canvas, visual)) {
+        return FALSE;
+    }
+    native->ver_major = ver_major;
+    native->ver_minor = ver_minor;
+    native->profile = profile;
+    native->flags = flags;
+    native->adoptable = TRUE;
+    return TRUE;
+}
+
+
+// Creates a context with the given attributes on a new surface
+static gboolean
+create_context(GtkGLCanvas *canvas, const GtkGLVisual *visual, EGLenum api,
+        const EGLint *attribs) {
+    GtkGLCanvas_NativePriv *native = GTK_GL_CANVAS_GET_PRIV(canvas)->native;
+    EGLint apis = 0;
+
+    eglGetConfigAttrib(native->egl_dpy, visual->cfg, EGL_RENDERABLE_TYPE,
+            &apis);
+    if (!(apis & (api == EGL_OPENGL_API ? EGL_OPENGL_BIT
+            : EGL_OPENGL_ES2_BIT))) {
+        return FALSE;
+    }
+
+    if (!gtk_gl_canvas_native_before_create_context(canvas, visual, api)) {
+        return FALSE;
+    }
+    bind_api(api);
+    native->context = eglCreateContext(native->egl_dpy, visual->cfg,
+            get_share_context(canvas, api), attribs);
+    return gtk_gl_canvas_native_after_create_context(canvas, visual);
+}
+
+
+static gboolean
+create_default_context(GtkGLCanvas *canvas, const GtkGLVisual *visual) {
+    GtkGLCanvas_NativePriv *native = GTK_GL_CANVAS_GET_PRIV(canvas)->native;
+
+    if (adopt_group_context(canvas, visual, 0, 0,
+                GTK_GL_COMPATIBILITY_PROFILE, GTK_GL_CONTEXT_FLAGS_NONE)
+            || acquire_from_context_pool(canvas, visual, 0, 0,
+                GTK_GL_COMPATIBILITY_PROFILE, GTK_GL_CONTEXT_FLAGS_NONE)) {
+        return TRUE;
+    }
+
+    // Create legacy context
+    if (!create_context(canvas, visual, EGL_OPENGL_API, NULL)) return FALSE;
+
+    native->ver_major = native->ver_minor = 0;
+    native->profile = GTK_GL_COMPATIBILITY_PROFILE;
+    native->flags = GTK_GL_CONTEXT_FLAGS_NONE;
+    native->adoptable = TRUE;
+    return TRUE;
+}
+
+
+// Drops the flags that the display or the version cannot honor
+static GtkGLContextFlags
+get_supported_context_flags(GtkGLDisplayCaps caps, guint ver_major,
+        GtkGLProfile profile, GtkGLContextFlags flags) {
+    if (!(caps & GTK_GL_DISPLAY_CREATE_CONTEXT)) {
+        return GTK_GL_CONTEXT_FLAGS_NONE;
+    }
+    // Forward compatibility is a desktop OpenGL 3.0+ notion
+    if (ver_major < 3 || profile == GTK_GL_ES_PROFILE) {
+        flags &= ~GTK_GL_CONTEXT_FORWARD_COMPATIBLE;
+    }
+    // A no-error debug context is an error (EGL_KHR_create_context_no_error)
+    if (!(caps & GTK_GL_DISPLAY_CREATE_CONTEXT_NO_ERROR)
+            || (flags & GTK_GL_CONTEXT_DEBUG)) {
+        flags &= ~GTK_GL_CONTEXT_NO_ERROR;
+    }
+    if (!(caps & GTK_GL_DISPLAY_CONTEXT_FLUSH_CONTROL)) {
+        flags &= ~GTK_GL_CONTEXT_NO_FLUSH_ON_RELEASE;
+    }
+    return flags;
+}
+
+
+// Parses GL_VERSION, which is prefixed with "OpenGL ES " for ES contexts
+static gboolean
+parse_context_version(guint *major, guint *minor) {
+    const char *version = (const char*) glGetString(GL_VERSION);
+
+    if (!version) return FALSE;
+    while (*version && !g_ascii_isdigit(*version)) ++version;
+    return sscanf(version, "%u.%u", major, minor) == 2;
+}
+
+
+static gboolean
+create_versioned_context(GtkGLCanvas *canvas, const GtkGLVisual *visual,
+        guint ver_major, guint ver_minor, GtkGLProfile profile,
+        GtkGLContextFlags flags) {
+    GtkGLCanvas_Priv *priv = GTK_GL_CANVAS_GET_PRIV(canvas);
+    GtkGLCanvas_NativePriv *native = priv->native;
+    GtkGLDisplayCaps caps = get_display_caps(canvas);
+    EGLenum api = profile == GTK_GL_ES_PROFILE
+            ? EGL_OPENGL_ES_API : EGL_OPENGL_API;
+    guint cxt_major, cxt_minor;
+
+    flags = get_supported_context_flags(caps, ver_major, profile, flags);
+    if (adopt_group_context(canvas, visual, ver_major, ver_minor, profile,
+                flags)
+            || acquire_from_context_pool(canvas, visual, ver_major, ver_minor,
+                profile, flags)) {
+        return TRUE;
+    }
+
+    if (profile == GTK_GL_ES_PROFILE
+            && !(caps & GTK_GL_DISPLAY_CREATE_CONTEXT_ES_PROFILE)) {
+        return FALSE;
+    }
+
+    if (caps & GTK_GL_DISPLAY_CREATE_CONTEXT) {
+        EGLint attribs[] = {
+                EGL_CONTEXT_MAJOR_VERSION_KHR, ver_major,
+                EGL_CONTEXT_MINOR_VERSION_KHR, ver_minor,
+                EGL_NONE, EGL_NONE, EGL_NONE, EGL_NONE, EGL_NONE, EGL_NONE,
+                EGL_NONE, EGL_NONE, EGL_NONE
+        };
+        size_t n = 4;
+
+        // Profiles only exist for desktop OpenGL 3.2+, ES is selected by
+        // the bound API instead
+        if (profile != GTK_GL_ES_PROFILE
+                && (ver_major > 3 || (ver_major == 3 && ver_minor >= 2))) {
+            attribs[n++] = EGL_CONTEXT_OPENGL_PROFILE_MASK_KHR;
+            attribs[n++] = profile == GTK_GL_CORE_PROFILE
+                    ? EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT_KHR
+                    : EGL_CONTEXT_OPENGL_COMPATIBILITY_PROFILE_BIT_KHR;
+        }
+        if (flags & (GTK_GL_CONTEXT_DEBUG | GTK_GL_CONTEXT_FORWARD_COMPATIBLE)) {
+            attribs[n++] = EGL_CONTEXT_FLAGS_KHR;
+            attribs[n++] = (flags & GTK_GL_CONTEXT_DEBUG
+                        ? EGL_CONTEXT_OPENGL_DEBUG_BIT_KHR : 0)
+                    | (flags & GTK_GL_CONTEXT_FORWARD_COMPATIBLE
+                        ? EGL_CONTEXT_OPENGL_FORWARD_COMPATIBLE_BIT_KHR : 0);
+        }
+        if (flags & GTK_GL_CONTEXT_NO_ERROR) {
+            attribs[n++] = EGL_CONTEXT_OPENGL_NO_ERROR_KHR;
+            attribs[n++] = EGL_TRUE;
+        }
+        if (flags & GTK_GL_CONTEXT_NO_FLUSH_ON_RELEASE) {
+            attribs[n++] = EGL_CONTEXT_RELEASE_BEHAVIOR_KHR;
+            attribs[n++] = EGL_CONTEXT_RELEASE_BEHAVIOR_NONE_KHR;
+        }
+        if (!create_context(canvas, visual, api, attribs)) return FALSE;
+    } else if (profile == GTK_GL_ES_PROFILE && ver_minor == 0) {
+        const EGLint attribs[] = {
+                EGL_CONTEXT_CLIENT_VERSION, ver_major,
+                EGL_NONE
+        };
+        if (!create_context(canvas, visual, api, attribs)) return FALSE;
+    } else if (ver_major < 3 || (ver_major == 3 && ver_minor == 0)) {
+        // Without EGL_KHR_create_context, desktop contexts are legacy ones
+        if (!create_default_context(canvas, visual)) {
+            return FALSE;
+        }
+    } else {
+        return FALSE;
+    }
+
+    // Verify the correct context version, see glx.c
+    if (parse_context_version(&cxt_major, &cxt_minor)) {
+        if (cxt_major < ver_major
+                || (cxt_major == ver_major && cxt_minor < ver_minor)) {
+            gtk_gl_canvas_native_destroy_context(canvas);
+            return FALSE;
+        }
+        if (cxt_major == 3 && cxt_minor == 1
+                && profile == GTK_GL_COMPATIBILITY_PROFILE
+                && !epoxy_has_gl_extension("GL_ARB_compatibility")) {
+            gtk_gl_canvas_native_destroy_context(canvas);
+            return FALSE;
+        }
+        native->ver_major = ver_major;
+        native->ver_minor = ver_minor;
+        native->profile = profile;
+        native->flags = flags;
+        native->adoptable = TRUE;
+        return TRUE;
+    }
+
+    gtk_gl_canvas_native_destroy_context(canvas);
+    return FALSE;
+}
+
+
+/* A failed creation must neither leave a capture (and with it the display
+ * lock) open nor X objects behind, as gtk_gl_canvas_create_best_context()
+ * goes on to try lower versions on the same canvas.
+ */
+static gboolean
+check_creation(GtkGLCanvas *canvas, gboolean success) {
+	GtkGLCanvas_NativePriv *native = GTK_GL_CANVAS_GET_PRIV(canvas)->native;
+    if (!success) {
+        assert(!native->dpy || !gtk_gl_is_capturing_xerrors(native->dpy));
+        assert(native->context == EGL_NO_CONTEXT
+                && native->surface == EGL_NO_SURFACE && !native->xwin
+                && !native->colormap && !native->toplevel);
+    }
+    return success;
+}
+
+
+gboolean
+gtk_gl_canvas_native_create_context(GtkGLCanvas *canvas,
+        const GtkGLVisual *visual) {
+    return check_creation(canvas, create_default_context(canvas, visual));
+}
+
+
+gboolean
+gtk_gl_canvas_native_create_context_with_version(GtkGLCanvas *canvas,
+        const GtkGLVisual *visual, guint ver_major, guint ver_minor,
+        GtkGLProfile profile, GtkGLContextFlags flags) {
+    return check_creation(canvas, create_versioned_context(canvas, visual,
+                ver_major, ver_minor, profile, flags));
+}
+
+
+void
+gtk_gl_canvas_native_destroy_context(GtkGLCanvas *canvas) {
+	GtkGLCanvas_Priv *priv = GTK_GL_CANVAS_GET_PRIV(canvas);
+	GtkGLCanvas_NativePriv *native = priv->native;
+    GtkGLToplevel *toplevel = native->toplevel;
+    gboolean drawable_in_use = FALSE;
+
+    // An aborted asynchronous creation may not have gotten this far
+    if (!native->initialized) return;
+
+    gtk_gl_begin_capture_xerrors(native->dpy);
+
+    if (toplevel) {
+        drawable_in_use = gtk_gl_toplevel_remove_member(toplevel, canvas);
+        native->toplevel = NULL;
+    }
+
+    if (drawable_in_use) {
+        // Other members in the toplevel keep presenting through the surface
+        native->context = EGL_NO_CONTEXT;
+        native->surface = EGL_NO_SURFACE;
+        native->xwin = 0;
+        native->colormap = 0;
+        native->adoptable = FALSE;
+    } else if (context_in_use_elsewhere(canvas)) {
+        // Other members keep rendering through the context, only drop the
+        // surface
+        destroy_context_objects(native, FALSE);
+    } else if (!release_to_context_pool(canvas)) {
+        destroy_context_objects(native, TRUE);
+    }
+
+    // Nothing to undo on errors, so do not wait for the server
+    gtk_gl_end_capture_xerrors_deferred(native->dpy,
+            "Received X window system error during context destruction");
+
+    // The drawable's X window is gone or pooled by now
+    if (toplevel && !drawable_in_use) gtk_gl_toplevel_free(toplevel);
+}
+
+
+gboolean
+gtk_gl_canvas_native_prepare_async(GtkGLCanvas *canvas) {
+    GtkGLCanvas_Priv *priv = GTK_GL_CANVAS_GET_PRIV(canvas);
+
+    // Single-context members present through GDK windows, see toplevel.h
+    if (priv->native->toplevel || (priv->share_group
+            && gtk_gl_share_group_get_single_context(priv->share_group))) {
+        return FALSE;
+    }
+
+    // Queries GDK, so it must happen on the main thread. See glx.c for the
+    // shared Display.
+    if (!gtk_gl_canvas_init_native(canvas)) return FALSE;
+    get_display_caps(canvas);
+    get_renderer_class(canvas);
+    return TRUE;
+}
+
+
+void
+gtk_gl_canvas_native_clear_current(GtkGLCanvas *canvas) {
+	GtkGLCanvas_NativePriv *native = GTK_GL_CANVAS_GET_PRIV(canvas)->native;
+    if (native->context != EGL_NO_CONTEXT) {
+        bind_api(native->api);
+        if (eglGetCurrentContext() == native->context) {
+            release_current(native->egl_dpy, native->api);
+        }
+    }
+}
+
+
+void
+gtk_gl_canvas_native_resize(GtkGLCanvas *canvas, gint width, gint height) {
+	GtkGLCanvas_NativePriv *native = GTK_GL_CANVAS_GET_PRIV(canvas)->native;
+    native->width = width;
+    native->height = height;
+    if (native->toplevel) {
+        // The framebuffer follows on the next make_current, see glx.c
+        gtk_gl_toplevel_queue_present(native->toplevel);
+    } else if (native->xwin) {
+        // The surface follows the size of its X window
+        XResizeWindow(native->dpy, native->xwin, MAX(width, 1),
+                MAX(height, 1));
+    }
+}
+
+
+void
+gtk_gl_canvas_native_make_current(GtkGLCanvas *canvas) {
+	GtkGLCanvas_NativePriv *native = GTK_GL_CANVAS_GET_PRIV(canvas)->native;
+    if (native->context != EGL_NO_CONTEXT
+            && make_current(native->egl_dpy, native->surface, native->context,
+                native->api)
+            && native->toplevel) {
+        gtk_gl_toplevel_bind(native->toplevel, canvas);
+    }
+}
+
+
+void
+gtk_gl_canvas_native_swap_buffers(GtkGLCanvas *canvas) {
+	GtkGLCanvas_NativePriv *native = GTK_GL_CANVAS_GET_PRIV(canvas)->native;
+    if (native->toplevel) {
+        gtk_gl_toplevel_display_frame(native->toplevel, canvas);
+    } else if (native->context != EGL_NO_CONTEXT) {
+        eglSwapBuffers(native->egl_dpy, native->surface);
+    }
+}
+
+
+guint
+gtk_gl_canvas_native_get_framebuffer(GtkGLCanvas *canvas) {
+	GtkGLCanvas_NativePriv *native = GTK_GL_CANVAS_GET_PRIV(canvas)->native;
+    return native->toplevel
+            ? gtk_gl_toplevel_get_framebuffer(native->toplevel, canvas) : 0;
+}
+
+
+GtkGLProc *
+gtk_gl_get_proc_address(const char *name) {
+    return (GtkGLProc*) eglGetProcAddress(name);
+}
+
+
+static gboolean
+egl_is_available(GdkDisplay *display) {
+    DisplayState *state;
+    gboolean available;
+
+    if (!GDK_IS_X11_DISPLAY(display) || !epoxy_has_egl()) return FALSE;
+
+    // Without EGL_KHR_create_context, EGL could only create legacy contexts
+
+    XLockDisplay(gdk_x11_display_get_xdisplay(display));
+    g_mutex_lock(&display_state_mutex);
+    state = get_display_state(display, gdk_x11_screen_get_screen_number(
+            gdk_display_get_default_screen(display)));
+    available = state->egl_dpy != EGL_NO_DISPLAY
+            && (state->caps & GTK_GL_DISPLAY_CREATE_CONTEXT);
+    g_mutex_unlock(&display_state_mutex);
+    XUnlockDisplay(gdk_x11_display_get_xdisplay(display));
+    return available;
+}
+
+
+DEFINE_BACKEND(egl_is_available);
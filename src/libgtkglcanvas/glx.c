@@ -46,7 +46,13 @@
  * SOFTWARE.
  **/
 
+#ifdef HAVE_EGL
+#define BACKEND_NAME glx
+#include "backend.h"
+#endif
+
 #include <stdlib.h>
+#include <string.h>
 #include <assert.h>
 
 #include <epoxy/gl.h>
@@ -60,54 +66,35 @@
 #include <gtkgl/canvas.h>
 #include <gtkgl/ext.h>
 #include "canvas_impl.h"
+#include "cache.h"
+#include "toplevel.h"
+#include "xerror.h"
 
 
-/* X Error handling routines:
- * X generates errors asynchronously, and a single error will usually terminate
- * the application. GLX functions may generate X Errors if a non-existing
- * context type was requested or a visual does not match the context - things
- * we cannot detect in advance.
- * To allow the gtk_gl_* functions to handle X Errors gracefully, they can be
- * "muted" via begin_capture_xerrors() / end_capture_xerrors().
- */
-typedef gint (*XErrorHandler)(Display *dpy, XErrorEvent *ev);
-static XErrorHandler old_xerror_handler;
-static XErrorEvent last_xerror;
-static gboolean have_xerror_flag;
-static GMutex xerror_mutex;
-
-
-static gint
-silent_xerror_handler(Display *dpy, XErrorEvent *ev) {
-    last_xerror = *ev;
-    have_xerror_flag = TRUE;
-    return 0;
-}
-
-
-static void
-begin_capture_xerrors(void) {
-    g_mutex_lock(&xerror_mutex);
-    have_xerror_flag = FALSE;
-    old_xerror_handler = XSetErrorHandler(silent_xerror_handler);
-}
+// Tokens of extensions newer than some epoxy releases
+#ifndef GLX_CONTEXT_OPENGL_NO_ERROR_ARB
+#define GLX_CONTEXT_OPENGL_NO_ERROR_ARB 0x31B3
+#endif
+#ifndef GLX_CONTEXT_RELEASE_BEHAVIOR_ARB
+#define GLX_CONTEXT_RELEASE_BEHAVIOR_ARB 0x2097
+#define GLX_CONTEXT_RELEASE_BEHAVIOR_NONE_ARB 0
+#endif
 
 
-static gboolean
-have_xerror(Display *dpy) {
-    XSync(dpy, False);
-    return have_xerror_flag;
-}
+// GLX attributes for querying multisampling, depending on the GLX version
+typedef struct _MultisampleAttribs {
+    gint sample_buffers;  // Zero if multisampling is unsupported
+    gint samples;
+} MultisampleAttribs;
 
 
-// Ends muting of X Errors, returning whether there was an error
-static gboolean
-end_capture_xerrors(Display *dpy) {
-    gboolean had_xerror = have_xerror(dpy);
-    XSetErrorHandler(old_xerror_handler);
-    g_mutex_unlock(&xerror_mutex);
-    return had_xerror;
-}
+// How the display's GL implementation renders, see probe_renderer()
+typedef enum _RendererClass {
+    RENDERER_UNKNOWN,  // Not probed yet or probing failed
+    RENDERER_ACCELERATED,
+    RENDERER_SOFTWARE,  // Direct, but rasterizing on the CPU
+    RENDERER_INDIRECT,  // GLX protocol through the X server
+} RendererClass;
 
 
 // Describes a X visual for create_context / describe_visual.
@@ -115,14 +102,22 @@ struct _GtkGLVisual {
     Display *dpy;
     int screen;
     GLXFBConfig cfg;
+    MultisampleAttribs ms;
+    GtkGLDisplayCaps caps;
+    RendererClass renderer;
+    // Bit (1 << attr) is set once the attribute has been queried into
+    // "config", see describe_fbconfig_attribute()
+    volatile gint described;
+    GtkGLFramebufferConfig config;
 };
 
 
-static GtkGLVisual *
-gtk_gl_visual_new(Display *dpy, int screen, GLXFBConfig cfg) {
-    GtkGLVisual visual = { dpy, screen, cfg };
-    return g_memdup(&visual, sizeof visual);
-}
+#define ALL_ATTRIBUTES_DESCRIBED \
+    ((gint) (((1u << (GTK_GL_BUFFER_AGE + 1)) - 1) & ~(1u << GTK_GL_NONE)))
+
+
+// Serializes lazy description of visuals shared between canvases
+static GMutex describe_mutex;
 
 
 void
@@ -131,6 +126,230 @@ gtk_gl_visual_free(GtkGLVisual *visual) {
 }
 
 
+static MultisampleAttribs
+get_multisample_attribs(gint glx_version, GtkGLDisplayCaps caps) {
+    MultisampleAttribs attribs = { 0, 0 };
+
+    if (glx_version >= 14) {
+        attribs.sample_buffers = GLX_SAMPLE_BUFFERS;
+        attribs.samples = GLX_SAMPLES;
+    } else if (caps & GTK_GL_DISPLAY_MULTISAMPLE) {
+        attribs.sample_buffers = GLX_SAMPLE_BUFFERS_ARB;
+        attribs.samples = GLX_SAMPLES_ARB;
+    }
+    return attribs;
+}
+
+
+/* Takes the capability snapshot of a screen. This is the only place that
+ * scans the GLX version and extension strings; it runs once per screen, see
+ * get_display_caps().
+ */
+static GtkGLDisplayCaps
+query_display_caps(Display *dpy, gint screen, gint *glx_version) {
+    GtkGLDisplayCaps caps = 0;
+
+#define HAS_EXTENSION(name) epoxy_has_glx_extension(dpy, screen, name)
+
+    *glx_version = epoxy_glx_version(dpy, screen);
+    if (*glx_version >= 13) caps |= GTK_GL_DISPLAY_FBCONFIG;
+    if (*glx_version >= 14 || HAS_EXTENSION("GLX_ARB_multisample")) {
+        caps |= GTK_GL_DISPLAY_MULTISAMPLE;
+    }
+    if (HAS_EXTENSION("GLX_ARB_create_context")) {
+        caps |= GTK_GL_DISPLAY_CREATE_CONTEXT;
+    }
+    if (HAS_EXTENSION("GLX_ARB_create_context_profile")) {
+        caps |= GTK_GL_DISPLAY_CREATE_CONTEXT_PROFILE;
+    }
+    if (HAS_EXTENSION("GLX_EXT_create_context_es_profile")) {
+        caps |= GTK_GL_DISPLAY_CREATE_CONTEXT_ES_PROFILE;
+    }
+    if (HAS_EXTENSION("GLX_OML_swap_method")) {
+        caps |= GTK_GL_DISPLAY_SWAP_METHOD;
+    }
+    if (HAS_EXTENSION("GLX_ARB_framebuffer_sRGB")
+            || HAS_EXTENSION("GLX_EXT_framebuffer_sRGB")) {
+        caps |= GTK_GL_DISPLAY_FRAMEBUFFER_SRGB;
+    }
+    if (HAS_EXTENSION("GLX_EXT_buffer_age")) {
+        caps |= GTK_GL_DISPLAY_BUFFER_AGE;
+    }
+    if (HAS_EXTENSION("GLX_MESA_release_buffers")) {
+        caps |= GTK_GL_DISPLAY_RELEASE_BUFFERS;
+    }
+    if (HAS_EXTENSION("GLX_ARB_create_context_no_error")) {
+        caps |= GTK_GL_DISPLAY_CREATE_CONTEXT_NO_ERROR;
+    }
+    if (HAS_EXTENSION("GLX_ARB_context_flush_control")) {
+        caps |= GTK_GL_DISPLAY_CONTEXT_FLUSH_CONTROL;
+    }
+
+#undef HAS_EXTENSION
+
+    return caps;
+}
+
+
+/* Queries a single attribute of a visual's GLXFBConfig into visual->config.
+ * Visuals are described lazily, one attribute at a time, so that choosing
+ * visuals only costs queries for the attributes the requirements and the
+ * tie-break order actually read. Must be called with describe_mutex held.
+ */
+static void
+describe_fbconfig_attribute(GtkGLVisual *visual, GtkGLAttribute attr) {
+    GtkGLFramebufferConfig *out = &visual->config;
+    gint value;
+
+#define QUERY_ATTRIB(attr) \
+    (glXGetFBConfigAttrib(visual->dpy, visual->cfg, (attr), &value), value)
+#define QUERY(attr) QUERY_ATTRIB(GLX_##attr)
+
+    if (visual->described & (1 << attr)) return;
+
+    switch (attr) {
+        case GTK_GL_ACCELERATED:
+            // GLX has no per-config notion of acceleration, all configs of a
+            // screen are served by the same renderer
+            out->accelerated = visual->renderer != RENDERER_SOFTWARE
+                    && visual->renderer != RENDERER_INDIRECT;
+            break;
+
+        case GTK_GL_COLOR_TYPES:
+            QUERY(RENDER_TYPE);
+            out->color_types = (
+                    (value & GLX_RGBA_BIT ? GTK_GL_COLOR_RGBA : 0)
+                    | (value & GLX_COLOR_INDEX_BIT ? GTK_GL_COLOR_INDEXED : 0));
+            break;
+
+        case GTK_GL_COLOR_BPP: out->color_bpp = QUERY(BUFFER_SIZE); break;
+        case GTK_GL_FB_LEVEL: out->fb_level = QUERY(LEVEL); break;
+        case GTK_GL_DOUBLE_BUFFERED:
+            out->double_buffered = QUERY(DOUBLEBUFFER);
+            break;
+        case GTK_GL_STEREO_BUFFERED: out->stereo_buffered = QUERY(STEREO); break;
+        case GTK_GL_AUX_BUFFERS: out->aux_buffers = QUERY(AUX_BUFFERS); break;
+        case GTK_GL_RED_COLOR_BPP: out->red_color_bpp = QUERY(RED_SIZE); break;
+        case GTK_GL_GREEN_COLOR_BPP:
+            out->green_color_bpp = QUERY(GREEN_SIZE);
+            break;
+        case GTK_GL_BLUE_COLOR_BPP: out->blue_color_bpp = QUERY(BLUE_SIZE); break;
+        case GTK_GL_ALPHA_COLOR_BPP:
+            out->alpha_color_bpp = QUERY(ALPHA_SIZE);
+            break;
+        case GTK_GL_DEPTH_BPP: out->depth_bpp = QUERY(DEPTH_SIZE); break;
+        case GTK_GL_STENCIL_BPP: out->stencil_bpp = QUERY(STENCIL_SIZE); break;
+        case GTK_GL_RED_ACCUM_BPP:
+            out->red_accum_bpp = QUERY(ACCUM_RED_SIZE);
+            break;
+        case GTK_GL_GREEN_ACCUM_BPP:
+            out->green_accum_bpp = QUERY(ACCUM_GREEN_SIZE);
+            break;
+        case GTK_GL_BLUE_ACCUM_BPP:
+            out->blue_accum_bpp = QUERY(ACCUM_BLUE_SIZE);
+            break;
+        case GTK_GL_ALPHA_ACCUM_BPP:
+            out->alpha_accum_bpp = QUERY(ACCUM_ALPHA_SIZE);
+            break;
+
+        case GTK_GL_TRANSPARENT_TYPE:
+            QUERY(TRANSPARENT_TYPE);
+            out->transparent_type
+                    = value == GLX_NONE ? GTK_GL_TRANSPARENT_NONE
+                    : value == GLX_TRANSPARENT_RGB ? GTK_GL_TRANSPARENT_RGB
+                    : GTK_GL_TRANSPARENT_INDEX;
+            break;
+
+        case GTK_GL_TRANSPARENT_INDEX_VALUE:
+            out->transparent_index = QUERY(TRANSPARENT_INDEX_VALUE);
+            break;
+        case GTK_GL_TRANSPARENT_RED:
+            out->transparent_red = QUERY(TRANSPARENT_RED_VALUE);
+            break;
+        case GTK_GL_TRANSPARENT_GREEN:
+            out->transparent_green = QUERY(TRANSPARENT_GREEN_VALUE);
+            break;
+        case GTK_GL_TRANSPARENT_BLUE:
+            out->transparent_blue = QUERY(TRANSPARENT_BLUE_VALUE);
+            break;
+        case GTK_GL_TRANSPARENT_ALPHA:
+            out->transparent_alpha = QUERY(TRANSPARENT_ALPHA_VALUE);
+            break;
+
+        case GTK_GL_SAMPLE_BUFFERS:
+            out->sample_buffers = visual->ms.sample_buffers
+                    ? QUERY_ATTRIB(visual->ms.sample_buffers) : 0;
+            break;
+        case GTK_GL_SAMPLES_PER_PIXEL:
+            out->samples_per_pixel = visual->ms.sample_buffers
+                    ? QUERY_ATTRIB(visual->ms.samples) : 0;
+            break;
+
+        case GTK_GL_CAVEAT:
+            QUERY(CONFIG_CAVEAT);
+            out->caveat
+                    = value == GLX_SLOW_CONFIG ? GTK_GL_CAVEAT_SLOW
+                    : value == GLX_NON_CONFORMANT_CONFIG
+                            ? GTK_GL_CAVEAT_NONCONFORMANT
+                    : GTK_GL_CAVEAT_NONE;
+            if (out->caveat == GTK_GL_CAVEAT_NONE
+                    && (visual->renderer == RENDERER_SOFTWARE
+                        || visual->renderer == RENDERER_INDIRECT)) {
+                // Drivers rarely mark their software fallback as slow
+                out->caveat = GTK_GL_CAVEAT_SLOW;
+            }
+            break;
+
+        case GTK_GL_SWAP_METHOD:
+            value = visual->caps & GTK_GL_DISPLAY_SWAP_METHOD
+                    ? QUERY(SWAP_METHOD_OML) : GLX_SWAP_UNDEFINED_OML;
+            out->swap_method
+                    = value == GLX_SWAP_EXCHANGE_OML ? GTK_GL_SWAP_EXCHANGE
+                    : value == GLX_SWAP_COPY_OML ? GTK_GL_SWAP_COPY
+                    : GTK_GL_SWAP_UNDEFINED;
+            break;
+
+        case GTK_GL_SRGB_CAPABLE:
+            out->srgb_capable = (visual->caps & GTK_GL_DISPLAY_FRAMEBUFFER_SRGB)
+                    && QUERY(FRAMEBUFFER_SRGB_CAPABLE_ARB);
+            break;
+
+        case GTK_GL_FLOAT_COLOR:
+            out->float_color = (QUERY(RENDER_TYPE) & (GLX_RGBA_FLOAT_BIT_ARB
+                    | GLX_RGBA_UNSIGNED_FLOAT_BIT_EXT)) != 0;
+            break;
+
+        case GTK_GL_BUFFER_AGE:
+            // A property of the drawable, available for every config
+            out->buffer_age = !!(visual->caps & GTK_GL_DISPLAY_BUFFER_AGE);
+            break;
+
+        default:
+            return;
+    }
+    g_atomic_int_or((volatile guint*) &visual->described, 1u << attr);
+
+#undef QUERY
+#undef QUERY_ATTRIB
+}
+
+
+// Makes sure all attributes of a visual are in visual->config
+static const GtkGLFramebufferConfig *
+describe_fbconfig(GtkGLVisual *visual) {
+    GtkGLAttribute attr;
+
+    if (g_atomic_int_get(&visual->described) != ALL_ATTRIBUTES_DESCRIBED) {
+        g_mutex_lock(&describe_mutex);
+        for (attr = GTK_GL_NONE + 1; attr <= GTK_GL_BUFFER_AGE; ++attr) {
+            describe_fbconfig_attribute(visual, attr);
+        }
+        g_mutex_unlock(&describe_mutex);
+    }
+    return &visual->config;
+}
+
+
 struct _GtkGLCanvas_NativePriv {
     // Whether the struct has been initialized (in init_native())
     gboolean initialized;
@@ -139,17 +358,105 @@ struct _GtkGLCanvas_NativePriv {
     Display *dpy;
     gint screen;
 
-    // The GLX window (residing inside the GtkGLCanvas window)
+    // The child X window of the GtkGLCanvas window the context renders to,
+    // its colormap and the GLX window created on it. xwin and colormap are 0
+    // if the GLX window is created on the GtkGLCanvas window itself.
+    Window xwin;
+    Colormap colormap;
     GLXWindow win;
 
     // The context once created
     GLXContext glc;
 
+    // What the context was created with, keys the context pool
+    gint fbconfig_id;
+    guint ver_major, ver_minor;
+    GtkGLProfile profile;
+    GtkGLContextFlags flags;  // As applied, see get_supported_context_flags()
+
+    // Whether the context has been created successfully and may be pooled
+    gboolean poolable;
+
+    // Set in single-context mode if the context renders into a framebuffer
+    // object, and xwin, colormap, win and glc are shared with the other
+    // members in the toplevel, see toplevel.h
+    GtkGLToplevel *toplevel;
+
     // The XVisualInfo of the GtkGLCanvas window
     XVisualInfo visual_info;
+
+    // The GdkDisplay, the GtkGLCanvas X window and its size, captured on the
+    // main thread so that creating the context on a worker needs no GDK calls
+    GdkDisplay *gdk_display;
+    Window parent;
+    gint width, height;
+
+    // Copy of the screen's capability snapshot, see get_display_caps()
+    gboolean caps_valid;
+    GtkGLDisplayCaps caps;
+    gint glx_version;
 };
 
 
+/* Per-thread record of the last glXMakeCurrent() issued by the library, so
+ * that redundant calls (a server round trip with indirect rendering) can be
+ * skipped. Destroying or pooling a context bumps current_generation, which
+ * invalidates the records of all threads because the handles and XIDs may be
+ * reused afterwards. Changes made behind the library's back are caught by
+ * comparing against the client-side glXGetCurrent*() state.
+ */
+typedef struct _CurrentRecord {
+    Display *dpy;
+    GLXDrawable win;
+    GLXContext glc;
+    gint generation;
+} CurrentRecord;
+
+static GPrivate current_record = G_PRIVATE_INIT(g_free);
+static volatile gint current_generation;
+
+
+static void
+invalidate_current_records(void) {
+    g_atomic_int_inc(&current_generation);
+}
+
+
+static gboolean
+make_current(Display *dpy, GLXDrawable win, GLXContext glc) {
+    CurrentRecord *rec = g_private_get(&current_record);
+    gint generation = g_atomic_int_get(&current_generation);
+    gboolean success;
+
+    if (!rec) {
+        rec = g_malloc0(sizeof *rec);
+        g_private_set(&current_record, rec);
+    } else if (rec->generation == generation && rec->dpy == dpy
+            && rec->win == win && rec->glc == glc
+            && glXGetCurrentContext() == glc
+            && glXGetCurrentDrawable() == win
+            && glXGetCurrentDisplay() == dpy) {
+        gtk_gl_count_make_current(TRUE);
+        return TRUE;
+    }
+
+    success = glXMakeCurrent(dpy, win, glc);
+    gtk_gl_count_make_current(FALSE);
+    rec->dpy = success ? dpy : NULL;
+    rec->win = success ? win : None;
+    rec->glc = success ? glc : NULL;
+    rec->generation = generation;
+    return success;
+}
+
+
+static void
+release_current(Display *dpy) {
+    glXMakeCurrent(dpy, None, NULL);
+    invalidate_current_records();
+}
+
+
 GtkGLCanvas_NativePriv*
 gtk_gl_canvas_native_new() {
 	return g_malloc0(sizeof(GtkGLCanvas_NativePriv));
@@ -166,8 +473,12 @@ gtk_gl_canvas_init_native(GtkGLCanvas *canvas) {
 
     if (native->initialized) return TRUE;
 
-    native->dpy = gdk_x11_display_get_xdisplay(gdk_window_get_display(
-            priv->win));
+    native->gdk_display = gdk_window_get_display(priv->win);
+    native->parent = gdk_x11_window_get_xid(priv->win);
+    native->width = gdk_window_get_width(priv->win);
+    native->height = gdk_window_get_height(priv->win);
+
+    native->dpy = gdk_x11_display_get_xdisplay(native->gdk_display);
 	if (!native->dpy) {
         g_warning("Unable to get X11 display");
         return FALSE;
@@ -176,19 +487,18 @@ gtk_gl_canvas_init_native(GtkGLCanvas *canvas) {
     native->screen = gdk_x11_screen_get_screen_number(gdk_window_get_screen(
             priv->win));
 
-    begin_capture_xerrors();
+    gtk_gl_begin_capture_xerrors(native->dpy);
 
     // Get the XVIsualInfo of the GtkGLCanvas window in order to compare
     // the visual type later
-    XGetWindowAttributes(native->dpy, gdk_x11_window_get_xid(priv->win),
-            &xattrs);
+    XGetWindowAttributes(native->dpy, native->parent, &xattrs);
     template.visualid = XVisualIDFromVisual(xattrs.visual);
     vi = XGetVisualInfo(native->dpy, VisualIDMask, &template, &count);
     assert(count == 1);
     native->visual_info = *vi;
     XFree(vi);
 
-    if (end_capture_xerrors(native->dpy)) {
+    if (gtk_gl_end_capture_xerrors(native->dpy)) {
         g_warning("Received X window system error during native canvas"
             " initialization");
         return FALSE;
@@ -207,14 +517,22 @@ gtk_gl_canvas_native_realize(GtkGLCanvas *canvas) {
     native->initialized = FALSE;
     native->dpy = NULL;
     native->screen = 0;
+    native->xwin = 0;
+    native->colormap = 0;
     native->win = 0;
     native->glc = NULL;
+    native->poolable = FALSE;
+    native->toplevel = NULL;
+    native->caps_valid = FALSE;
+    native->gdk_display = NULL;
+    native->parent = 0;
 }
 
 
 void
 gtk_gl_canvas_native_unrealize(GtkGLCanvas *canvas) {
-
+    // The canvas window and its children are gone, their XIDs may be reused
+    invalidate_current_records();
 }
 
 
@@ -231,32 +549,436 @@ visual_type_matches(gint glx, gint x) {
     }
 }
 
-GtkGLVisualList *
-gtk_gl_canvas_enumerate_visuals(GtkGLCanvas *canvas) {
-	GtkGLCanvas_Priv *priv = GTK_GL_CANVAS_GET_PRIV(canvas);
+/* Released contexts are kept per screen (see gtk_gl_set_context_pool_size()),
+ * so that recreating a context with the same GLXFBConfig, version, profile and
+ * flags only costs re-parenting its window and a make-current instead of
+ * creating a new GLX window and driver context.
+ */
+typedef struct _PooledContext {
+    gint fbconfig_id;
+    guint ver_major, ver_minor;
+    GtkGLProfile profile;
+    GtkGLContextFlags flags;
+    GtkGLShareGroup *share_group;  // Holds a reference
+    gboolean double_buffered;
+    Window xwin;
+    Colormap colormap;
+    GLXWindow win;
+    GLXContext glc;
+} PooledContext;
+
+
+static void
+pooled_context_free(PooledContext *pooled) {
+    if (pooled->share_group) gtk_gl_share_group_unref(pooled->share_group);
+    g_free(pooled);
+}
+
+
+/* Enumerating and describing GLXFBConfigs is expensive, so the result is
+ * cached per X screen and parent visual class. The cache is dropped once the
+ * GdkDisplay is closed.
+ */
+typedef struct _DisplayState {
+    GdkDisplay *gdk_display;
+    Display *dpy;
+    gint screen;
+    RendererClass renderer;  // RENDERER_UNKNOWN until probed
+    gboolean caps_valid;
+    GtkGLDisplayCaps caps;  // See query_display_caps()
+    gint glx_version;
+    GSList *visual_pools;  // of VisualPool
+    GQueue context_pool;  // of PooledContext, most recently released first
+} DisplayState;
+
+
+typedef struct _VisualPool {
+    gint visual_class;  // X visual class of the parent window
+    GtkGLVisualList *visuals;  // Owns the visuals
+} VisualPool;
+
+
+static GSList *display_states;
+static GMutex display_state_mutex;
+
+
+static void
+display_state_free(DisplayState *state) {
+    GSList *it;
+    for (it = state->visual_pools; it; it = it->next) {
+        VisualPool *pool = it->data;
+        gtk_gl_visual_list_free(pool->visuals);
+        g_free(pool);
+    }
+    g_slist_free(state->visual_pools);
+
+    // The display is gone, and with it all server-side context resources
+    g_queue_foreach(&state->context_pool, (GFunc) pooled_context_free, NULL);
+    g_queue_clear(&state->context_pool);
+    g_free(state);
+}
+
+
+static void
+on_display_closed(GdkDisplay *gdk_display, gboolean is_error,
+        gpointer user) {
+    GSList *it;
+
+    gtk_gl_forget_xerror_traps(gdk_x11_display_get_xdisplay(gdk_display));
+
+    g_mutex_lock(&display_state_mutex);
+    it = display_states;
+    while (it) {
+        DisplayState *state = it->data;
+        it = it->next;
+        if (state->gdk_display == gdk_display) {
+            display_states = g_slist_remove(display_states, state);
+            display_state_free(state);
+        }
+    }
+    g_mutex_unlock(&display_state_mutex);
+}
+
+
+// Looks up the state of the canvas' screen, creating it if necessary. Must be
+// called with display_state_mutex held.
+static DisplayState *
+get_display_state(GtkGLCanvas *canvas) {
+    GtkGLCanvas_Priv *priv = GTK_GL_CANVAS_GET_PRIV(canvas);
     GtkGLCanvas_NativePriv *native = priv->native;
+    DisplayState *state;
+    GSList *it;
+
+    for (it = display_states; it; it = it->next) {
+        state = it->data;
+        if (state->dpy == native->dpy && state->screen == native->screen) {
+            return state;
+        }
+    }
+
+    state = g_malloc0(sizeof *state);
+    state->gdk_display = native->gdk_display;
+    state->dpy = native->dpy;
+    state->screen = native->screen;
+    display_states = g_slist_prepend(display_states, state);
+
+    // Only connect once per GdkDisplay, the handler drops all its screens
+    for (it = display_states->next; it; it = it->next) {
+        if (((DisplayState*) it->data)->gdk_display == state->gdk_display) {
+            return state;
+        }
+    }
+    g_signal_connect(state->gdk_display, "closed",
+            G_CALLBACK(on_display_closed), NULL);
+    return state;
+}
+
+
+/* Returns the capability snapshot of the canvas' screen, taking it on first
+ * use. The canvas keeps a copy so that lifecycle paths, which may run on a
+ * worker thread, do not need the display state. Must be called with the
+ * native part initialized and display_state_mutex not held.
+ */
+static GtkGLDisplayCaps
+get_display_caps(GtkGLCanvas *canvas) {
+    GtkGLCanvas_NativePriv *native = GTK_GL_CANVAS_GET_PRIV(canvas)->native;
+    DisplayState *state;
+
+    if (!native->caps_valid) {
+        // Queries the server, so lock the display first (see xerror.h)
+        XLockDisplay(native->dpy);
+        g_mutex_lock(&display_state_mutex);
+        state = get_display_state(canvas);
+        if (!state->caps_valid) {
+            state->caps = query_display_caps(state->dpy, state->screen,
+                    &state->glx_version);
+            state->caps_valid = TRUE;
+        }
+        native->caps = state->caps;
+        native->glx_version = state->glx_version;
+        native->caps_valid = TRUE;
+        g_mutex_unlock(&display_state_mutex);
+        XUnlockDisplay(native->dpy);
+    }
+    return native->caps;
+}
+
+
+GtkGLDisplayCaps
+gtk_gl_canvas_native_get_display_caps(GtkGLCanvas *canvas) {
+    if (!gtk_gl_canvas_init_native(canvas)) return 0;
+    return get_display_caps(canvas);
+}
 
+
+static VisualPool *
+find_visual_pool(DisplayState *state, gint visual_class) {
+    GSList *it;
+    for (it = state->visual_pools; it; it = it->next) {
+        VisualPool *pool = it->data;
+        if (pool->visual_class == visual_class) return pool;
+    }
+    return NULL;
+}
+
+
+/* GLX cannot tell whether a configuration is hardware-accelerated, and Mesa
+ * happily serves every config through llvmpipe when no driver is available.
+ * The only reliable way to find out is creating a context and asking it, so
+ * this is done once per screen on a throwaway pbuffer.
+ */
+static gboolean
+is_software_renderer(const gchar *renderer) {
+    static const gchar *const software_renderers[] = {
+        "llvmpipe", "softpipe", "swrast", "Software Rasterizer", "SWR",
+    };
+    size_t i;
+
+    for (i = 0; i < G_N_ELEMENTS(software_renderers); ++i) {
+        if (strstr(renderer, software_renderers[i])) return TRUE;
+    }
+    return FALSE;
+}
+
+
+static RendererClass
+probe_renderer(Display *dpy, gint screen) {
+    static const gint fbconfig_attribs[] = {
+        GLX_DRAWABLE_TYPE, GLX_PBUFFER_BIT,
+        GLX_RENDER_TYPE, GLX_RGBA_BIT,
+        None
+    };
+    static const gint pbuffer_attribs[] = {
+        GLX_PBUFFER_WIDTH, 1,
+        GLX_PBUFFER_HEIGHT, 1,
+        None
+    };
+    RendererClass renderer = RENDERER_UNKNOWN;
+    Display *old_dpy = glXGetCurrentDisplay();
+    GLXContext old_context = glXGetCurrentContext();
+    GLXDrawable old_draw = glXGetCurrentDrawable(),
+                old_read = glXGetCurrentReadDrawable();
+    GLXFBConfig *fbconfigs;
+    GLXContext context = NULL;
+    GLXPbuffer pbuffer = None;
     gint fbconfig_count;
+
+    gtk_gl_begin_capture_xerrors(dpy);
+
+    fbconfigs = glXChooseFBConfig(dpy, screen, fbconfig_attribs,
+            &fbconfig_count);
+    if (fbconfigs && fbconfig_count > 0) {
+        context = glXCreateNewContext(dpy, fbconfigs[0], GLX_RGBA_TYPE, NULL,
+                True);
+        pbuffer = glXCreatePbuffer(dpy, fbconfigs[0], pbuffer_attribs);
+    }
+
+    if (context && pbuffer && !gtk_gl_have_xerror(dpy)
+            && glXMakeContextCurrent(dpy, pbuffer, pbuffer, context)) {
+        const gchar *string = (const gchar*) glGetString(GL_RENDERER);
+
+        if (!glXIsDirect(dpy, context)) {
+            renderer = RENDERER_INDIRECT;
+        } else if (string && is_software_renderer(string)) {
+            renderer = RENDERER_SOFTWARE;
+        } else {
+            renderer = RENDERER_ACCELERATED;
+        }
+
+        if (old_context) {
+            glXMakeContextCurrent(old_dpy, old_draw, old_read, old_context);
+        } else {
+            glXMakeContextCurrent(dpy, None, None, NULL);
+        }
+    }
+
+    if (pbuffer) glXDestroyPbuffer(dpy, pbuffer);
+    if (context) glXDestroyContext(dpy, context);
+    if (fbconfigs) XFree(fbconfigs);
+
+    if (gtk_gl_end_capture_xerrors(dpy)) return RENDERER_UNKNOWN;
+    return renderer;
+}
+
+
+// Returns the renderer class of the canvas' screen, probing it on first use
+static RendererClass
+get_renderer_class(GtkGLCanvas *canvas) {
+    GtkGLCanvas_NativePriv *native = GTK_GL_CANVAS_GET_PRIV(canvas)->native;
+    RendererClass renderer;
+
+    g_mutex_lock(&display_state_mutex);
+    renderer = get_display_state(canvas)->renderer;
+    g_mutex_unlock(&display_state_mutex);
+    if (renderer != RENDERER_UNKNOWN) return renderer;
+
+    // Probe without holding the lock, creating a context may take a while
+    renderer = probe_renderer(native->dpy, native->screen);
+
+    g_mutex_lock(&display_state_mutex);
+    get_display_state(canvas)->renderer = renderer;
+    g_mutex_unlock(&display_state_mutex);
+    return renderer;
+}
+
+
+/* The persistent cache (cache.h) identifies configurations by their
+ * GLX_FBCONFIG_ID. Its key contains everything the list of usable
+ * configurations and their description depends on. Probing the renderer
+ * (probe_renderer()) is too expensive for a cache lookup, so the key includes
+ * the environment variables that make Mesa fall back to software or indirect
+ * rendering instead. The GLX strings of Mesa stay the same across driver
+ * upgrades and GPU changes, so the key also contains the number of
+ * GLXFBConfigs, and each cached record is checked against the live
+ * configuration before it is used (see record_matches()).
+ */
+#define NONNULL_STRING(s) ((s) ? (s) : "")
+
+static gchar *
+get_cache_key(GtkGLCanvas_NativePriv *native) {
     GLXFBConfig *fbconfigs;
+    gint fbconfig_count = 0;
+
+    fbconfigs = glXGetFBConfigs(native->dpy, native->screen, &fbconfig_count);
+    if (fbconfigs) XFree(fbconfigs);
+
+    return g_strdup_printf("glx|%s|%s|%s|%s|%s|%d|%d|%lu|%d|%s|%s|%s",
+            NONNULL_STRING(DisplayString(native->dpy)),
+            NONNULL_STRING(glXQueryServerString(native->dpy, native->screen,
+                    GLX_VENDOR)),
+            NONNULL_STRING(glXQueryServerString(native->dpy, native->screen,
+                    GLX_VERSION)),
+            NONNULL_STRING(glXGetClientString(native->dpy, GLX_VENDOR)),
+            NONNULL_STRING(glXGetClientString(native->dpy, GLX_VERSION)),
+            fbconfig_count, native->screen,
+            (unsigned long) native->visual_info.visualid,
+            native->visual_info.class,
+            NONNULL_STRING(g_getenv("LIBGL_ALWAYS_SOFTWARE")),
+            NONNULL_STRING(g_getenv("LIBGL_ALWAYS_INDIRECT")),
+            NONNULL_STRING(g_getenv("GALLIUM_DRIVER")));
+}
+
+#undef NONNULL_STRING
+
+
+static gint
+get_fbconfig_id(Display *dpy, GLXFBConfig cfg) {
+    gint id = 0;
+    glXGetFBConfigAttrib(dpy, cfg, GLX_FBCONFIG_ID, &id);
+    return id;
+}
+
+
+/* Re-queries a few attributes of a cached configuration, all answered from
+ * the client-side GLXFBConfig list, to catch a cache written by another
+ * driver. Must be called while capturing X errors.
+ */
+static gboolean
+record_matches(Display *dpy, GLXFBConfig cfg, const GtkGLCacheRecord *record) {
+    gint color = -1, depth = -1, stencil = -1;
+
+    glXGetFBConfigAttrib(dpy, cfg, GLX_BUFFER_SIZE, &color);
+    glXGetFBConfigAttrib(dpy, cfg, GLX_DEPTH_SIZE, &depth);
+    glXGetFBConfigAttrib(dpy, cfg, GLX_STENCIL_SIZE, &stencil);
+    return color == record->config.color_bpp
+            && depth == record->config.depth_bpp
+            && stencil == record->config.stencil_bpp;
+}
+
+
+// Must be called while capturing X errors
+static void
+store_fbconfigs(const gchar *key, const GtkGLVisualList *list) {
+    GtkGLCacheRecord *records;
+    size_t i;
+
+    if (!gtk_gl_cache_is_enabled()) return;
+
+    records = g_new(GtkGLCacheRecord, list->count);
+    for (i = 0; i < list->count; ++i) {
+        GtkGLVisual *visual = list->entries[i];
+        records[i].id = get_fbconfig_id(visual->dpy, visual->cfg);
+        records[i].config = *describe_fbconfig(list->entries[i]);
+    }
+    gtk_gl_cache_store_records(key, records, list->count);
+    g_free(records);
+}
+
+
+/* Rebuilds the visual list from the persistent cache, which only costs a few
+ * attribute queries per GLXFBConfig instead of a full description. Returns
+ * NULL if there is no cache file or a cached configuration no longer exists
+ * or has changed.
+ */
+static GtkGLVisualList *
+load_fbconfigs(GtkGLCanvas_NativePriv *native, const gchar *key) {
+    GtkGLCacheFile *file;
+    const GtkGLCacheRecord *records;
     GtkGLVisualList *list;
-    size_t i, j;
+    GHashTable *by_id;
+    GLXFBConfig *fbconfigs;
+    gint fbconfig_count;
+    gboolean complete = TRUE;
+    size_t i;
 
-    assert(canvas);
+    file = gtk_gl_cache_file_open(key);
+    if (!file) return NULL;
 
-    if (!gtk_gl_canvas_init_native(canvas) || epoxy_glx_version(native->dpy, native->screen) < 13) {
-        return gtk_gl_visual_list_new(TRUE, 0);
+    gtk_gl_begin_capture_xerrors(native->dpy);
+
+    fbconfigs = glXGetFBConfigs(native->dpy, native->screen, &fbconfig_count);
+    by_id = g_hash_table_new(NULL, NULL);
+    for (i = 0; i < (size_t) MAX(fbconfig_count, 0); ++i) {
+        g_hash_table_insert(by_id, GINT_TO_POINTER(get_fbconfig_id(
+                native->dpy, fbconfigs[i])), fbconfigs[i]);
+    }
+
+    list = gtk_gl_visual_list_new_inline(gtk_gl_cache_file_get_records(file,
+            &records), sizeof(GtkGLVisual));
+    for (i = 0; i < list->count && complete; ++i) {
+        GtkGLVisual *visual = list->entries[i];
+        visual->dpy = native->dpy;
+        visual->screen = native->screen;
+        visual->cfg = g_hash_table_lookup(by_id,
+                GINT_TO_POINTER(records[i].id));
+        visual->config = records[i].config;
+        visual->described = ALL_ATTRIBUTES_DESCRIBED;
+        complete = visual->cfg != NULL
+                && record_matches(native->dpy, visual->cfg, &records[i]);
     }
+    g_hash_table_destroy(by_id);
+    if (fbconfigs) XFree(fbconfigs);
+    gtk_gl_cache_file_close(file);
+
+    if (gtk_gl_end_capture_xerrors(native->dpy) || !complete) {
+        gtk_gl_visual_list_free(list);
+        return NULL;
+    }
+    return list;
+}
 
-    begin_capture_xerrors();
+
+// Enumerates and describes all GLXFBConfigs usable on the canvas window.
+// Returns NULL on X errors.
+static GtkGLVisualList *
+enumerate_fbconfigs(GtkGLCanvas_NativePriv *native, const gchar *key,
+        RendererClass renderer) {
+    gint fbconfig_count;
+    GLXFBConfig *fbconfigs;
+    GtkGLVisualList *list;
+    MultisampleAttribs ms;
+    size_t i, j;
+
+    gtk_gl_begin_capture_xerrors(native->dpy);
 
     /* Get a list of GLXFBConfigs, check for:
      *   - Ability to render to an X window
      *   - Correct visual type (must match the parent GtkGLCanvas window)
-     * and insert matching configs into the visual list
+     * and move matching configs to the front, so the visual list and all of
+     * its visuals can be allocated at once with the exact size
      */
     fbconfigs = glXGetFBConfigs(native->dpy, native->screen, &fbconfig_count);
-    list = gtk_gl_visual_list_new(TRUE, fbconfig_count);
-    for (i = 0, j = 0; i < list->count; ++i) {
+    for (i = 0, j = 0; i < (size_t) MAX(fbconfig_count, 0); ++i) {
         gint targets, vtype;
         glXGetFBConfigAttrib(native->dpy, fbconfigs[i], GLX_DRAWABLE_TYPE,
             &targets);
@@ -264,82 +986,468 @@ gtk_gl_canvas_enumerate_visuals(GtkGLCanvas *canvas) {
             &vtype);
         if ((targets & GLX_WINDOW_BIT)
                 && visual_type_matches(vtype, native->visual_info.class)) {
-            list->entries[j++] = gtk_gl_visual_new(native->dpy, native->screen, fbconfigs[i]);
+            fbconfigs[j++] = fbconfigs[i];
         }
     }
-    if (end_capture_xerrors(native->dpy)) {
+
+    list = gtk_gl_visual_list_new_inline(j, sizeof(GtkGLVisual));
+    ms = get_multisample_attribs(native->glx_version, native->caps);
+    for (i = 0; i < list->count; ++i) {
+        GtkGLVisual *visual = list->entries[i];
+        visual->dpy = native->dpy;
+        visual->screen = native->screen;
+        visual->cfg = fbconfigs[i];
+        visual->ms = ms;
+        visual->caps = native->caps;
+        visual->renderer = renderer;
+        visual->described = 0;
+    }
+    if (fbconfigs) XFree(fbconfigs);
+    store_fbconfigs(key, list);
+
+    if (gtk_gl_end_capture_xerrors(native->dpy)) {
         g_warning("Received X window system error during visual enumeration");
+        gtk_gl_visual_list_free(list);
+        return NULL;
+    }
+    return list;
+}
+
+
+GtkGLVisualList *
+gtk_gl_canvas_enumerate_visuals(GtkGLCanvas *canvas) {
+	GtkGLCanvas_Priv *priv = GTK_GL_CANVAS_GET_PRIV(canvas);
+    GtkGLCanvas_NativePriv *native = priv->native;
+    gint visual_class;
+    DisplayState *state;
+    VisualPool *pool;
+    GtkGLVisualList *visuals, *list;
+    gchar *key;
+
+    assert(canvas);
+
+    if (!gtk_gl_canvas_init_native(canvas)
+            || !(get_display_caps(canvas) & GTK_GL_DISPLAY_FBCONFIG)) {
         return gtk_gl_visual_list_new(TRUE, 0);
     }
+    visual_class = native->visual_info.class;
 
-    list->count = j;
+    g_mutex_lock(&display_state_mutex);
+    pool = find_visual_pool(get_display_state(canvas), visual_class);
+    if (pool) {
+        list = gtk_gl_visual_list_ref(pool->visuals);
+    }
+    g_mutex_unlock(&display_state_mutex);
+    if (pool) return list;
+
+    // Enumerate without holding the lock, X errors are captured globally
+    key = get_cache_key(native);
+    visuals = load_fbconfigs(native, key);
+    if (!visuals) {
+        visuals = enumerate_fbconfigs(native, key, get_renderer_class(canvas));
+    }
+    g_free(key);
+    if (!visuals) return gtk_gl_visual_list_new(TRUE, 0);
+
+    g_mutex_lock(&display_state_mutex);
+    state = get_display_state(canvas);
+    pool = find_visual_pool(state, visual_class);
+    if (pool) {
+        // Lost the race against another thread
+        gtk_gl_visual_list_free(visuals);
+    } else {
+        pool = g_malloc(sizeof *pool);
+        pool->visual_class = visual_class;
+        pool->visuals = visuals;
+        state->visual_pools = g_slist_prepend(state->visual_pools, pool);
+    }
+    list = gtk_gl_visual_list_ref(pool->visuals);
+    g_mutex_unlock(&display_state_mutex);
     return list;
 }
 
 
+GtkGLVisual *
+gtk_gl_canvas_native_lookup_decision(GtkGLCanvas *canvas,
+        const GtkGLRequirement *requirements, guint ver_major,
+        guint ver_minor, GtkGLProfile profile) {
+	GtkGLCanvas_Priv *priv = GTK_GL_CANVAS_GET_PRIV(canvas);
+    GtkGLCanvas_NativePriv *native = priv->native;
+    const GtkGLCacheDecision *decision;
+    const GtkGLCacheRecord *record = NULL;
+    GtkGLCacheFile *file;
+    GtkGLVisual *visual = NULL;
+    gchar *key;
+
+    if (!gtk_gl_cache_is_enabled() || !gtk_gl_canvas_init_native(canvas)
+            || !(get_display_caps(canvas) & GTK_GL_DISPLAY_FBCONFIG)) {
+        return NULL;
+    }
+
+    key = get_cache_key(native);
+    file = gtk_gl_cache_file_open(key);
+    g_free(key);
+    if (!file) return NULL;
+
+    decision = gtk_gl_cache_file_get_decision(file, requirements);
+    if (decision
+            && decision->ver_major == ver_major
+            && decision->ver_minor == ver_minor
+            && decision->profile == (gint32) profile) {
+        record = gtk_gl_cache_file_find_record(file, decision->id);
+    }
+
+    if (record) {
+        const gint attribs[] = { GLX_FBCONFIG_ID, record->id, None };
+        GLXFBConfig *fbconfigs;
+        gint count = 0;
+
+        gtk_gl_begin_capture_xerrors(native->dpy);
+        fbconfigs = glXChooseFBConfig(native->dpy, native->screen, attribs,
+                &count);
+        if (fbconfigs && count > 0
+                && record_matches(native->dpy, fbconfigs[0], record)) {
+            visual = g_malloc0(sizeof *visual);
+            visual->dpy = native->dpy;
+            visual->screen = native->screen;
+            visual->cfg = fbconfigs[0];
+            visual->config = record->config;
+            visual->described = ALL_ATTRIBUTES_DESCRIBED;
+        }
+        if (fbconfigs) XFree(fbconfigs);
+        if (gtk_gl_end_capture_xerrors(native->dpy)) {
+            g_free(visual);
+            visual = NULL;
+        }
+    }
+
+    gtk_gl_cache_file_close(file);
+    return visual;
+}
+
+
 void
-gtk_gl_describe_visual(const GtkGLVisual *visual, GtkGLFramebufferConfig *out) {
-    gint value;
+gtk_gl_canvas_native_store_decision(GtkGLCanvas *canvas,
+        const GtkGLRequirement *requirements, const GtkGLVisual *visual,
+        guint ver_major, guint ver_minor, GtkGLProfile profile) {
+	GtkGLCanvas_Priv *priv = GTK_GL_CANVAS_GET_PRIV(canvas);
+    GtkGLCanvas_NativePriv *native = priv->native;
+    GtkGLCacheDecision decision;
+    gchar *key;
 
+    if (!gtk_gl_cache_is_enabled()) return;
+
+    gtk_gl_begin_capture_xerrors(native->dpy);
+    decision.id = get_fbconfig_id(visual->dpy, visual->cfg);
+    if (gtk_gl_end_capture_xerrors(native->dpy)) return;
+
+    decision.ver_major = ver_major;
+    decision.ver_minor = ver_minor;
+    decision.profile = profile;
+
+    key = get_cache_key(native);
+    gtk_gl_cache_store_decision(key, &decision, requirements);
+    g_free(key);
+}
+
+
+void
+gtk_gl_describe_visual(const GtkGLVisual *visual, GtkGLFramebufferConfig *out) {
     assert(visual);
     assert(out);
-    assert(epoxy_glx_version(visual->dpy, visual->screen) >= 13);
-
-#define QUERY(attr) \
-    (glXGetFBConfigAttrib(visual->dpy, visual->cfg, GLX_##attr, &value), value)
-
-    out->accelerated = TRUE;
-
-    QUERY(RENDER_TYPE);
-    out->color_types = (
-            (value & GLX_RGBA_BIT ? GTK_GL_COLOR_RGBA : 0)
-            | (value & GLX_COLOR_INDEX_BIT ? GTK_GL_COLOR_INDEXED : 0));
-
-    out->color_bpp = QUERY(BUFFER_SIZE);
-    out->fb_level = QUERY(LEVEL);
-    out->double_buffered = QUERY(DOUBLEBUFFER);
-    out->stereo_buffered = QUERY(STEREO);
-    out->aux_buffers = QUERY(AUX_BUFFERS);
-    out->red_color_bpp = QUERY(RED_SIZE);
-    out->green_color_bpp = QUERY(GREEN_SIZE);
-    out->blue_color_bpp = QUERY(BLUE_SIZE);
-    out->alpha_color_bpp = QUERY(ALPHA_SIZE);
-    out->depth_bpp = QUERY(DEPTH_SIZE);
-    out->stencil_bpp = QUERY(STENCIL_SIZE);
-    out->red_accum_bpp = QUERY(ACCUM_RED_SIZE);
-    out->green_accum_bpp = QUERY(ACCUM_GREEN_SIZE);
-    out->blue_accum_bpp = QUERY(ACCUM_BLUE_SIZE);
-    out->alpha_accum_bpp = QUERY(ACCUM_ALPHA_SIZE);
-
-    QUERY(TRANSPARENT_TYPE);
-    out->transparent_type
-            = value == GLX_NONE ? GTK_GL_TRANSPARENT_NONE
-            : value == GLX_TRANSPARENT_RGB ? GTK_GL_TRANSPARENT_INDEX
-            : GTK_GL_TRANSPARENT_INDEX;
-
-    out->transparent_index = QUERY(TRANSPARENT_INDEX_VALUE);
-    out->transparent_red = QUERY(TRANSPARENT_RED_VALUE);
-    out->transparent_green = QUERY(TRANSPARENT_GREEN_VALUE);
-    out->transparent_blue = QUERY(TRANSPARENT_BLUE_VALUE);
-    out->transparent_alpha = QUERY(TRANSPARENT_ALPHA_VALUE);
-
-    if (epoxy_glx_version(visual->dpy, visual->screen) >= 14) {
-        out->sample_buffers = QUERY(SAMPLE_BUFFERS);
-        out->samples_per_pixel = QUERY(SAMPLES);
-    } else if (epoxy_has_glx_extension(visual->dpy, visual->screen, "GLX_ARB_multisample")) {
-        out->sample_buffers = QUERY(SAMPLE_BUFFERS_ARB);
-        out->samples_per_pixel = QUERY(SAMPLES_ARB);
-    } else {
-        out->sample_buffers = out->samples_per_pixel = 0;
+
+    *out = *describe_fbconfig((GtkGLVisual*) visual);
+}
+
+
+void
+gtk_gl_describe_visuals(const GtkGLVisualList *visuals,
+        GtkGLFramebufferConfig *out) {
+    size_t i;
+
+    assert(visuals);
+    assert(out || !visuals->count);
+
+    for (i = 0; i < visuals->count; ++i) {
+        out[i] = *describe_fbconfig(visuals->entries[i]);
     }
+}
 
-    QUERY(CONFIG_CAVEAT);
-    out->caveat
-            = value == GLX_SLOW_CONFIG ? GTK_GL_CAVEAT_SLOW
-            : value == GLX_NON_CONFORMANT_CONFIG ? GTK_GL_CAVEAT_NONCONFORMANT
-            : GTK_GL_CAVEAT_NONE;
 
-#undef QUERY
+void
+gtk_gl_describe_visuals_attribute(const GtkGLVisualList *visuals,
+        GtkGLAttribute attr, gint *out) {
+    size_t i;
+
+    assert(visuals);
+    assert(out || !visuals->count);
+
+    g_mutex_lock(&describe_mutex);
+    for (i = 0; i < visuals->count; ++i) {
+        describe_fbconfig_attribute(visuals->entries[i], attr);
+        out[i] = gtk_gl_framebuffer_config_get(&visuals->entries[i]->config,
+                attr);
+    }
+    g_mutex_unlock(&describe_mutex);
+}
+
+
+// Must be called while capturing X errors
+static void
+destroy_context_objects(Display *dpy, GtkGLDisplayCaps caps, GLXContext glc,
+        GLXWindow win, Window xwin, Colormap colormap) {
+    if (glc) {
+        // Context is not destroyed until it is no longer current
+        if (glXGetCurrentContext() == glc) glXMakeCurrent(dpy, None, NULL);
+        glXDestroyContext(dpy, glc);
+    }
+    invalidate_current_records();
+    if (win) {
+        // See the GLX_MESA_release_buffers docs
+        if (caps & GTK_GL_DISPLAY_RELEASE_BUFFERS) {
+            glXReleaseBuffersMESA(dpy, win);
+        }
+        glXDestroyWindow(dpy, win);
+    }
+    if (xwin) XDestroyWindow(dpy, xwin);
+    if (colormap) XFreeColormap(dpy, colormap);
+}
+
+
+static gboolean
+toplevel_make_current(GtkGLCanvas *member) {
+	GtkGLCanvas_NativePriv *native = GTK_GL_CANVAS_GET_PRIV(member)->native;
+    return make_current(native->dpy, native->win, native->glc);
+}
+
+
+static void
+toplevel_resize(GtkGLCanvas *member, gint width, gint height) {
+	GtkGLCanvas_NativePriv *native = GTK_GL_CANVAS_GET_PRIV(member)->native;
+    XResizeWindow(native->dpy, native->xwin, MAX(width, 1), MAX(height, 1));
+}
+
+
+static void
+toplevel_swap_buffers(GtkGLCanvas *member) {
+	GtkGLCanvas_NativePriv *native = GTK_GL_CANVAS_GET_PRIV(member)->native;
+    glXSwapBuffers(native->dpy, native->win);
+}
+
+
+static const GtkGLToplevelFuncs toplevel_funcs = {
+    toplevel_make_current,
+    toplevel_resize,
+    toplevel_swap_buffers
+};
+
+
+/* In single-context mode, moves the canvas' new X window into a child window
+ * of its toplevel, where it becomes the drawable of all members with equal
+ * fbconfig, version, profile and flags in that toplevel (see toplevel.h and
+ * adopt_group_context()). The canvas keeps its own X window if its context
+ * lacks framebuffer objects. Must be called with the context current.
+ */
+static void
+enter_toplevel(GtkGLCanvas *canvas, const GtkGLVisual *visual) {
+    GtkGLCanvas_Priv *priv = GTK_GL_CANVAS_GET_PRIV(canvas);
+    GtkGLCanvas_NativePriv *native = priv->native;
+    GtkGLFramebufferConfig config;
+    GtkGLToplevel *toplevel;
+    GdkWindow *window;
+
+    if (!native->xwin || !priv->context_group
+            || !gtk_gl_share_group_get_single_context(priv->context_group)) {
+        return;
+    }
+    gtk_gl_describe_visual(visual, &config);
+    if (!gtk_gl_toplevel_is_supported(&config)) return;
+    toplevel = gtk_gl_toplevel_new(canvas, &config, &toplevel_funcs);
+    if (!toplevel) return;
+
+    window = gtk_gl_toplevel_get_window(toplevel);
+    gtk_gl_begin_capture_xerrors(native->dpy);
+    XReparentWindow(native->dpy, native->xwin,
+            gdk_x11_window_get_xid(window), 0, 0);
+    XResizeWindow(native->dpy, native->xwin,
+            MAX(gdk_window_get_width(window), 1),
+            MAX(gdk_window_get_height(window), 1));
+    if (gtk_gl_end_capture_xerrors(native->dpy)) {
+        g_warning("Unable to move the drawable of a single-context canvas to"
+                " its toplevel");
+        XReparentWindow(native->dpy, native->xwin, native->parent, 0, 0);
+        gtk_gl_toplevel_free(toplevel);
+        return;
+    }
+
+    native->toplevel = toplevel;
+    gtk_gl_toplevel_add_member(toplevel, canvas);
+    gtk_gl_toplevel_bind(toplevel, canvas);
+}
+
+
+// Renders through the drawable and context of a member in the same toplevel
+static gboolean
+join_toplevel(GtkGLCanvas *canvas, GtkGLCanvas_NativePriv *owner) {
+    GtkGLCanvas_NativePriv *native = GTK_GL_CANVAS_GET_PRIV(canvas)->native;
+
+    if (!make_current(owner->dpy, owner->win, owner->glc)) {
+        g_warning("glXMakeCurrent() failed on a shared toplevel drawable");
+        return FALSE;
+    }
+    native->fbconfig_id = owner->fbconfig_id;
+    native->ver_major = owner->ver_major;
+    native->ver_minor = owner->ver_minor;
+    native->profile = owner->profile;
+    native->flags = owner->flags;
+    native->xwin = owner->xwin;
+    native->colormap = owner->colormap;
+    native->win = owner->win;
+    native->glc = owner->glc;
+    native->poolable = TRUE;
+    native->toplevel = owner->toplevel;
+    GTK_GL_CANVAS_GET_PRIV(canvas)->double_buffered = TRUE;
+    gtk_gl_toplevel_add_member(native->toplevel, canvas);
+    gtk_gl_toplevel_bind(native->toplevel, canvas);
+    return TRUE;
+}
+
+
+/* Moves the canvas' context into the pool instead of destroying it, evicting
+ * the least recently released contexts beyond the pool size. Returns FALSE if
+ * the context cannot be pooled. Must be called while capturing X errors.
+ */
+static gboolean
+release_to_context_pool(GtkGLCanvas *canvas) {
+    GtkGLCanvas_Priv *priv = GTK_GL_CANVAS_GET_PRIV(canvas);
+    GtkGLCanvas_NativePriv *native = priv->native;
+    guint pool_size = gtk_gl_context_pool_get_size();
+    GSList *evicted = NULL, *it;
+    PooledContext *pooled;
+    DisplayState *state;
+
+    // Only a drawable in a child window can move between canvases
+    if (!pool_size || !native->poolable || !native->xwin) return FALSE;
+
+    if (glXGetCurrentContext() == native->glc) {
+        glXMakeCurrent(native->dpy, None, NULL);
+    }
+    invalidate_current_records();
+    XUnmapWindow(native->dpy, native->xwin);
+    XReparentWindow(native->dpy, native->xwin,
+            RootWindow(native->dpy, native->screen), 0, 0);
+
+    pooled = g_malloc(sizeof *pooled);
+    pooled->fbconfig_id = native->fbconfig_id;
+    pooled->ver_major = native->ver_major;
+    pooled->ver_minor = native->ver_minor;
+    pooled->profile = native->profile;
+    pooled->flags = native->flags;
+    pooled->share_group = priv->context_group
+            ? gtk_gl_share_group_ref(priv->context_group) : NULL;
+    pooled->double_buffered = priv->double_buffered;
+    pooled->xwin = native->xwin;
+    pooled->colormap = native->colormap;
+    pooled->win = native->win;
+    pooled->glc = native->glc;
+
+    g_mutex_lock(&display_state_mutex);
+    state = get_display_state(canvas);
+    g_queue_push_head(&state->context_pool, pooled);
+    while (g_queue_get_length(&state->context_pool) > pool_size) {
+        evicted = g_slist_prepend(evicted,
+                g_queue_pop_tail(&state->context_pool));
+    }
+    g_mutex_unlock(&display_state_mutex);
+
+    for (it = evicted; it; it = it->next) {
+        pooled = it->data;
+        destroy_context_objects(native->dpy, native->caps, pooled->glc,
+                pooled->win, pooled->xwin, pooled->colormap);
+        pooled_context_free(pooled);
+    }
+    g_slist_free(evicted);
+    return TRUE;
+}
+
+
+// Takes a matching context from the pool and makes it current on the canvas
+static gboolean
+acquire_from_context_pool(GtkGLCanvas *canvas, const GtkGLVisual *visual,
+        guint ver_major, guint ver_minor, GtkGLProfile profile,
+        GtkGLContextFlags flags) {
+    GtkGLCanvas_Priv *priv = GTK_GL_CANVAS_GET_PRIV(canvas);
+    GtkGLCanvas_NativePriv *native = priv->native;
+    gint fbconfig_id = get_fbconfig_id(visual->dpy, visual->cfg);
+    PooledContext *pooled = NULL;
+    DisplayState *state;
+    GList *it;
+    gboolean current;
+
+    g_mutex_lock(&display_state_mutex);
+    state = get_display_state(canvas);
+    for (it = state->context_pool.head; it; it = it->next) {
+        PooledContext *candidate = it->data;
+        if (candidate->fbconfig_id == fbconfig_id
+                && candidate->ver_major == ver_major
+                && candidate->ver_minor == ver_minor
+                && candidate->profile == profile
+                && candidate->flags == flags
+                && candidate->share_group == priv->context_group) {
+            pooled = candidate;
+            g_queue_delete_link(&state->context_pool, it);
+            break;
+        }
+    }
+    g_mutex_unlock(&display_state_mutex);
+    if (!pooled) return FALSE;
+
+    native->fbconfig_id = pooled->fbconfig_id;
+    native->ver_major = pooled->ver_major;
+    native->ver_minor = pooled->ver_minor;
+    native->profile = pooled->profile;
+    native->flags = pooled->flags;
+    native->xwin = pooled->xwin;
+    native->colormap = pooled->colormap;
+    native->win = pooled->win;
+    native->glc = pooled->glc;
+    native->poolable = TRUE;
+    priv->double_buffered = pooled->double_buffered;
+    pooled_context_free(pooled);
+
+    gtk_gl_begin_capture_xerrors(native->dpy);
+    XReparentWindow(native->dpy, native->xwin, native->parent, 0, 0);
+    XResizeWindow(native->dpy, native->xwin, MAX(native->width, 1),
+            MAX(native->height, 1));
+    XMapWindow(native->dpy, native->xwin);
+    current = make_current(native->dpy, native->win, native->glc);
+    if (gtk_gl_end_capture_xerrors(native->dpy) || !current) {
+        g_warning("Unable to reuse pooled context");
+        native->poolable = FALSE;
+        gtk_gl_canvas_native_destroy_context(canvas);
+        return FALSE;
+    }
+    enter_toplevel(canvas, visual);
+    return TRUE;
+}
+
+
+// Returns the context to share objects with, see gtk_gl_canvas_set_share_group()
+static GLXContext
+get_share_context(GtkGLCanvas *canvas) {
+    GtkGLCanvas *peer = gtk_gl_canvas_get_share_peer(canvas);
+    GtkGLCanvas_NativePriv *native = GTK_GL_CANVAS_GET_PRIV(canvas)->native;
+    GtkGLCanvas_NativePriv *peer_native;
+
+    if (!peer) return NULL;
+    peer_native = GTK_GL_CANVAS_GET_PRIV(peer)->native;
+    if (peer_native->dpy != native->dpy
+            || peer_native->screen != native->screen) {
+        g_warning("Unable to share objects between contexts on different"
+                " screens");
+        return NULL;
+    }
+    return peer_native->glc;
 }
 
 
@@ -348,23 +1456,59 @@ gtk_gl_canvas_native_before_create_context(GtkGLCanvas *canvas,
         const GtkGLVisual *visual) {
     GtkGLCanvas_Priv *priv = GTK_GL_CANVAS_GET_PRIV(canvas);
     GtkGLCanvas_NativePriv *native = priv->native;
+    Window drawable = native->parent;
+    XSetWindowAttributes xattrs;
+    XVisualInfo *vi = NULL;
 
     assert(visual);
     assert(native->initialized);
-    assert(epoxy_glx_version(visual->dpy, visual->screen) >= 13);
+    assert(get_display_caps(canvas) & GTK_GL_DISPLAY_FBCONFIG);
 
-    begin_capture_xerrors();
+    /* The drawable lives in a child X window of the GtkGLCanvas window if it
+     * may outlive the canvas, so that it can be pooled together with the
+     * context or moved to the toplevel in single-context mode. Otherwise the
+     * GtkGLCanvas window itself is used.
+     */
+    if (gtk_gl_context_pool_get_size() || (priv->context_group
+                && gtk_gl_share_group_get_single_context(
+                    priv->context_group))) {
+        vi = glXGetVisualFromFBConfig(visual->dpy, visual->cfg);
+        if (!vi) {
+            g_warning("Unable to get X visual from GtkGLVisual");
+            return FALSE;
+        }
+    }
+
+    native->fbconfig_id = get_fbconfig_id(visual->dpy, visual->cfg);
+    native->poolable = FALSE;
+
+    gtk_gl_begin_capture_xerrors(native->dpy);
+
+    if (vi) {
+        native->colormap = XCreateColormap(native->dpy, native->parent,
+                vi->visual, AllocNone);
+        xattrs.colormap = native->colormap;
+        xattrs.border_pixel = 0;
+        xattrs.background_pixmap = None;
+        native->xwin = XCreateWindow(native->dpy, native->parent, 0, 0,
+                MAX(native->width, 1), MAX(native->height, 1), 0, vi->depth,
+                InputOutput, vi->visual,
+                CWColormap | CWBorderPixel | CWBackPixmap, &xattrs);
+        XFree(vi);
+        XMapWindow(native->dpy, native->xwin);
+        drawable = native->xwin;
+    }
 
     /* For each context creation a new GLX window must be constructed - once the
      * visual is pinned down, it cannot be changed. Just using the GtkGLCanvas
      * window would crash upon creating a second context with a different
-     * lisual
+     * visual
      */
-    native->win = glXCreateWindow(native->dpy, visual->cfg,
-            gdk_x11_window_get_xid(priv->win), NULL);
-    if (!native->win || have_xerror(native->dpy)) {
+    native->win = glXCreateWindow(native->dpy, visual->cfg, drawable, NULL);
+    if (!native->win || gtk_gl_have_xerror(native->dpy)) {
         g_warning("glXCreateWindow() failed");
-        end_capture_xerrors(native->dpy);
+        gtk_gl_end_capture_xerrors(native->dpy);
+        gtk_gl_canvas_native_destroy_context(canvas);
         return FALSE;
     }
     return TRUE;
@@ -379,7 +1523,13 @@ gtk_gl_canvas_native_after_create_context(GtkGLCanvas *canvas,
     gint attrib;
     gboolean failed = FALSE;
 
-    if (!native->glc) return FALSE;
+    // Close the capture opened by before_create_context() and drop the
+    // windows created there
+    if (!native->glc) {
+        gtk_gl_end_capture_xerrors(native->dpy);
+        gtk_gl_canvas_native_destroy_context(canvas);
+        return FALSE;
+    }
 
     // Required for deciding between glFlush() and swap_buffers() in
     // display_frame()
@@ -387,12 +1537,12 @@ gtk_gl_canvas_native_after_create_context(GtkGLCanvas *canvas,
             &attrib);
     priv->double_buffered = (guint) attrib;
 
-    if (!glXMakeCurrent(native->dpy, native->win, native->glc)) {
+    if (!make_current(native->dpy, native->win, native->glc)) {
         g_warning("glXMakeCurrent() failed after successful context creation");
         failed = TRUE;
     }
 
-    if (end_capture_xerrors(native->dpy)) {
+    if (gtk_gl_end_capture_xerrors(native->dpy)) {
         g_warning("Received X error during context creation");
         failed = TRUE;
     }
@@ -400,52 +1550,173 @@ gtk_gl_canvas_native_after_create_context(GtkGLCanvas *canvas,
     if (failed) {
         gtk_gl_canvas_native_destroy_context(canvas);
         native->glc = NULL;
-    };
+    } else {
+        enter_toplevel(canvas, visual);
+    }
     return !failed;
 }
 
 
-gboolean
-gtk_gl_canvas_native_create_context(GtkGLCanvas *canvas,
-        const GtkGLVisual *visual) {
+/* In single-context mode (see gtk_gl_share_group_set_single_context()),
+ * members with equal fbconfig, version, profile and flags render through one
+ * GLXContext. Members in the same toplevel also share one GLX window there
+ * and render into framebuffer objects (see enter_toplevel()); without
+ * framebuffer objects, each member has its own GLX window. The context is
+ * destroyed together with the drawable of the last member using it.
+ */
+static gboolean
+context_in_use_elsewhere(GtkGLCanvas *canvas) {
+    GtkGLCanvas_Priv *priv = GTK_GL_CANVAS_GET_PRIV(canvas);
+    GtkGLShareGroup *group = priv->context_group;
+    GList *members, *it;
+    gboolean in_use = FALSE;
+
+    if (!priv->native->glc || !group) return FALSE;
+
+    members = gtk_gl_share_group_list_canvases(group);
+    for (it = members; it && !in_use; it = it->next) {
+        in_use = it->data != canvas && GTK_GL_CANVAS_GET_PRIV(it->data)
+                ->native->glc == priv->native->glc;
+    }
+    g_list_free(members);
+    return in_use;
+}
+
+
+static gboolean
+adopt_group_context(GtkGLCanvas *canvas, const GtkGLVisual *visual,
+        guint ver_major, guint ver_minor, GtkGLProfile profile,
+        GtkGLContextFlags flags) {
     GtkGLCanvas_Priv *priv = GTK_GL_CANVAS_GET_PRIV(canvas);
     GtkGLCanvas_NativePriv *native = priv->native;
-    XVisualInfo *vi;
+    GtkGLCanvas_NativePriv *owner = NULL, *drawable_owner = NULL;
+    GList *members, *it;
+    gint fbconfig_id;
+
+    if (!priv->context_group
+            || !gtk_gl_share_group_get_single_context(priv->context_group)) {
+        return FALSE;
+    }
+
+    // Prefer a member whose drawable is in the same toplevel
+    fbconfig_id = get_fbconfig_id(visual->dpy, visual->cfg);
+    members = gtk_gl_share_group_list_canvases(priv->context_group);
+    for (it = members; it && !drawable_owner; it = it->next) {
+        GtkGLCanvas_NativePriv *peer = GTK_GL_CANVAS_GET_PRIV(it->data)->native;
+        if (it->data != canvas && peer->poolable && peer->dpy == native->dpy
+                && peer->screen == native->screen
+                && peer->fbconfig_id == fbconfig_id
+                && peer->ver_major == ver_major
+                && peer->ver_minor == ver_minor && peer->profile == profile
+                && peer->flags == flags) {
+            if (!owner) owner = peer;
+            if (peer->toplevel
+                    && gtk_gl_toplevel_contains(peer->toplevel, canvas)) {
+                drawable_owner = peer;
+            }
+        }
+    }
+    g_list_free(members);
+    if (drawable_owner) return join_toplevel(canvas, drawable_owner);
+    if (!owner) return FALSE;
 
     if (!gtk_gl_canvas_native_before_create_context(canvas, visual)) {
         return FALSE;
     }
+    native->glc = owner->glc;
+    if (!gtk_gl_canvas_native_after_create_context(canvas, visual)) {
+        return FALSE;
+    }
+    native->ver_major = ver_major;
+    native->ver_minor = ver_minor;
+    native->profile = profile;
+    native->flags = flags;
+    native->poolable = TRUE;
+    return TRUE;
+}
 
-    vi = glXGetVisualFromFBConfig(visual->dpy, visual->cfg);
-    if (!vi) {
-        g_error("Unable to get X visual form GtkGLVisual");
+
+static gboolean
+create_legacy_context(GtkGLCanvas *canvas, const GtkGLVisual *visual) {
+    GtkGLCanvas_Priv *priv = GTK_GL_CANVAS_GET_PRIV(canvas);
+    GtkGLCanvas_NativePriv *native = priv->native;
+    XVisualInfo *vi;
+
+    if (adopt_group_context(canvas, visual, 0, 0,
+                GTK_GL_COMPATIBILITY_PROFILE, GTK_GL_CONTEXT_FLAGS_NONE)
+            || acquire_from_context_pool(canvas, visual, 0, 0,
+                GTK_GL_COMPATIBILITY_PROFILE, GTK_GL_CONTEXT_FLAGS_NONE)) {
+        return TRUE;
+    }
+
+    if (!gtk_gl_canvas_native_before_create_context(canvas, visual)) {
         return FALSE;
     }
+
+    vi = glXGetVisualFromFBConfig(visual->dpy, visual->cfg);
     // Create legacy context
-    native->glc = glXCreateContext(native->dpy, vi, NULL, GL_TRUE);
+    native->glc = glXCreateContext(native->dpy, vi, get_share_context(canvas),
+            GL_TRUE);
     XFree(vi);
 
-    return gtk_gl_canvas_native_after_create_context(canvas, visual);
+    if (!gtk_gl_canvas_native_after_create_context(canvas, visual)) {
+        return FALSE;
+    }
+    native->ver_major = native->ver_minor = 0;
+    native->profile = GTK_GL_COMPATIBILITY_PROFILE;
+    native->flags = GTK_GL_CONTEXT_FLAGS_NONE;
+    native->poolable = TRUE;
+    return TRUE;
 }
 
 
-gboolean
-gtk_gl_canvas_native_create_context_with_version(GtkGLCanvas *canvas,
-        const GtkGLVisual *visual, guint ver_major, guint ver_minor,
-        GtkGLProfile profile) {
+// Drops the flags that the display or the version cannot honor
+static GtkGLContextFlags
+get_supported_context_flags(GtkGLDisplayCaps caps, guint ver_major,
+        GtkGLContextFlags flags) {
+    if (!(caps & GTK_GL_DISPLAY_CREATE_CONTEXT)) {
+        return GTK_GL_CONTEXT_FLAGS_NONE;
+    }
+    if (ver_major < 3) flags &= ~GTK_GL_CONTEXT_FORWARD_COMPATIBLE;
+    // A no-error debug context is an error (GLX_ARB_create_context_no_error)
+    if (!(caps & GTK_GL_DISPLAY_CREATE_CONTEXT_NO_ERROR)
+            || (flags & GTK_GL_CONTEXT_DEBUG)) {
+        flags &= ~GTK_GL_CONTEXT_NO_ERROR;
+    }
+    if (!(caps & GTK_GL_DISPLAY_CONTEXT_FLUSH_CONTROL)) {
+        flags &= ~GTK_GL_CONTEXT_NO_FLUSH_ON_RELEASE;
+    }
+    return flags;
+}
+
+
+static gboolean
+create_versioned_context(GtkGLCanvas *canvas, const GtkGLVisual *visual,
+        guint ver_major, guint ver_minor, GtkGLProfile profile,
+        GtkGLContextFlags flags) {
     GtkGLCanvas_Priv *priv = GTK_GL_CANVAS_GET_PRIV(canvas);
     GtkGLCanvas_NativePriv *native = priv->native;
+    GtkGLDisplayCaps caps = get_display_caps(canvas);
     const char *cxt_version;
     guint cxt_major, cxt_minor;
 
+    flags = get_supported_context_flags(caps, ver_major, flags);
+    if (adopt_group_context(canvas, visual, ver_major, ver_minor, profile,
+                flags)
+            || acquire_from_context_pool(canvas, visual, ver_major, ver_minor,
+                profile, flags)) {
+        return TRUE;
+    }
+
     if ((ver_major < 3 || (ver_major == 3 && ver_minor == 0))
             && (profile == GTK_GL_CORE_PROFILE
-                || profile == GTK_GL_COMPATIBILITY_PROFILE)) {
+                || profile == GTK_GL_COMPATIBILITY_PROFILE)
+            && !flags) {
         // Use legacy function for legacy contexts
-        if (!gtk_gl_canvas_native_create_context(canvas, visual)) {
+        if (!create_legacy_context(canvas, visual)) {
             return FALSE;
         }
-    } else if (epoxy_has_glx_extension(native->dpy, native->screen, "GLX_ARB_create_context")) {
+    } else if (caps & GTK_GL_DISPLAY_CREATE_CONTEXT) {
         /* (Core) contexts > 3.0 cannot be created via the legacy
          * glXCreateContext because the deprecation functionality requires
          * specification of the target version.
@@ -453,41 +1724,57 @@ gtk_gl_canvas_native_create_context_with_version(GtkGLCanvas *canvas,
         gint attrib_list[] = {
                 GLX_CONTEXT_MAJOR_VERSION_ARB, ver_major,
                 GLX_CONTEXT_MINOR_VERSION_ARB, ver_minor,
-                None, None, None
+                None, None, None, None, None, None, None, None, None
         };
+        size_t n = 4;
+
         /* OpenGL 3.1 does not know about compatibility profiles, so
          * compatibility is checked later via GLX_ARB_compatibility in that
          * case
          */
-        if (epoxy_has_glx_extension(native->dpy, native->screen, "GLX_ARB_create_context_profile")) {
-            attrib_list[4] = GLX_CONTEXT_PROFILE_MASK_ARB;
+        if (caps & GTK_GL_DISPLAY_CREATE_CONTEXT_PROFILE) {
+            attrib_list[n++] = GLX_CONTEXT_PROFILE_MASK_ARB;
             switch (profile) {
                 case GTK_GL_CORE_PROFILE:
-                    attrib_list[5] = GLX_CONTEXT_CORE_PROFILE_BIT_ARB;
+                    attrib_list[n++] = GLX_CONTEXT_CORE_PROFILE_BIT_ARB;
                     break;
 
                 case GTK_GL_COMPATIBILITY_PROFILE:
-                    attrib_list[5] = GLX_CONTEXT_COMPATIBILITY_PROFILE_BIT_ARB;
+                    attrib_list[n++] = GLX_CONTEXT_COMPATIBILITY_PROFILE_BIT_ARB;
                     break;
 
                 case GTK_GL_ES_PROFILE:
-                    if (!epoxy_has_glx_extension(native->dpy, native->screen,
-                            "GLX_EXT_create_context_es_profile")) {
+                    if (!(caps & GTK_GL_DISPLAY_CREATE_CONTEXT_ES_PROFILE)) {
                         return FALSE;
                     }
-                    attrib_list[5] = GLX_CONTEXT_ES_PROFILE_BIT_EXT;
+                    attrib_list[n++] = GLX_CONTEXT_ES_PROFILE_BIT_EXT;
                     break;
 
                 default:
                     return FALSE;
             }
         };
+        if (flags & (GTK_GL_CONTEXT_DEBUG | GTK_GL_CONTEXT_FORWARD_COMPATIBLE)) {
+            attrib_list[n++] = GLX_CONTEXT_FLAGS_ARB;
+            attrib_list[n++] = (flags & GTK_GL_CONTEXT_DEBUG
+                        ? GLX_CONTEXT_DEBUG_BIT_ARB : 0)
+                    | (flags & GTK_GL_CONTEXT_FORWARD_COMPATIBLE
+                        ? GLX_CONTEXT_FORWARD_COMPATIBLE_BIT_ARB : 0);
+        }
+        if (flags & GTK_GL_CONTEXT_NO_ERROR) {
+            attrib_list[n++] = GLX_CONTEXT_OPENGL_NO_ERROR_ARB;
+            attrib_list[n++] = True;
+        }
+        if (flags & GTK_GL_CONTEXT_NO_FLUSH_ON_RELEASE) {
+            attrib_list[n++] = GLX_CONTEXT_RELEASE_BEHAVIOR_ARB;
+            attrib_list[n++] = GLX_CONTEXT_RELEASE_BEHAVIOR_NONE_ARB;
+        }
 
         if (!gtk_gl_canvas_native_before_create_context(canvas, visual)) {
             return FALSE;
         }
-        native->glc = glXCreateContextAttribsARB(native->dpy, visual->cfg, NULL,
-                GL_TRUE, attrib_list);
+        native->glc = glXCreateContextAttribsARB(native->dpy, visual->cfg,
+                get_share_context(canvas), GL_TRUE, attrib_list);
         if (!gtk_gl_canvas_native_after_create_context(canvas, visual)) {
             return FALSE;
         }
@@ -504,13 +1791,20 @@ gtk_gl_canvas_native_create_context_with_version(GtkGLCanvas *canvas,
     if (sscanf(cxt_version, "%u.%u", &cxt_major, &cxt_minor) == 2) {
         if (cxt_major < ver_major
                 || (cxt_major == ver_major && cxt_minor < ver_minor)) {
+            gtk_gl_canvas_native_destroy_context(canvas);
             return FALSE;
         }
         if (cxt_major == 3 && cxt_minor == 1
                 && profile == GTK_GL_COMPATIBILITY_PROFILE
                 && !epoxy_has_gl_extension("ARB_compatibility")) {
+            gtk_gl_canvas_native_destroy_context(canvas);
             return FALSE;
         }
+        native->ver_major = ver_major;
+        native->ver_minor = ver_minor;
+        native->profile = profile;
+        native->flags = flags;
+        native->poolable = TRUE;
         return TRUE;
     }
 
@@ -519,30 +1813,124 @@ gtk_gl_canvas_native_create_context_with_version(GtkGLCanvas *canvas,
 }
 
 
+/* A failed creation must neither leave a capture (and with it the display
+ * lock) open nor X objects behind, as gtk_gl_canvas_create_best_context()
+ * goes on to try lower versions on the same canvas.
+ */
+static gboolean
+check_creation(GtkGLCanvas *canvas, gboolean success) {
+	GtkGLCanvas_NativePriv *native = GTK_GL_CANVAS_GET_PRIV(canvas)->native;
+    if (!success) {
+        assert(!native->dpy || !gtk_gl_is_capturing_xerrors(native->dpy));
+        assert(!native->glc && !native->win && !native->xwin
+                && !native->colormap && !native->toplevel);
+    }
+    return success;
+}
+
+
+gboolean
+gtk_gl_canvas_native_create_context(GtkGLCanvas *canvas,
+        const GtkGLVisual *visual) {
+    return check_creation(canvas, create_legacy_context(canvas, visual));
+}
+
+
+gboolean
+gtk_gl_canvas_native_create_context_with_version(GtkGLCanvas *canvas,
+        const GtkGLVisual *visual, guint ver_major, guint ver_minor,
+        GtkGLProfile profile, GtkGLContextFlags flags) {
+    return check_creation(canvas, create_versioned_context(canvas, visual,
+                ver_major, ver_minor, profile, flags));
+}
+
+
 void
 gtk_gl_canvas_native_destroy_context(GtkGLCanvas *canvas) {
 	GtkGLCanvas_Priv *priv = GTK_GL_CANVAS_GET_PRIV(canvas);
 	GtkGLCanvas_NativePriv *native = priv->native;
+    GtkGLToplevel *toplevel = native->toplevel;
+    gboolean drawable_in_use = FALSE;
 
-    begin_capture_xerrors();
+    // An aborted asynchronous creation may not have gotten this far
+    if (!native->initialized) return;
 
-    if (native->glc) {
-        // Context is not destroyed until it is no longer current
-        glXMakeCurrent(native->dpy, None, NULL);
-		glXDestroyContext(native->dpy, native->glc);
-		native->glc = NULL;
+    gtk_gl_begin_capture_xerrors(native->dpy);
+
+    if (toplevel) {
+        drawable_in_use = gtk_gl_toplevel_remove_member(toplevel, canvas);
+        native->toplevel = NULL;
     }
-    if (native->win) {
-        // See the GLX_MESA_release_buffers docs
-        if (epoxy_has_glx_extension(native->dpy, native->screen, "MESA_release_buffers")) {
-            glXReleaseBuffersMESA(native->dpy, native->win);
+
+    if (drawable_in_use) {
+        // Other members in the toplevel keep presenting through the drawable
+    } else if (context_in_use_elsewhere(canvas)) {
+        // Other members keep rendering through the context, only drop the
+        // window
+        if (glXGetCurrentDrawable() == native->win) {
+            release_current(native->dpy);
         }
-        glXDestroyWindow(native->dpy, native->win);
-        native->win = 0;
+        destroy_context_objects(native->dpy, native->caps, NULL,
+                native->win, native->xwin, native->colormap);
+    } else if (!release_to_context_pool(canvas)) {
+        destroy_context_objects(native->dpy, native->caps, native->glc,
+                native->win, native->xwin, native->colormap);
+    }
+    native->glc = NULL;
+    native->win = 0;
+    native->xwin = 0;
+    native->colormap = 0;
+    native->poolable = FALSE;
+
+    // Nothing to undo on errors, so do not wait for the server
+    gtk_gl_end_capture_xerrors_deferred(native->dpy,
+            "Received X window system error during context destruction");
+
+    // The drawable's X window is gone or pooled by now
+    if (toplevel && !drawable_in_use) gtk_gl_toplevel_free(toplevel);
+}
+
+
+gboolean
+gtk_gl_canvas_native_prepare_async(GtkGLCanvas *canvas) {
+    GtkGLCanvas_Priv *priv = GTK_GL_CANVAS_GET_PRIV(canvas);
+
+    // Single-context members present through GDK windows, see toplevel.h
+    if (priv->native->toplevel || (priv->share_group
+            && gtk_gl_share_group_get_single_context(priv->share_group))) {
+        return FALSE;
     }
 
-    if (end_capture_xerrors(native->dpy)) {
-        g_warning("Received X window system error during context destruction");
+    // Queries GDK, so it must happen on the main thread. The worker shares
+    // the canvas' Display with GTK, which the application has promised to be
+    // thread-safe, see gtk_gl_set_threaded_context_creation().
+    if (!gtk_gl_canvas_init_native(canvas)) return FALSE;
+    get_display_caps(canvas);
+    return TRUE;
+}
+
+
+void
+gtk_gl_canvas_native_clear_current(GtkGLCanvas *canvas) {
+	GtkGLCanvas_NativePriv *native = GTK_GL_CANVAS_GET_PRIV(canvas)->native;
+    if (native->glc && glXGetCurrentContext() == native->glc) {
+        release_current(native->dpy);
+    }
+}
+
+
+void
+gtk_gl_canvas_native_resize(GtkGLCanvas *canvas, gint width, gint height) {
+	GtkGLCanvas_NativePriv *native = GTK_GL_CANVAS_GET_PRIV(canvas)->native;
+    native->width = width;
+    native->height = height;
+    if (native->toplevel) {
+        // The framebuffer follows on the next make_current, but the member
+        // may have moved
+        gtk_gl_toplevel_queue_present(native->toplevel);
+    } else if (native->xwin) {
+        XResizeWindow(native->dpy, native->xwin, MAX(width, 1),
+                MAX(height, 1));
     }
 }
 
@@ -550,8 +1938,9 @@ gtk_gl_canvas_native_destroy_context(GtkGLCanvas *canvas) {
 void
 gtk_gl_canvas_native_make_current(GtkGLCanvas *canvas) {
 	GtkGLCanvas_NativePriv *native = GTK_GL_CANVAS_GET_PRIV(canvas)->native;
-    if (native->glc) {
-        glXMakeCurrent(native->dpy, native->win, native->glc);
+    if (native->glc && make_current(native->dpy, native->win, native->glc)
+            && native->toplevel) {
+        gtk_gl_toplevel_bind(native->toplevel, canvas);
     }
 }
 
@@ -559,14 +1948,48 @@ gtk_gl_canvas_native_make_current(GtkGLCanvas *canvas) {
 void
 gtk_gl_canvas_native_swap_buffers(GtkGLCanvas *canvas) {
 	GtkGLCanvas_NativePriv *native = GTK_GL_CANVAS_GET_PRIV(canvas)->native;
-    if (native->glc) {
+    if (native->toplevel) {
+        gtk_gl_toplevel_display_frame(native->toplevel, canvas);
+    } else if (native->glc) {
         glXSwapBuffers(native->dpy, native->win);
     }
 }
 
 
+guint
+gtk_gl_canvas_native_get_framebuffer(GtkGLCanvas *canvas) {
+	GtkGLCanvas_NativePriv *native = GTK_GL_CANVAS_GET_PRIV(canvas)->native;
+    return native->toplevel
+            ? gtk_gl_toplevel_get_framebuffer(native->toplevel, canvas) : 0;
+}
+
+
 GtkGLProc *
 gtk_gl_get_proc_address(const char *name) {
     return glXGetProcAddress((const GLubyte*) name);
 }
 
+
+#ifdef HAVE_EGL
+
+static gboolean
+glx_is_available(GdkDisplay *display) {
+    Display *dpy;
+    gint error_base, event_base;
+
+    if (!GDK_IS_X11_DISPLAY(display)) return FALSE;
+    dpy = gdk_x11_display_get_xdisplay(display);
+    return glXQueryExtension(dpy, &error_base, &event_base);
+}
+
+
+DEFINE_BACKEND(glx_is_available);
+
+#else
+
+const gchar *
+gtk_gl_get_backend_name(void) {
+    return "glx";
+}
+
+#endif
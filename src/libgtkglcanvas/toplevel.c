@@ -0,0 +1,378 @@
+/**
+ * Copyright (c) 2014-2015, Fabian Knorr
+ *
+ * This file is part of libgtkglcanvas.
+ *
+ * libgtkglcanvas is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libgtkglcanvas is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libgtkglcanvas. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <assert.h>
+
+#include <epoxy/gl.h>
+#include <gtk/gtk.h>
+
+#include "toplevel.h"
+
+
+typedef struct _Member {
+    GtkGLCanvas *canvas;
+    GLuint framebuffer, color, depth_stencil;
+    gint width, height;  // Of the renderbuffers, zero before the first bind
+    gboolean displayed;  // Whether a frame has been rendered since
+} Member;
+
+
+struct _GtkGLToplevel {
+    const GtkGLToplevelFuncs *funcs;
+    GtkGLFramebufferConfig config;  // Of the drawable, for the renderbuffers
+
+    GtkWidget *widget;  // The toplevel and its window
+    GdkWindow *parent;
+
+    // The child window holding the drawable, its size and current shape
+    GdkWindow *window;
+    gint width, height;
+    cairo_region_t *shape;
+
+    GList *members;  // Of Member
+    guint present_source;
+};
+
+
+gboolean
+gtk_gl_toplevel_is_supported(const GtkGLFramebufferConfig *config) {
+    // Presenting swaps, and blitting into a multisampled drawable is an error
+    if (!config->double_buffered || config->sample_buffers) return FALSE;
+    if (epoxy_is_desktop_gl()) {
+        return epoxy_gl_version() >= 30
+            || epoxy_has_gl_extension("GL_ARB_framebuffer_object");
+    }
+    return epoxy_gl_version() >= 30;
+}
+
+
+GtkGLToplevel *
+gtk_gl_toplevel_new(GtkGLCanvas *canvas, const GtkGLFramebufferConfig *config,
+        const GtkGLToplevelFuncs *funcs) {
+    GtkWidget *widget = gtk_widget_get_toplevel(GTK_WIDGET(canvas));
+    GtkGLToplevel *toplevel;
+    GdkWindowAttr attrs;
+
+    if (!gtk_widget_is_toplevel(widget) || !gtk_widget_get_realized(widget)) {
+        return NULL;
+    }
+
+    toplevel = g_malloc0(sizeof *toplevel);
+    toplevel->funcs = funcs;
+    toplevel->config = *config;
+    toplevel->widget = widget;
+    toplevel->parent = gtk_widget_get_window(widget);
+    toplevel->width = gdk_window_get_width(toplevel->parent);
+    toplevel->height = gdk_window_get_height(toplevel->parent);
+
+    attrs.window_type = GDK_WINDOW_CHILD;
+    attrs.wclass = GDK_INPUT_OUTPUT;
+    attrs.x = attrs.y = 0;
+    attrs.width = toplevel->width;
+    attrs.height = toplevel->height;
+    attrs.event_mask = 0;
+    toplevel->window = gdk_window_new(toplevel->parent, &attrs,
+            GDK_WA_X | GDK_WA_Y);
+    gdk_window_ensure_native(toplevel->window);
+
+    // Nothing is shown until members display frames, and input always goes
+    // to the canvas windows below
+    toplevel->shape = cairo_region_create();
+    gdk_window_shape_combine_region(toplevel->window, toplevel->shape, 0, 0);
+    gdk_window_input_shape_combine_region(toplevel->window, toplevel->shape,
+            0, 0);
+    gdk_window_show(toplevel->window);
+    return toplevel;
+}
+
+
+void
+gtk_gl_toplevel_free(GtkGLToplevel *toplevel) {
+    assert(!toplevel->members);
+    if (toplevel->present_source) g_source_remove(toplevel->present_source);
+    gdk_window_destroy(toplevel->window);
+    cairo_region_destroy(toplevel->shape);
+    g_free(toplevel);
+}
+
+
+GdkWindow *
+gtk_gl_toplevel_get_window(GtkGLToplevel *toplevel) {
+    return toplevel->window;
+}
+
+
+gboolean
+gtk_gl_toplevel_contains(GtkGLToplevel *toplevel, GtkGLCanvas *canvas) {
+    return gtk_widget_get_toplevel(GTK_WIDGET(canvas)) == toplevel->widget;
+}
+
+
+static Member *
+find_member(GtkGLToplevel *toplevel, GtkGLCanvas *canvas) {
+    GList *it;
+
+    for (it = toplevel->members; it; it = it->next) {
+        Member *member = it->data;
+        if (member->canvas == canvas) return member;
+    }
+    return NULL;
+}
+
+
+void
+gtk_gl_toplevel_add_member(GtkGLToplevel *toplevel, GtkGLCanvas *canvas) {
+    Member *member = g_malloc0(sizeof *member);
+
+    assert(!find_member(toplevel, canvas));
+    member->canvas = canvas;
+    toplevel->members = g_list_prepend(toplevel->members, member);
+
+    // Showing or hiding a member changes the shape
+    g_signal_connect_swapped(canvas, "map",
+            G_CALLBACK(gtk_gl_toplevel_queue_present), toplevel);
+    g_signal_connect_swapped(canvas, "unmap",
+            G_CALLBACK(gtk_gl_toplevel_queue_present), toplevel);
+
+    // Canvas windows that became native since must stay below
+    gdk_window_raise(toplevel->window);
+}
+
+
+gboolean
+gtk_gl_toplevel_remove_member(GtkGLToplevel *toplevel, GtkGLCanvas *canvas) {
+    Member *member = find_member(toplevel, canvas);
+
+    assert(member);
+    g_signal_handlers_disconnect_by_data(canvas, toplevel);
+
+    if (member->framebuffer && toplevel->funcs->make_current(canvas)) {
+        glDeleteFramebuffers(1, &member->framebuffer);
+        glDeleteRenderbuffers(1, &member->color);
+        if (member->depth_stencil) {
+            glDeleteRenderbuffers(1, &member->depth_stencil);
+        }
+    }
+    toplevel->members = g_list_remove(toplevel->members, member);
+    g_free(member);
+
+    if (toplevel->members) gtk_gl_toplevel_queue_present(toplevel);
+    return toplevel->members != NULL;
+}
+
+
+// Allocates renderbuffers matching the drawable's configuration, leaving the
+// framebuffer bound
+static void
+allocate_framebuffer(GtkGLToplevel *toplevel, Member *member, gint width,
+        gint height) {
+    const GtkGLFramebufferConfig *config = &toplevel->config;
+    GLenum depth_format = 0, depth_attachment = 0;
+    GLint renderbuffer = 0;
+
+    if (!member->framebuffer) {
+        glGenFramebuffers(1, &member->framebuffer);
+        glGenRenderbuffers(1, &member->color);
+    }
+    if (config->stencil_bpp) {
+        depth_format = GL_DEPTH24_STENCIL8;
+        depth_attachment = GL_DEPTH_STENCIL_ATTACHMENT;
+    } else if (config->depth_bpp) {
+        depth_format = config->depth_bpp > 16
+                ? GL_DEPTH_COMPONENT24 : GL_DEPTH_COMPONENT16;
+        depth_attachment = GL_DEPTH_ATTACHMENT;
+    }
+    if (depth_format && !member->depth_stencil) {
+        glGenRenderbuffers(1, &member->depth_stencil);
+    }
+
+    glGetIntegerv(GL_RENDERBUFFER_BINDING, &renderbuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, member->framebuffer);
+    glBindRenderbuffer(GL_RENDERBUFFER, member->color);
+    glRenderbufferStorage(GL_RENDERBUFFER,
+            config->alpha_color_bpp ? GL_RGBA8 : GL_RGB8, width, height);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+            GL_RENDERBUFFER, member->color);
+    if (depth_format) {
+        glBindRenderbuffer(GL_RENDERBUFFER, member->depth_stencil);
+        glRenderbufferStorage(GL_RENDERBUFFER, depth_format, width, height);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, depth_attachment,
+                GL_RENDERBUFFER, member->depth_stencil);
+    }
+    glBindRenderbuffer(GL_RENDERBUFFER, (GLuint) renderbuffer);
+
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        g_warning("Incomplete framebuffer for single-context canvas");
+    }
+    member->width = width;
+    member->height = height;
+}
+
+
+void
+gtk_gl_toplevel_bind(GtkGLToplevel *toplevel, GtkGLCanvas *canvas) {
+    Member *member = find_member(toplevel, canvas);
+    gint width = MAX(gtk_widget_get_allocated_width(GTK_WIDGET(canvas)), 1);
+    gint height = MAX(gtk_widget_get_allocated_height(GTK_WIDGET(canvas)), 1);
+
+    assert(member);
+    if (width != member->width || height != member->height) {
+        allocate_framebuffer(toplevel, member, width, height);
+    } else {
+        glBindFramebuffer(GL_FRAMEBUFFER, member->framebuffer);
+    }
+}
+
+
+guint
+gtk_gl_toplevel_get_framebuffer(GtkGLToplevel *toplevel,
+        GtkGLCanvas *canvas) {
+    Member *member = find_member(toplevel, canvas);
+    return member ? member->framebuffer : 0;
+}
+
+
+/* Where a member is visible in the toplevel window, and where its top-left
+ * corner lies, FALSE if it is not visible. The canvas window is clipped by
+ * its ancestor windows, e.g. the view of a scrolled window, as the X server
+ * clips a child window of the canvas. Siblings overlapping the canvas are
+ * not excluded.
+ */
+static gboolean
+get_member_rect(GtkGLToplevel *toplevel, Member *member, GdkRectangle *rect,
+        gint *origin_x, gint *origin_y) {
+    GtkWidget *widget = GTK_WIDGET(member->canvas);
+    GdkWindow *window = gtk_widget_get_window(widget);
+    GdkRectangle bounds;
+    gint x, y;
+
+    if (!member->displayed || !gtk_widget_is_drawable(widget)) return FALSE;
+
+    rect->x = rect->y = 0;
+    rect->width = MIN(gtk_widget_get_allocated_width(widget), member->width);
+    rect->height = MIN(gtk_widget_get_allocated_height(widget),
+            member->height);
+    *origin_x = *origin_y = 0;
+    while (window != toplevel->parent) {
+        if (!window) return FALSE;
+        gdk_window_get_position(window, &x, &y);
+        rect->x += x;
+        rect->y += y;
+        *origin_x += x;
+        *origin_y += y;
+
+        window = gdk_window_get_parent(window);
+        bounds.x = bounds.y = 0;
+        bounds.width = window ? gdk_window_get_width(window) : 0;
+        bounds.height = window ? gdk_window_get_height(window) : 0;
+        if (!gdk_rectangle_intersect(rect, &bounds, rect)) return FALSE;
+    }
+    return TRUE;
+}
+
+
+static gboolean
+present(gpointer data) {
+    GtkGLToplevel *toplevel = data;
+    GtkGLCanvas *any = ((Member*) toplevel->members->data)->canvas;
+    gint width = gdk_window_get_width(toplevel->parent);
+    gint height = gdk_window_get_height(toplevel->parent);
+    cairo_region_t *shape = cairo_region_create();
+    GdkRectangle rect;
+    gint x, y;
+    GLboolean scissor;
+    GList *it;
+
+    toplevel->present_source = 0;
+    if (!gtk_widget_get_mapped(toplevel->widget)) {
+        cairo_region_destroy(shape);
+        return G_SOURCE_REMOVE;
+    }
+
+    if (width != toplevel->width || height != toplevel->height) {
+        gdk_window_resize(toplevel->window, width, height);
+        toplevel->funcs->resize(any, width, height);
+        toplevel->width = width;
+        toplevel->height = height;
+    }
+
+    for (it = toplevel->members; it; it = it->next) {
+        if (get_member_rect(toplevel, it->data, &rect, &x, &y)) {
+            cairo_region_union_rectangle(shape, &rect);
+        }
+    }
+    if (!cairo_region_equal(shape, toplevel->shape)) {
+        gdk_window_shape_combine_region(toplevel->window, shape, 0, 0);
+        cairo_region_destroy(toplevel->shape);
+        toplevel->shape = shape;
+    } else {
+        cairo_region_destroy(shape);
+    }
+    if (cairo_region_is_empty(toplevel->shape)
+            || !toplevel->funcs->make_current(any)) {
+        return G_SOURCE_REMOVE;
+    }
+
+    // Blit the visible part of each framebuffer, with rows counted from the
+    // top of the canvas. GL has its origin bottom-left.
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+    scissor = glIsEnabled(GL_SCISSOR_TEST);
+    if (scissor) glDisable(GL_SCISSOR_TEST);
+    for (it = toplevel->members; it; it = it->next) {
+        Member *member = it->data;
+        gint left, top;  // Of the visible part within the canvas
+
+        if (!get_member_rect(toplevel, member, &rect, &x, &y)) continue;
+        left = rect.x - x;
+        top = rect.y - y;
+
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, member->framebuffer);
+        glBlitFramebuffer(left, member->height - top - rect.height,
+                left + rect.width, member->height - top,
+                rect.x, height - rect.y - rect.height,
+                rect.x + rect.width, height - rect.y, GL_COLOR_BUFFER_BIT,
+                GL_NEAREST);
+    }
+    if (scissor) glEnable(GL_SCISSOR_TEST);
+
+    toplevel->funcs->swap_buffers(any);
+    return G_SOURCE_REMOVE;
+}
+
+
+void
+gtk_gl_toplevel_display_frame(GtkGLToplevel *toplevel, GtkGLCanvas *canvas) {
+    Member *member = find_member(toplevel, canvas);
+
+    assert(member);
+    member->displayed = TRUE;
+    gtk_gl_toplevel_queue_present(toplevel);
+}
+
+
+void
+gtk_gl_toplevel_queue_present(GtkGLToplevel *toplevel) {
+    // Below the redraw priority, so that all frames displayed while GTK
+    // paints the toplevel go out with one swap
+    if (!toplevel->present_source) {
+        toplevel->present_source = g_idle_add_full(GDK_PRIORITY_REDRAW + 10,
+                present, toplevel, NULL);
+    }
+}
@@ -0,0 +1,90 @@
+/**
+ * Copyright (c) 2014-2015, Fabian Knorr
+ *
+ * This file is part of libgtkglcanvas.
+ *
+ * libgtkglcanvas is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libgtkglcanvas is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libgtkglcanvas. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include <gtk/gtk.h>
+#include <gtkgl/canvas.h>
+
+
+/* Single-drawable presentation for share groups in single-context mode, see
+ * gtk_gl_share_group_set_single_context(). All members of a group within one
+ * toplevel window render through one context into a framebuffer object
+ * each. A GtkGLToplevel owns a native child window of the toplevel, shaped
+ * to the members' allocations and transparent to input, in which the backend
+ * places one drawable of the toplevel's size. Displaying a frame on a member
+ * only queues a present, which blits the framebuffers of all mapped members
+ * into the drawable and swaps it once per main loop iteration.
+ *
+ * Everything here runs on the main thread, so backends create contexts for
+ * such groups synchronously.
+ */
+
+typedef struct _GtkGLToplevel GtkGLToplevel;
+
+
+typedef struct _GtkGLToplevelFuncs {
+    // Makes the shared drawable and context current, through any member
+    gboolean (*make_current)(GtkGLCanvas *member);
+    // Resizes the drawable to the toplevel window
+    void (*resize)(GtkGLCanvas *member, gint width, gint height);
+    void (*swap_buffers)(GtkGLCanvas *member);
+} GtkGLToplevelFuncs;
+
+
+// Whether the current context can present from framebuffer objects to a
+// drawable of the given configuration
+gboolean gtk_gl_toplevel_is_supported(const GtkGLFramebufferConfig *config);
+
+// Creates the child window for the canvas' toplevel, or returns NULL if the
+// canvas is not inside a realized toplevel
+GtkGLToplevel *gtk_gl_toplevel_new(GtkGLCanvas *canvas,
+        const GtkGLFramebufferConfig *config, const GtkGLToplevelFuncs *funcs);
+
+// Destroys the child window, once the backend has released its drawable and
+// the last member has been removed
+void gtk_gl_toplevel_free(GtkGLToplevel *toplevel);
+
+GdkWindow *gtk_gl_toplevel_get_window(GtkGLToplevel *toplevel);
+
+// Whether the canvas resides in the toplevel window
+gboolean gtk_gl_toplevel_contains(GtkGLToplevel *toplevel,
+        GtkGLCanvas *canvas);
+
+void gtk_gl_toplevel_add_member(GtkGLToplevel *toplevel, GtkGLCanvas *canvas);
+
+// Deletes the member's framebuffer with the shared context current and
+// returns whether other members remain
+gboolean gtk_gl_toplevel_remove_member(GtkGLToplevel *toplevel,
+        GtkGLCanvas *canvas);
+
+// Binds the member's framebuffer, (re)allocating it for the canvas'
+// allocation. The shared context must be current.
+void gtk_gl_toplevel_bind(GtkGLToplevel *toplevel, GtkGLCanvas *canvas);
+
+guint gtk_gl_toplevel_get_framebuffer(GtkGLToplevel *toplevel,
+        GtkGLCanvas *canvas);
+
+// Marks the member's framebuffer as holding a frame and queues a present
+void gtk_gl_toplevel_display_frame(GtkGLToplevel *toplevel,
+        GtkGLCanvas *canvas);
+
+// Queues a present, e.g. after the layout of the members changed
+void gtk_gl_toplevel_queue_present(GtkGLToplevel *toplevel);
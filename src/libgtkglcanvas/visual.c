@@ -18,189 +18,654 @@
  */
 
 #include <gtkgl/visual.h>
+#include "canvas_impl.h"
 #include <assert.h>
 #include <stdlib.h>
+#include <string.h>
+
+#if defined(__AVX2__)
+#   include <immintrin.h>
+#elif defined(__SSE2__)
+#   include <emmintrin.h>
+#endif
+
+
+/* The attribute values of a visual pool are stored in a structure-of-arrays
+ * table: One contiguous column of gints per GtkGLAttribute, indexed by the
+ * position of the visual in the pool. Filtering is done as one linear pass
+ * over each referenced column, and ranking only touches the columns named in
+ * the requirement list and the tie-break chain.
+ *
+ * Columns are padded with zeroes to a multiple of BLOCK_ROWS, so the filter
+ * kernels can process whole blocks without a scalar remainder loop.
+ *
+ * Columns are fetched from the backend only when first read by a filter or a
+ * comparison, so attributes no requirement and no tie-break step looks at are
+ * never queried.
+ */
+#define N_ATTRIBUTES (GTK_GL_BUFFER_AGE + 1)
+
+// Rows per selection bitmap byte and per filter kernel iteration
+#define BLOCK_ROWS 8
+
+
+typedef enum _AttributeKind {
+    ATTRIBUTE_RANGE,  // Compared numerically
+    ATTRIBUTE_BOOL,   // Compared as truth value
+    ATTRIBUTE_MASK    // Masked with the reference value, then truth value
+} AttributeKind;
+
+
+typedef struct _AttributeInfo {
+    glong offset;  // Offset of the field in GtkGLFramebufferConfig
+    AttributeKind kind;
+} AttributeInfo;
+
+
+static const AttributeInfo attribute_info[N_ATTRIBUTES] = {
+#define ATTRIBUTE(attr, field, kind) \
+    [GTK_GL_##attr] = { G_STRUCT_OFFSET(GtkGLFramebufferConfig, field), \
+            ATTRIBUTE_##kind }
+    ATTRIBUTE(ACCELERATED, accelerated, BOOL),
+    ATTRIBUTE(COLOR_TYPES, color_types, MASK),
+    ATTRIBUTE(COLOR_BPP, color_bpp, RANGE),
+    ATTRIBUTE(FB_LEVEL, fb_level, RANGE),
+    ATTRIBUTE(DOUBLE_BUFFERED, double_buffered, BOOL),
+    ATTRIBUTE(STEREO_BUFFERED, stereo_buffered, BOOL),
+    ATTRIBUTE(AUX_BUFFERS, aux_buffers, RANGE),
+    ATTRIBUTE(RED_COLOR_BPP, red_color_bpp, RANGE),
+    ATTRIBUTE(GREEN_COLOR_BPP, green_color_bpp, RANGE),
+    ATTRIBUTE(BLUE_COLOR_BPP, blue_color_bpp, RANGE),
+    ATTRIBUTE(ALPHA_COLOR_BPP, alpha_color_bpp, RANGE),
+    ATTRIBUTE(DEPTH_BPP, depth_bpp, RANGE),
+    ATTRIBUTE(STENCIL_BPP, stencil_bpp, RANGE),
+    ATTRIBUTE(RED_ACCUM_BPP, red_accum_bpp, RANGE),
+    ATTRIBUTE(GREEN_ACCUM_BPP, green_accum_bpp, RANGE),
+    ATTRIBUTE(BLUE_ACCUM_BPP, blue_accum_bpp, RANGE),
+    ATTRIBUTE(ALPHA_ACCUM_BPP, alpha_accum_bpp, RANGE),
+    ATTRIBUTE(TRANSPARENT_TYPE, transparent_type, RANGE),
+    ATTRIBUTE(TRANSPARENT_INDEX_VALUE, transparent_index, RANGE),
+    ATTRIBUTE(TRANSPARENT_RED, transparent_red, RANGE),
+    ATTRIBUTE(TRANSPARENT_GREEN, transparent_green, RANGE),
+    ATTRIBUTE(TRANSPARENT_BLUE, transparent_blue, RANGE),
+    ATTRIBUTE(TRANSPARENT_ALPHA, transparent_alpha, RANGE),
+    ATTRIBUTE(SAMPLE_BUFFERS, sample_buffers, RANGE),
+    ATTRIBUTE(SAMPLES_PER_PIXEL, samples_per_pixel, RANGE),
+    ATTRIBUTE(CAVEAT, caveat, RANGE),
+    ATTRIBUTE(SWAP_METHOD, swap_method, RANGE),
+    ATTRIBUTE(SRGB_CAPABLE, srgb_capable, BOOL),
+    ATTRIBUTE(FLOAT_COLOR, float_color, BOOL),
+    ATTRIBUTE(BUFFER_AGE, buffer_age, BOOL)
+#undef ATTRIBUTE
+};
 
 
 static gboolean
-suits_range(gint value1, gint value2, GtkGLRequirementType restr) {
-    switch (restr) {
-        case GTK_GL_PREFERABLY: return TRUE;
-        case GTK_GL_EXACTLY: return value1 == value2;
-        case GTK_GL_AT_MOST: return value1 <= value2;
-        case GTK_GL_AT_LEAST: return value1 >= value2;
-    }
+is_known_attribute(GtkGLAttribute attr) {
+    return attr > GTK_GL_NONE && attr < N_ATTRIBUTES;
+}
+
+
+gint
+gtk_gl_framebuffer_config_get(const GtkGLFramebufferConfig *config,
+        GtkGLAttribute attr) {
+    assert(is_known_attribute(attr));
+
+    return G_STRUCT_MEMBER(gint, config, attribute_info[attr].offset);
 }
 
 
+typedef struct _GtkGLAttributeTable {
+    const GtkGLVisualList *pool;
+    // Bit (1 << attr) is set once columns[attr] has been fetched
+    volatile gint valid;
+    // Built for a list not created by the library, see get_attribute_table()
+    gboolean temporary;
+    gsize count;
+    gsize n_blocks;  // Padded column length in units of BLOCK_ROWS
+    gint *columns[N_ATTRIBUTES];  // columns[GTK_GL_NONE] is unused
+} GtkGLAttributeTable;
+
+
+// Private part of a GtkGLVisualList. The structure and the entries array live
+// in a single allocation made by gtk_gl_visual_list_new(), slices point their
+// entries into the parent list instead.
+typedef struct _GtkGLVisualList_Priv {
+    GtkGLVisualList list;
+    // LIST_MAGIC for lists allocated by the library, see is_library_list()
+    guint32 magic;
+    volatile gint ref_count;
+    // Built lazily by get_attribute_table()
+    GtkGLAttributeTable *table;
+    // Results of gtk_gl_choose_visuals_cached(), guarded by memo_mutex
+    GHashTable *memo;
+    // Views keep a reference to the list whose visuals they share
+    GtkGLVisualList *parent;
+} GtkGLVisualList_Priv;
+
+
+#define GTK_GL_VISUAL_LIST_GET_PRIV(list) \
+    ((GtkGLVisualList_Priv*) (list))
+
+
+/* Lists may also be built by callers as plain GtkGLVisualList structures,
+ * which have no private part. Lists allocated by the library carry a magic
+ * value behind the public structure, and only those are cast to
+ * GtkGLVisualList_Priv. The check reads the word following a caller-built
+ * list, which is never mistaken for the magic in practice.
+ */
+#define LIST_MAGIC 0x56534c54  // "VSLT"
+
+
 static gboolean
-suits_bool(gint value1, gint value2, GtkGLRequirementType restr) {
-    switch (restr) {
-        case GTK_GL_PREFERABLY: return TRUE;
-        case GTK_GL_EXACTLY: return !value1 == !value2;
-        case GTK_GL_AT_MOST: return !value1 >= !value2;
-        case GTK_GL_AT_LEAST: return !value1 <= !value2;
+is_library_list(const GtkGLVisualList *list) {
+    return GTK_GL_VISUAL_LIST_GET_PRIV(list)->magic == LIST_MAGIC;
+}
+
+
+static GtkGLAttributeTable *
+attribute_table_new(const GtkGLVisualList *pool) {
+    GtkGLAttributeTable *table;
+    gint *column_data;
+    gsize n_blocks = (pool->count + BLOCK_ROWS - 1) / BLOCK_ROWS;
+    gsize stride = n_blocks * BLOCK_ROWS;
+    gsize attr;
+
+    // Header and all columns in one block, zeroed for the padding rows
+    table = g_malloc0(sizeof *table + N_ATTRIBUTES * stride * sizeof(gint));
+    column_data = (gint*) (table + 1);
+    table->pool = pool;
+    table->count = pool->count;
+    table->n_blocks = n_blocks;
+    for (attr = 0; attr < N_ATTRIBUTES; ++attr) {
+        table->columns[attr] = column_data + attr * stride;
     }
+    return table;
 }
 
 
+// Serializes fetching columns of tables shared between threads
+static GMutex column_mutex;
 
-static gboolean
-is_suitable_configuration(const GtkGLFramebufferConfig *config,
-        const GtkGLRequirement *r) {
-    while (r->attr != GTK_GL_NONE) {
-
-#define CASE_TEST(attr, compar, expr) \
-    case GTK_GL_##attr: \
-        if (!(compar)((expr), r->value, r->req)) return FALSE; \
-        break;
-
-        switch (r->attr) {
-            CASE_TEST(ACCELERATED, suits_bool, config->accelerated)
-            CASE_TEST(COLOR_TYPES, suits_bool, config->color_types & r->value)
-            CASE_TEST(FB_LEVEL, suits_range, config->fb_level)
-            CASE_TEST(COLOR_BPP, suits_range, config->color_bpp)
-            CASE_TEST(DOUBLE_BUFFERED, suits_bool, config->double_buffered)
-            CASE_TEST(STEREO_BUFFERED, suits_bool, config->stereo_buffered)
-            CASE_TEST(AUX_BUFFERS, suits_range, config->aux_buffers)
-            CASE_TEST(RED_COLOR_BPP, suits_range, config->red_color_bpp)
-            CASE_TEST(GREEN_COLOR_BPP, suits_range, config->green_color_bpp)
-            CASE_TEST(BLUE_COLOR_BPP, suits_range, config->blue_color_bpp)
-            CASE_TEST(ALPHA_COLOR_BPP, suits_range, config->alpha_color_bpp)
-            CASE_TEST(DEPTH_BPP, suits_range, config->depth_bpp)
-            CASE_TEST(STENCIL_BPP, suits_range, config->depth_bpp)
-            CASE_TEST(RED_ACCUM_BPP, suits_range, config->red_accum_bpp)
-            CASE_TEST(GREEN_ACCUM_BPP, suits_range, config->green_accum_bpp)
-            CASE_TEST(BLUE_ACCUM_BPP, suits_range, config->blue_accum_bpp)
-            CASE_TEST(ALPHA_ACCUM_BPP, suits_range, config->alpha_accum_bpp)
-            CASE_TEST(TRANSPARENT_TYPE, suits_range, config->transparent_type)
-            CASE_TEST(TRANSPARENT_INDEX_VALUE, suits_range,
-                    config->transparent_index)
-            CASE_TEST(TRANSPARENT_RED, suits_range, config->transparent_red)
-            CASE_TEST(TRANSPARENT_GREEN, suits_range,
-                    config->transparent_green)
-            CASE_TEST(TRANSPARENT_BLUE, suits_range, config->transparent_blue)
-            CASE_TEST(TRANSPARENT_ALPHA, suits_range,
-                    config->transparent_alpha)
-            CASE_TEST(SAMPLE_BUFFERS, suits_range, config->sample_buffers)
-            CASE_TEST(SAMPLES_PER_PIXEL, suits_range,
-                    config->samples_per_pixel)
-            CASE_TEST(CAVEAT, suits_range, config->caveat)
-            default: break;
+
+// Returns a column of the table, fetching it from the backend on first use.
+// Filling in a column does not change the logical contents of the table.
+static const gint *
+get_column(const GtkGLAttributeTable *table, GtkGLAttribute attr) {
+    GtkGLAttributeTable *mutable_table = (GtkGLAttributeTable*) table;
+    const gint bit = 1 << attr;
+
+    if (!(g_atomic_int_get(&table->valid) & bit)) {
+        g_mutex_lock(&column_mutex);
+        if (!(table->valid & bit)) {
+            gtk_gl_describe_visuals_attribute(table->pool, attr,
+                    mutable_table->columns[attr]);
+            g_atomic_int_or((volatile guint*) &mutable_table->valid, bit);
         }
+        g_mutex_unlock(&column_mutex);
+    }
+    return table->columns[attr];
+}
+
 
-#undef CASE_TEST
+// Returns the attribute table of a pool, building it on first use. Visual
+// lists are immutable, so the table stays valid for the lifetime of the list.
+// Lists built by the caller get a temporary table for this call only, which
+// must be passed to release_attribute_table().
+static const GtkGLAttributeTable *
+get_attribute_table(const GtkGLVisualList *pool) {
+    GtkGLVisualList_Priv *priv;
+    GtkGLAttributeTable *table;
 
-        ++r;
+    if (!is_library_list(pool)) {
+        table = attribute_table_new(pool);
+        table->temporary = TRUE;
+        return table;
     }
 
-    return TRUE;
+    priv = GTK_GL_VISUAL_LIST_GET_PRIV(pool);
+    table = g_atomic_pointer_get(&priv->table);
+    if (!table) {
+        table = attribute_table_new(pool);
+        // Another thread may have won the race, use its table then
+        if (!g_atomic_pointer_compare_and_exchange(&priv->table, NULL,
+                table)) {
+            g_free(table);
+            table = g_atomic_pointer_get(&priv->table);
+        }
+    }
+    return table;
 }
 
 
-static gint
-compare_configurations(const GtkGLFramebufferConfig *lhs,
-        const GtkGLFramebufferConfig *rhs,
-        const GtkGLRequirement *r) {
-
-#define CASE_ORDER_BY(attr, var) \
-    case GTK_GL_##attr: \
-        if (r->req == GTK_GL_PREFERABLY && (gint) lhs->var == r->value \
-                && (gint) rhs->var != r->value) { \
-            return -1; \
-        } else if (r->req == GTK_GL_PREFERABLY && (gint) lhs->var != r->value \
-                && (gint) rhs->var == r->value) { \
-            return +1; \
-        } else if (lhs->var < rhs->var) { \
-            return r->req == GTK_GL_AT_MOST /* ascending */ ? -1 : +1; \
-        } else if (lhs->var > rhs->var) { \
-            return r->req == GTK_GL_AT_LEAST /* descending */ ? -1 : +1; \
-        } \
-        break;
-#define PREFER_BOOL(attr, v) \
-    if (!lhs->attr == !v && !rhs->attr != !v) return -1; \
-    else if (!lhs->attr != !v && !rhs->attr == !v) return +1;
-#define PREFER_ORDER(attr, order) \
-    if (lhs->attr < rhs->attr) return order; \
-    if (lhs->attr > rhs->attr) return -(order);
-#define PREFER_LESS(attr) PREFER_ORDER(attr, -1)
-#define PREFER_GREATER(attr) PREFER_ORDER(attr, +1)
-
-    while (r->attr != GTK_GL_NONE) {
+static void
+release_attribute_table(const GtkGLAttributeTable *table) {
+    if (table->temporary) g_free((GtkGLAttributeTable*) table);
+}
+
+
+/* A requirement list compiled for repeated evaluation. Every filtering
+ * requirement (EXACTLY, AT_MOST, AT_LEAST) is reduced to a closed interval
+ * [min, max] on an optionally masked and truth-converted column value, so
+ * filtering needs no per-value switch over the requirement type. Ordering
+ * requirements are kept as a flat array of known attributes.
+ */
+typedef struct _FilterOp {
+    GtkGLAttribute attr;  // Column in the attribute table
+    gint mask;            // Applied before the comparison, ~0 for none
+    gboolean truth;       // Compare !!(value & mask) instead of the value
+} FilterOp;
+
+
+struct _GtkGLRequirementProgram {
+    gsize n_filters;
+    gsize n_orders;
+    FilterOp *filters;
+    gint *bounds;  // min and max of filters[i] at 2*i and 2*i+1
+    GtkGLRequirement *orders;
+};
+
+
+GtkGLRequirementProgram *
+gtk_gl_requirement_program_new(const GtkGLRequirement *requirements) {
+    GtkGLRequirementProgram *program;
+    const GtkGLRequirement *r;
+    gsize n_requirements = 0, f = 0, o = 0;
+
+    assert(requirements);
+
+    for (r = requirements; r->attr != GTK_GL_NONE; ++r) {
+        ++n_requirements;
+    }
+
+    // Header and arrays in one block, sized for the worst case
+    program = g_malloc(sizeof *program + n_requirements * (sizeof(FilterOp)
+            + 2 * sizeof(gint) + sizeof(GtkGLRequirement)));
+    program->filters = (FilterOp*) (program + 1);
+    program->bounds = (gint*) (program->filters + n_requirements);
+    program->orders = (GtkGLRequirement*) (program->bounds
+            + 2 * n_requirements);
+
+    for (r = requirements; r->attr != GTK_GL_NONE; ++r) {
+        FilterOp *op = &program->filters[f];
+        gint *bounds = &program->bounds[2 * f];
+        gint value;
+
+        if (!is_known_attribute(r->attr)) continue;
+
         if (r->req != GTK_GL_EXACTLY) {
-            switch (r->attr) {
-                CASE_ORDER_BY(ACCELERATED, accelerated)
-                CASE_ORDER_BY(COLOR_TYPES, color_types)
-                CASE_ORDER_BY(FB_LEVEL, fb_level)
-                CASE_ORDER_BY(COLOR_BPP, color_bpp)
-                CASE_ORDER_BY(DOUBLE_BUFFERED, double_buffered)
-                CASE_ORDER_BY(STEREO_BUFFERED, stereo_buffered)
-                CASE_ORDER_BY(AUX_BUFFERS, aux_buffers)
-                CASE_ORDER_BY(RED_COLOR_BPP, red_color_bpp)
-                CASE_ORDER_BY(GREEN_COLOR_BPP, green_color_bpp)
-                CASE_ORDER_BY(BLUE_COLOR_BPP, blue_color_bpp)
-                CASE_ORDER_BY(ALPHA_COLOR_BPP, alpha_color_bpp)
-                CASE_ORDER_BY(DEPTH_BPP, depth_bpp)
-                CASE_ORDER_BY(STENCIL_BPP, stencil_bpp)
-                CASE_ORDER_BY(RED_ACCUM_BPP, red_accum_bpp)
-                CASE_ORDER_BY(GREEN_ACCUM_BPP, green_accum_bpp)
-                CASE_ORDER_BY(BLUE_ACCUM_BPP, blue_accum_bpp)
-                CASE_ORDER_BY(ALPHA_ACCUM_BPP, alpha_accum_bpp)
-                CASE_ORDER_BY(TRANSPARENT_TYPE, transparent_type)
-                CASE_ORDER_BY(TRANSPARENT_INDEX_VALUE, transparent_index)
-                CASE_ORDER_BY(TRANSPARENT_RED, transparent_red)
-                CASE_ORDER_BY(TRANSPARENT_GREEN, transparent_green)
-                CASE_ORDER_BY(TRANSPARENT_BLUE, transparent_blue)
-                CASE_ORDER_BY(TRANSPARENT_ALPHA, transparent_alpha)
-                CASE_ORDER_BY(SAMPLE_BUFFERS, sample_buffers)
-                CASE_ORDER_BY(SAMPLES_PER_PIXEL, samples_per_pixel)
-                CASE_ORDER_BY(CAVEAT, caveat)
-                default: break;
-            }
+            program->orders[o++] = *r;
+        }
+        if (r->req == GTK_GL_PREFERABLY) continue;
+
+        op->attr = r->attr;
+        op->mask = attribute_info[r->attr].kind == ATTRIBUTE_MASK
+                ? r->value : ~0;
+        op->truth = attribute_info[r->attr].kind != ATTRIBUTE_RANGE;
+        value = op->truth ? !!r->value : r->value;
+
+        /* For truth values, AT_MOST TRUE and AT_LEAST FALSE accept anything,
+         * which the [0, 1] interval expresses without special cases
+         */
+        switch (r->req) {
+            case GTK_GL_EXACTLY:
+                bounds[0] = bounds[1] = value;
+                break;
+
+            case GTK_GL_AT_MOST:
+                bounds[0] = op->truth ? 0 : G_MININT;
+                bounds[1] = value;
+                break;
+
+            case GTK_GL_AT_LEAST:
+                bounds[0] = value;
+                bounds[1] = op->truth ? 1 : G_MAXINT;
+                break;
+
+            default:
+                break;
+        }
+        ++f;
+    }
+
+    program->n_filters = f;
+    program->n_orders = o;
+    return program;
+}
+
+
+void
+gtk_gl_requirement_program_free(GtkGLRequirementProgram *program) {
+    g_free(program);
+}
+
+
+/* Clears the bits of the selection bitmap whose row does not pass the filter
+ * operation. Bit j of selection[b] stands for row b * BLOCK_ROWS + j.
+ *
+ * The vector kernels compute "value < min || value > max" with signed
+ * compares and clear the resulting lanes, the truth conversion maps
+ * "value == 0" (all ones or zero) to 0 or 1 by adding one.
+ */
+#if defined(__AVX2__)
+
+static void
+filter_column(const GtkGLAttributeTable *table, const FilterOp *op,
+        const gint *bounds, guint8 *selection) {
+    const gint *column = get_column(table, op->attr);
+    const __m256i mask = _mm256_set1_epi32(op->mask);
+    const __m256i min = _mm256_set1_epi32(bounds[0]);
+    const __m256i max = _mm256_set1_epi32(bounds[1]);
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i one = _mm256_set1_epi32(1);
+    gsize b;
+
+    for (b = 0; b < table->n_blocks; ++b) {
+        __m256i value = _mm256_and_si256(mask, _mm256_loadu_si256(
+                (const __m256i*) (column + b * BLOCK_ROWS)));
+        __m256i reject;
+
+        if (op->truth) {
+            value = _mm256_add_epi32(_mm256_cmpeq_epi32(value, zero), one);
+        }
+        reject = _mm256_or_si256(_mm256_cmpgt_epi32(min, value),
+                _mm256_cmpgt_epi32(value, max));
+        selection[b] &= ~_mm256_movemask_ps(_mm256_castsi256_ps(reject));
+    }
+}
+
+#elif defined(__SSE2__)
+
+static inline int
+reject_sse2(const gint *values, __m128i mask, __m128i min, __m128i max,
+        gboolean truth) {
+    __m128i value = _mm_and_si128(mask,
+            _mm_loadu_si128((const __m128i*) values));
+
+    if (truth) {
+        value = _mm_add_epi32(_mm_cmpeq_epi32(value, _mm_setzero_si128()),
+                _mm_set1_epi32(1));
+    }
+    return _mm_movemask_ps(_mm_castsi128_ps(_mm_or_si128(
+            _mm_cmplt_epi32(value, min), _mm_cmpgt_epi32(value, max))));
+}
+
+
+static void
+filter_column(const GtkGLAttributeTable *table, const FilterOp *op,
+        const gint *bounds, guint8 *selection) {
+    const gint *column = get_column(table, op->attr);
+    const __m128i mask = _mm_set1_epi32(op->mask);
+    const __m128i min = _mm_set1_epi32(bounds[0]);
+    const __m128i max = _mm_set1_epi32(bounds[1]);
+    gsize b;
 
+    for (b = 0; b < table->n_blocks; ++b) {
+        const gint *block = column + b * BLOCK_ROWS;
+        int reject = reject_sse2(block, mask, min, max, op->truth)
+                | reject_sse2(block + 4, mask, min, max, op->truth) << 4;
+        selection[b] &= ~reject;
+    }
+}
+
+#else
+
+static void
+filter_column(const GtkGLAttributeTable *table, const FilterOp *op,
+        const gint *bounds, guint8 *selection) {
+    const gint *column = get_column(table, op->attr);
+    const gint mask = op->mask, min = bounds[0], max = bounds[1];
+    gsize b, j;
+
+    for (b = 0; b < table->n_blocks; ++b) {
+        const gint *block = column + b * BLOCK_ROWS;
+        guint accept = 0;
+
+        for (j = 0; j < BLOCK_ROWS; ++j) {
+            gint value = block[j] & mask;
+            if (op->truth) value = value != 0;
+            accept |= (guint) ((value >= min) & (value <= max)) << j;
         }
-        ++r;
-    }
-
-    PREFER_BOOL(caveat, FALSE)
-    PREFER_BOOL(accelerated, TRUE)
-    PREFER_LESS(aux_buffers)
-    PREFER_LESS(red_accum_bpp)
-    PREFER_LESS(green_accum_bpp)
-    PREFER_LESS(blue_accum_bpp)
-    PREFER_LESS(alpha_accum_bpp)
-    PREFER_LESS(sample_buffers)
-    PREFER_LESS(samples_per_pixel)
-    PREFER_BOOL(stereo_buffered, FALSE)
-    PREFER_BOOL(double_buffered, FALSE)
-    PREFER_LESS(stencil_bpp)
-    PREFER_LESS(depth_bpp)
-    PREFER_LESS(color_bpp)
+        selection[b] &= accept;
+    }
+}
+
+#endif
+
 
+// Builds the selection bitmap of all rows passing every filter of the
+// program, table->n_blocks bytes. Returns the number of selected rows.
+static gsize
+filter_configurations(const GtkGLAttributeTable *table,
+        const GtkGLRequirementProgram *program, guint8 *selection) {
+    gsize i, count = 0;
+    gsize tail = table->count % BLOCK_ROWS;
+
+    if (!table->n_blocks) return 0;
+
+    memset(selection, 0xff, table->n_blocks);
+    // Padding rows are never selected
+    if (tail) selection[table->n_blocks - 1] = (1u << tail) - 1;
+
+    for (i = 0; i < program->n_filters; ++i) {
+        filter_column(table, &program->filters[i], &program->bounds[2 * i],
+                selection);
+    }
+
+    for (i = 0; i < table->n_blocks; ++i) {
+        guint bits = selection[i];
+        for (; bits; bits &= bits - 1) ++count;
+    }
+    return count;
+}
+
+
+// Returns the next selected row at or after "row", or table->count
+static gsize
+next_selected_row(const GtkGLAttributeTable *table, const guint8 *selection,
+        gsize row) {
+    while (row < table->count) {
+        guint bits = selection[row / BLOCK_ROWS] >> (row % BLOCK_ROWS);
+        if (bits) return row + g_bit_nth_lsf(bits, -1);
+        row = (row / BLOCK_ROWS + 1) * BLOCK_ROWS;
+    }
+    return table->count;
+}
+
+
+typedef enum _TieBreak {
+    PREFER_FALSE,
+    PREFER_TRUE,
+    PREFER_LESS
+} TieBreak;
+
+
+/* Order between configurations that are equal with respect to all
+ * requirements: Avoid caveats, prefer acceleration and otherwise choose the
+ * configuration with the least resources.
+ */
+static const struct {
+    GtkGLAttribute attr;
+    TieBreak prefer;
+} tie_breaks[] = {
+    { GTK_GL_CAVEAT, PREFER_FALSE },
+    { GTK_GL_ACCELERATED, PREFER_TRUE },
+    { GTK_GL_AUX_BUFFERS, PREFER_LESS },
+    { GTK_GL_RED_ACCUM_BPP, PREFER_LESS },
+    { GTK_GL_GREEN_ACCUM_BPP, PREFER_LESS },
+    { GTK_GL_BLUE_ACCUM_BPP, PREFER_LESS },
+    { GTK_GL_ALPHA_ACCUM_BPP, PREFER_LESS },
+    { GTK_GL_SAMPLE_BUFFERS, PREFER_LESS },
+    { GTK_GL_SAMPLES_PER_PIXEL, PREFER_LESS },
+    { GTK_GL_STEREO_BUFFERED, PREFER_FALSE },
+    { GTK_GL_FLOAT_COLOR, PREFER_FALSE },
+    { GTK_GL_SRGB_CAPABLE, PREFER_FALSE },
+    { GTK_GL_DOUBLE_BUFFERED, PREFER_FALSE },
+    { GTK_GL_STENCIL_BPP, PREFER_LESS },
+    { GTK_GL_DEPTH_BPP, PREFER_LESS },
+    { GTK_GL_COLOR_BPP, PREFER_LESS }
+};
+
+
+static gint
+compare_attribute(gint lhs, gint rhs, const GtkGLRequirement *r) {
+    if (r->req == GTK_GL_PREFERABLY) {
+        // Only a match is preferred, the magnitude does not matter
+        if ((lhs == r->value) == (rhs == r->value)) return 0;
+        return lhs == r->value ? -1 : +1;
+    } else if (lhs < rhs) {
+        return r->req == GTK_GL_AT_MOST /* ascending */ ? -1 : +1;
+    } else if (lhs > rhs) {
+        return r->req == GTK_GL_AT_LEAST /* descending */ ? -1 : +1;
+    }
     return 0;
+}
+
 
-#undef CASE_TEST
-#undef PREFER_BOOL
-#undef PREFER_ORDER
-#undef PREFER_GREATER
-#undef PREFER_LESS
+static gint
+tie_break(gint lhs, gint rhs, TieBreak prefer) {
+    switch (prefer) {
+        case PREFER_FALSE: return !lhs == !rhs ? 0 : !lhs ? -1 : +1;
+        case PREFER_TRUE: return !lhs == !rhs ? 0 : !lhs ? +1 : -1;
+        case PREFER_LESS: return lhs < rhs ? -1 : lhs > rhs ? +1 : 0;
+    }
+    return 0;
 }
 
 
-static gboolean
-dump_visuals(GtkGLFramebufferConfig *config, GtkGLVisual *visual,
-        GtkGLVisual ***array_pptr) {
-    *(*array_pptr)++ = visual;
-    return FALSE;
+typedef struct _RankingContext {
+    const GtkGLAttributeTable *table;
+    const GtkGLRequirementProgram *program;
+    // Columns resolved by ranking_column(), NULL until first read
+    const gint *columns[N_ATTRIBUTES];
+} RankingContext;
+
+
+static void
+ranking_context_init(RankingContext *ctx, const GtkGLAttributeTable *table,
+        const GtkGLRequirementProgram *program) {
+    memset(ctx, 0, sizeof *ctx);
+    ctx->table = table;
+    ctx->program = program;
+}
+
+
+// Like get_column(), but without synchronization after the first access
+static const gint *
+ranking_column(RankingContext *ctx, GtkGLAttribute attr) {
+    if (!ctx->columns[attr]) {
+        ctx->columns[attr] = get_column(ctx->table, attr);
+    }
+    return ctx->columns[attr];
+}
+
+
+// Compares two rows of the attribute table
+static gint
+compare_configurations(RankingContext *ctx, gsize lhs, gsize rhs) {
+    const GtkGLRequirementProgram *program = ctx->program;
+    gsize i;
+    gint order;
+
+    for (i = 0; i < program->n_orders; ++i) {
+        const GtkGLRequirement *r = &program->orders[i];
+        const gint *column = ranking_column(ctx, r->attr);
+        order = compare_attribute(column[lhs], column[rhs], r);
+        if (order) return order;
+    }
+
+    for (i = 0; i < G_N_ELEMENTS(tie_breaks); ++i) {
+        const gint *column = ranking_column(ctx, tie_breaks[i].attr);
+        order = tie_break(column[lhs], column[rhs], tie_breaks[i].prefer);
+        if (order) return order;
+    }
+    return 0;
+}
+
+
+static gint
+compare_rows(gconstpointer lhs, gconstpointer rhs, gpointer user) {
+    RankingContext *ctx = user;
+    gsize lhs_row = GPOINTER_TO_SIZE(*(GtkGLVisual *const *) lhs);
+    gsize rhs_row = GPOINTER_TO_SIZE(*(GtkGLVisual *const *) rhs);
+    gint order = compare_configurations(ctx, lhs_row, rhs_row);
+
+    // Keep the pool order between equivalent configurations
+    if (!order) order = lhs_row < rhs_row ? -1 : lhs_row > rhs_row;
+    return order;
 }
 
 
 GtkGLVisualList *
 gtk_gl_visual_list_new(gboolean is_owner, size_t count) {
-    GtkGLVisualList *list = g_malloc(sizeof *list);
-    list->is_owner = is_owner;
+    GtkGLVisualList_Priv *priv = g_malloc0(sizeof *priv
+            + sizeof(GtkGLVisual*) * count);
+    priv->ref_count = 1;
+    priv->list.is_owner = is_owner;
+    priv->list.count = count;
+    priv->list.entries = (GtkGLVisual**) (priv + 1);
+    priv->magic = LIST_MAGIC;
+    return &priv->list;
+}
+
+
+GtkGLVisualList *
+gtk_gl_visual_list_new_inline(gsize count, gsize visual_size) {
+    GtkGLVisualList *list;
+    guint8 *arena;
+    gsize i;
+
+    // Round up so every slot stays pointer-aligned
+    visual_size = (visual_size + sizeof(gpointer) - 1)
+            / sizeof(gpointer) * sizeof(gpointer);
+
+    // The arena is allocated as additional entries after the real ones
+    list = gtk_gl_visual_list_new(FALSE,
+            count + visual_size / sizeof(GtkGLVisual*) * count);
+    arena = (guint8*) (list->entries + count);
     list->count = count;
-    list->entries = g_malloc0(sizeof(GtkGLVisual*) * count);
+    for (i = 0; i < count; ++i) {
+        list->entries[i] = (GtkGLVisual*) (arena + i * visual_size);
+    }
+    return list;
+}
+
+
+GtkGLVisualList *
+gtk_gl_choose_visuals_compiled(const GtkGLVisualList *pool,
+        const GtkGLRequirementProgram *program) {
+    const GtkGLAttributeTable *table;
+    RankingContext ctx;
+    GtkGLVisualList *list;
+    guint8 *selection;
+    size_t i, j;
+
+    assert(pool);
+    assert(program);
+
+    table = get_attribute_table(pool);
+    selection = g_malloc(table->n_blocks);
+    list = gtk_gl_visual_list_new(FALSE,
+            filter_configurations(table, program, selection));
+
+    /* The entries array temporarily holds the row indices of the suitable
+     * configurations, which are sorted and then replaced by the visuals
+     * themselves
+     */
+    for (i = next_selected_row(table, selection, 0), j = 0; i < table->count;
+            i = next_selected_row(table, selection, i + 1)) {
+        list->entries[j++] = GSIZE_TO_POINTER(i);
+    }
+    g_free(selection);
+
+    ranking_context_init(&ctx, table, program);
+    g_qsort_with_data(list->entries, list->count, sizeof *list->entries,
+            compare_rows, &ctx);
+    release_attribute_table(table);
+
+    for (i = 0; i < list->count; ++i) {
+        list->entries[i] = pool->entries[GPOINTER_TO_SIZE(list->entries[i])];
+    }
     return list;
 }
 
@@ -208,44 +673,459 @@ gtk_gl_visual_list_new(gboolean is_owner, size_t count) {
 GtkGLVisualList *
 gtk_gl_choose_visuals(const GtkGLVisualList *pool,
         const GtkGLRequirement *requirements) {
-    GTree *suitable_configs;
+    GtkGLRequirementProgram *program;
     GtkGLVisualList *list;
-    GtkGLVisual **list_ptr;
-    size_t i;
 
     assert(pool);
     assert(requirements);
 
-    suitable_configs = g_tree_new_full(
-            (GCompareDataFunc) compare_configurations, (void*) requirements,
-            g_free, NULL);
-    for (i = 0; i < pool->count; ++i) {
-        GtkGLFramebufferConfig *config = g_malloc(sizeof *config);
-        gtk_gl_describe_visual(pool->entries[i], config);
-        if (is_suitable_configuration(config, requirements)) {
-            g_tree_insert(suitable_configs, config, pool->entries[i]);
+    program = gtk_gl_requirement_program_new(requirements);
+    list = gtk_gl_choose_visuals_compiled(pool, program);
+    gtk_gl_requirement_program_free(program);
+    return list;
+}
+
+
+/* Cost-model ranking: Each configuration is scored by an estimate of its
+ * framebuffer memory and per-frame bandwidth in bytes per pixel plus weighted
+ * distances from per-attribute targets, and ranked by ascending score. Equal
+ * scores fall back to the lexicographic order.
+ */
+static const GtkGLAttribute cost_attributes[] = {
+    GTK_GL_COLOR_BPP, GTK_GL_DOUBLE_BUFFERED, GTK_GL_STEREO_BUFFERED,
+    GTK_GL_AUX_BUFFERS, GTK_GL_DEPTH_BPP, GTK_GL_STENCIL_BPP,
+    GTK_GL_RED_ACCUM_BPP, GTK_GL_GREEN_ACCUM_BPP, GTK_GL_BLUE_ACCUM_BPP,
+    GTK_GL_ALPHA_ACCUM_BPP, GTK_GL_SAMPLE_BUFFERS, GTK_GL_SAMPLES_PER_PIXEL,
+    GTK_GL_SWAP_METHOD
+};
+
+
+// "value" holds the attributes of one configuration, indexed by attribute
+static gdouble
+framebuffer_cost(const gint *value, const GtkGLCostModel *model) {
+    const GtkGLCostTerm *term;
+    gdouble samples = value[GTK_GL_SAMPLE_BUFFERS]
+            ? MAX(value[GTK_GL_SAMPLES_PER_PIXEL], 1) : 1;
+    gdouble color_buffers = (value[GTK_GL_DOUBLE_BUFFERED] ? 2 : 1)
+            * (value[GTK_GL_STEREO_BUFFERED] ? 2 : 1);
+    gdouble color = value[GTK_GL_COLOR_BPP] / 8.0;
+    gdouble depth_stencil = (value[GTK_GL_DEPTH_BPP]
+            + value[GTK_GL_STENCIL_BPP]) / 8.0;
+    gdouble accum = (value[GTK_GL_RED_ACCUM_BPP]
+            + value[GTK_GL_GREEN_ACCUM_BPP] + value[GTK_GL_BLUE_ACCUM_BPP]
+            + value[GTK_GL_ALPHA_ACCUM_BPP]) / 8.0;
+    gdouble memory, bandwidth, swap, cost;
+
+    // Multisampled buffers are resolved into a single-sampled color buffer
+    memory = color * samples * color_buffers
+            + (samples > 1 ? color * color_buffers : 0)
+            + depth_stencil * samples + accum
+            + value[GTK_GL_AUX_BUFFERS] * color;
+
+    // A flip is free, a copy reads and writes the color buffer. Assume one
+    // buffer's worth of traffic if the backend doesn't tell.
+    swap = value[GTK_GL_SWAP_METHOD] == GTK_GL_SWAP_EXCHANGE ? 0
+            : value[GTK_GL_SWAP_METHOD] == GTK_GL_SWAP_COPY ? 2 * color
+            : color;
+
+    // One color write and a depth/stencil test and write per sample, plus
+    // the resolve and the buffer swap
+    bandwidth = color * samples + 2 * depth_stencil * samples
+            + (samples > 1 ? color * (samples + 1) : 0)
+            + (value[GTK_GL_DOUBLE_BUFFERED] ? swap : 0);
+
+    cost = model->memory_weight * memory
+            + model->bandwidth_weight * bandwidth;
+    for (term = model->terms; term && term->attr != GTK_GL_NONE; ++term) {
+        if (is_known_attribute(term->attr)) {
+            cost += term->weight * ABS(value[term->attr] - term->target);
         }
     }
+    return cost;
+}
+
+
+gdouble
+gtk_gl_framebuffer_config_cost(const GtkGLFramebufferConfig *config,
+        const GtkGLCostModel *model) {
+    gint value[N_ATTRIBUTES] = { 0 };
+    gint attr;
+
+    assert(config);
+    assert(model);
+
+    for (attr = GTK_GL_NONE + 1; attr < N_ATTRIBUTES; ++attr) {
+        value[attr] = gtk_gl_framebuffer_config_get(config, attr);
+    }
+    return framebuffer_cost(value, model);
+}
+
+
+typedef struct _CostRankingContext {
+    RankingContext ranking;
+    const gdouble *costs;  // Indexed by row
+} CostRankingContext;
+
 
-    list = gtk_gl_visual_list_new(FALSE, g_tree_nnodes(suitable_configs));
-    list_ptr = list->entries;
-    g_tree_foreach(suitable_configs, (GTraverseFunc) dump_visuals, &list_ptr);
-    g_tree_unref(suitable_configs);
+static gint
+compare_rows_by_cost(gconstpointer lhs, gconstpointer rhs, gpointer user) {
+    CostRankingContext *ctx = user;
+    gsize lhs_row = GPOINTER_TO_SIZE(*(GtkGLVisual *const *) lhs);
+    gsize rhs_row = GPOINTER_TO_SIZE(*(GtkGLVisual *const *) rhs);
+
+    if (ctx->costs[lhs_row] < ctx->costs[rhs_row]) return -1;
+    if (ctx->costs[lhs_row] > ctx->costs[rhs_row]) return +1;
+    return compare_rows(lhs, rhs, &ctx->ranking);
+}
+
+
+GtkGLVisualList *
+gtk_gl_choose_visuals_by_cost(const GtkGLVisualList *pool,
+        const GtkGLRequirement *requirements, const GtkGLCostModel *model) {
+    const GtkGLAttributeTable *table;
+    GtkGLRequirementProgram *program;
+    CostRankingContext ctx;
+    GtkGLVisualList *list;
+    const GtkGLCostTerm *term;
+    gdouble *costs;
+    guint8 *selection;
+    gsize i, j;
+
+    assert(pool);
+    assert(requirements);
+    assert(model);
 
+    table = get_attribute_table(pool);
+    program = gtk_gl_requirement_program_new(requirements);
+    ranking_context_init(&ctx.ranking, table, program);
+
+    selection = g_malloc(table->n_blocks);
+    list = gtk_gl_visual_list_new(FALSE,
+            filter_configurations(table, program, selection));
+
+    // Only fetch the columns the cost model reads
+    for (i = 0; i < G_N_ELEMENTS(cost_attributes); ++i) {
+        ranking_column(&ctx.ranking, cost_attributes[i]);
+    }
+    for (term = model->terms; term && term->attr != GTK_GL_NONE; ++term) {
+        if (is_known_attribute(term->attr)) {
+            ranking_column(&ctx.ranking, term->attr);
+        }
+    }
+
+    costs = g_new(gdouble, table->count);
+    for (i = next_selected_row(table, selection, 0), j = 0; i < table->count;
+            i = next_selected_row(table, selection, i + 1)) {
+        gint value[N_ATTRIBUTES] = { 0 };
+        gint attr;
+
+        for (attr = GTK_GL_NONE + 1; attr < N_ATTRIBUTES; ++attr) {
+            if (ctx.ranking.columns[attr]) {
+                value[attr] = ctx.ranking.columns[attr][i];
+            }
+        }
+        costs[i] = framebuffer_cost(value, model);
+        list->entries[j++] = GSIZE_TO_POINTER(i);
+    }
+    g_free(selection);
+
+    ctx.costs = costs;
+    g_qsort_with_data(list->entries, list->count, sizeof *list->entries,
+            compare_rows_by_cost, &ctx);
+    release_attribute_table(table);
+
+    for (i = 0; i < list->count; ++i) {
+        list->entries[i] = pool->entries[GPOINTER_TO_SIZE(list->entries[i])];
+    }
+    g_free(costs);
+    gtk_gl_requirement_program_free(program);
+    return list;
+}
+
+
+/* Memoised results of gtk_gl_choose_visuals() are stored with the pool they
+ * were chosen from, keyed by the requirement list. Since a pool owns its
+ * memo, the pool identity is implicitly part of the key and freeing the pool
+ * drops all of its results.
+ */
+static GMutex memo_mutex;
+
+
+typedef struct _MemoKey {
+    guint hash;
+    gsize count;
+    GtkGLRequirement requirements[];  // Without the terminator
+} MemoKey;
+
+
+static guint
+hash_requirements(const GtkGLRequirement *requirements, gsize count) {
+    guint hash = 5381;
+    gsize i;
+
+    for (i = 0; i < count; ++i) {
+        hash = hash * 33 + requirements[i].attr;
+        hash = hash * 33 + requirements[i].req;
+        hash = hash * 33 + (guint) requirements[i].value;
+    }
+    return hash;
+}
+
+
+static guint
+memo_key_hash(gconstpointer key) {
+    return ((const MemoKey*) key)->hash;
+}
+
+
+static gboolean
+memo_key_equal(gconstpointer lhs, gconstpointer rhs) {
+    const MemoKey *l = lhs, *r = rhs;
+    gsize i;
+
+    if (l->hash != r->hash || l->count != r->count) return FALSE;
+    for (i = 0; i < l->count; ++i) {
+        if (l->requirements[i].attr != r->requirements[i].attr
+                || l->requirements[i].req != r->requirements[i].req
+                || l->requirements[i].value != r->requirements[i].value) {
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+
+static MemoKey *
+memo_key_new(const GtkGLRequirement *requirements) {
+    MemoKey *key;
+    gsize count = 0;
+
+    while (requirements[count].attr != GTK_GL_NONE) ++count;
+
+    key = g_malloc(sizeof *key + count * sizeof *requirements);
+    key->count = count;
+    memcpy(key->requirements, requirements, count * sizeof *requirements);
+    key->hash = hash_requirements(requirements, count);
+    return key;
+}
+
+
+GtkGLVisualList *
+gtk_gl_choose_visuals_cached(const GtkGLVisualList *pool,
+        const GtkGLRequirement *requirements) {
+    GtkGLVisualList_Priv *priv = GTK_GL_VISUAL_LIST_GET_PRIV(pool);
+    GtkGLVisualList_Priv *result;
+    MemoKey *key;
+
+    assert(pool);
+    assert(requirements);
+
+    // Lists built by the caller have nowhere to keep the memo
+    if (!is_library_list(pool)) {
+        return gtk_gl_choose_visuals(pool, requirements);
+    }
+
+    key = memo_key_new(requirements);
+
+    g_mutex_lock(&memo_mutex);
+    if (!priv->memo) {
+        priv->memo = g_hash_table_new_full(memo_key_hash, memo_key_equal,
+                g_free, (GDestroyNotify) gtk_gl_visual_list_free);
+    }
+    result = g_hash_table_lookup(priv->memo, key);
+    if (result) {
+        gtk_gl_visual_list_ref(&result->list);
+        g_mutex_unlock(&memo_mutex);
+        g_free(key);
+        return &result->list;
+    }
+    g_mutex_unlock(&memo_mutex);
+
+    // Choose outside the lock, the result does not depend on other threads
+    result = GTK_GL_VISUAL_LIST_GET_PRIV(
+            gtk_gl_choose_visuals(pool, requirements));
+
+    g_mutex_lock(&memo_mutex);
+    {
+        GtkGLVisualList_Priv *existing = g_hash_table_lookup(priv->memo, key);
+        if (existing) {
+            // Another thread chose concurrently, share its result instead
+            gtk_gl_visual_list_free(&result->list);
+            result = existing;
+            g_free(key);
+        } else {
+            g_hash_table_insert(priv->memo, key, result);
+        }
+        // One reference for the caller, the memo keeps its own
+        gtk_gl_visual_list_ref(&result->list);
+    }
+    g_mutex_unlock(&memo_mutex);
+
+    return &result->list;
+}
+
+
+GtkGLVisual *
+gtk_gl_choose_best_visual(const GtkGLVisualList *pool,
+        const GtkGLRequirement *requirements) {
+    GtkGLVisual *best;
+    return gtk_gl_choose_best_visuals(pool, requirements, &best, 1)
+            ? best : NULL;
+}
+
+
+gsize
+gtk_gl_choose_best_visuals_compiled(const GtkGLVisualList *pool,
+        const GtkGLRequirementProgram *program, GtkGLVisual **best, gsize k) {
+    const GtkGLAttributeTable *table;
+    RankingContext ctx;
+    guint8 *selection;
+    gsize row, n = 0, i;
+
+    assert(pool);
+    assert(program);
+    assert(best || !k);
+
+    if (!k) return 0;
+
+    table = get_attribute_table(pool);
+    ranking_context_init(&ctx, table, program);
+
+    selection = g_malloc(table->n_blocks);
+    filter_configurations(table, program, selection);
+
+    /* Single scan over the selected rows keeping the k best in order. Like in
+     * gtk_gl_choose_visuals(), the output array holds row indices until the
+     * scan is complete.
+     */
+    for (row = next_selected_row(table, selection, 0); row < table->count;
+            row = next_selected_row(table, selection, row + 1)) {
+        GtkGLVisual *candidate = GSIZE_TO_POINTER(row);
+
+        if (n == k && compare_rows(&candidate, &best[n - 1], &ctx) >= 0) {
+            continue;
+        }
+
+        i = n < k ? n++ : n - 1;
+        for (; i > 0 && compare_rows(&candidate, &best[i - 1], &ctx) < 0;
+                --i) {
+            best[i] = best[i - 1];
+        }
+        best[i] = candidate;
+    }
+    g_free(selection);
+    release_attribute_table(table);
+
+    for (i = 0; i < n; ++i) {
+        best[i] = pool->entries[GPOINTER_TO_SIZE(best[i])];
+    }
+    return n;
+}
+
+
+gsize
+gtk_gl_choose_best_visuals(const GtkGLVisualList *pool,
+        const GtkGLRequirement *requirements, GtkGLVisual **best, gsize k) {
+    GtkGLRequirementProgram *program;
+    gsize n;
+
+    assert(pool);
+    assert(requirements);
+
+    program = gtk_gl_requirement_program_new(requirements);
+    n = gtk_gl_choose_best_visuals_compiled(pool, program, best, k);
+    gtk_gl_requirement_program_free(program);
+    return n;
+}
+
+
+GtkGLVisualList *
+gtk_gl_visual_list_slice(GtkGLVisualList *list, gsize offset, gsize count) {
+    GtkGLVisualList_Priv *priv;
+
+    assert(list);
+    assert(offset <= list->count && count <= list->count - offset);
+
+    priv = g_malloc0(sizeof *priv);
+    priv->ref_count = 1;
+    if (is_library_list(list)) priv->parent = gtk_gl_visual_list_ref(list);
+    priv->list.is_owner = FALSE;
+    priv->list.count = count;
+    priv->list.entries = list->entries + offset;
+    priv->magic = LIST_MAGIC;
+    return &priv->list;
+}
+
+
+GtkGLVisualList *
+gtk_gl_visual_list_filter(GtkGLVisualList *list,
+        const GtkGLRequirement *requirements) {
+    const GtkGLAttributeTable *table;
+    GtkGLRequirementProgram *program;
+    GtkGLVisualList *view;
+    guint8 *selection;
+    gsize row, j = 0;
+
+    assert(list);
+    assert(requirements);
+
+    table = get_attribute_table(list);
+    program = gtk_gl_requirement_program_new(requirements);
+    selection = g_malloc(table->n_blocks);
+    view = gtk_gl_visual_list_new(FALSE,
+            filter_configurations(table, program, selection));
+    gtk_gl_requirement_program_free(program);
+
+    for (row = next_selected_row(table, selection, 0); row < table->count;
+            row = next_selected_row(table, selection, row + 1)) {
+        view->entries[j++] = list->entries[row];
+    }
+    g_free(selection);
+    release_attribute_table(table);
+
+    // A list built by the caller cannot be referenced, it must outlive the
+    // view instead
+    if (is_library_list(list)) {
+        GTK_GL_VISUAL_LIST_GET_PRIV(view)->parent
+                = gtk_gl_visual_list_ref(list);
+    }
+    return view;
+}
+
+
+GtkGLVisualList *
+gtk_gl_visual_list_ref(GtkGLVisualList *list) {
+    assert(list);
+
+    g_atomic_int_inc(&GTK_GL_VISUAL_LIST_GET_PRIV(list)->ref_count);
     return list;
 }
 
 
 void
-gtk_gl_visual_list_free(GtkGLVisualList *list) {
+gtk_gl_visual_list_unref(GtkGLVisualList *list) {
+    GtkGLVisualList_Priv *priv;
+
     if (!list) return;
 
+    priv = GTK_GL_VISUAL_LIST_GET_PRIV(list);
+    if (!g_atomic_int_dec_and_test(&priv->ref_count)) return;
+
     if (list->is_owner) {
         size_t i;
         for (i = 0; i < list->count; ++i) {
             gtk_gl_visual_free(list->entries[i]);
         }
     }
-    g_free(list->entries);
+    if (priv->memo) g_hash_table_destroy(priv->memo);
+    gtk_gl_visual_list_unref(priv->parent);
+    g_free(priv->table);
+    priv->magic = 0;
     g_free(list);
 }
+
+
+void
+gtk_gl_visual_list_free(GtkGLVisualList *list) {
+    gtk_gl_visual_list_unref(list);
+}
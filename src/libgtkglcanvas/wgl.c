@@ -33,6 +33,16 @@
 #include <epoxy/wgl.h>
 
 
+// Tokens of extensions newer than some epoxy releases
+#ifndef WGL_CONTEXT_OPENGL_NO_ERROR_ARB
+#define WGL_CONTEXT_OPENGL_NO_ERROR_ARB 0x31B3
+#endif
+#ifndef WGL_CONTEXT_RELEASE_BEHAVIOR_ARB
+#define WGL_CONTEXT_RELEASE_BEHAVIOR_ARB 0x2097
+#define WGL_CONTEXT_RELEASE_BEHAVIOR_NONE_ARB 0
+#endif
+
+
 // Returns a human-readable error message  based GetLastError. The result is
 // owned by the caller.
 static void
@@ -66,13 +76,6 @@ struct _GtkGLVisual {
 };
 
 
-static GtkGLVisual *
-gtk_gl_visual_new(HDC dc, gint pf) {
-    GtkGLVisual visual = { dc, pf };
-    return g_memdup(&visual, sizeof visual);
-}
-
-
 void
 gtk_gl_visual_free(GtkGLVisual *visual) {
     g_free(visual);
@@ -83,6 +86,7 @@ struct _GtkGLCanvas_NativePriv {
     HWND win;  // The canvas child window
 	HDC dc;
     HGLRC glc;
+    GtkGLDisplayCaps caps;  // Zero until queried
 };
 
 
@@ -161,6 +165,7 @@ gtk_gl_canvas_native_realize(GtkGLCanvas *canvas) {
 	native->win = NULL;
 	native->dc = NULL;
 	native->glc = NULL;
+	native->caps = 0;
     g_signal_connect(GTK_WIDGET(canvas), "size-allocate",
         G_CALLBACK(on_size_allocate), NULL);
 }
@@ -207,26 +212,27 @@ gtk_gl_canvas_enumerate_visuals(GtkGLCanvas *canvas) {
 		g_warning("Unable to wglChoosePixelFormatARB(), returning "
 				"empty visual list");
 		warn_last_error();
+		g_free(formats);
 		return gtk_gl_visual_list_new(FALSE, 0);
 	}
 
-	list = gtk_gl_visual_list_new(TRUE, n_formats);
+	list = gtk_gl_visual_list_new_inline(n_formats, sizeof(GtkGLVisual));
 	for (i = 0; i < n_formats; ++i) {
-		list->entries[i] = gtk_gl_visual_new(native->dc, formats[i]);
+		list->entries[i]->dc = native->dc;
+		list->entries[i]->pf = formats[i];
 	}
+	g_free(formats);
 	return list;
 }
 
 
-void
-gtk_gl_describe_visual(const GtkGLVisual *visual, GtkGLFramebufferConfig *out) {
+static void
+describe_pixel_format(const GtkGLVisual *visual, gboolean has_multisample,
+        GtkGLFramebufferConfig *out) {
     gint value;
 	gint attr;
 	gboolean ok;
 
-    assert(visual);
-    assert(out);
-
 #define QUERY(a) \
     (attr = WGL_##a##_ARB, ok = wglGetPixelFormatAttribivARB(visual->dc, \
 			visual->pf, 0, 1, &attr, &value), ok ? value : 0)
@@ -263,7 +269,7 @@ gtk_gl_describe_visual(const GtkGLVisual *visual, GtkGLFramebufferConfig *out) {
     out->transparent_blue = QUERY(TRANSPARENT_BLUE_VALUE);
     out->transparent_alpha = QUERY(TRANSPARENT_ALPHA_VALUE);
 
-    if (!epoxy_has_wgl_extension(visual->dc, "WGL_ARB_multisample")) {
+    if (has_multisample) {
         out->sample_buffers = QUERY(SAMPLE_BUFFERS);
         out->samples_per_pixel = QUERY(SAMPLES);
     } else {
@@ -272,10 +278,92 @@ gtk_gl_describe_visual(const GtkGLVisual *visual, GtkGLFramebufferConfig *out) {
 
 	out->caveat = GTK_GL_CAVEAT_NONE;
 
+    value = QUERY(SWAP_METHOD);
+    out->swap_method = value == WGL_SWAP_EXCHANGE_ARB ? GTK_GL_SWAP_EXCHANGE
+            : value == WGL_SWAP_COPY_ARB ? GTK_GL_SWAP_COPY
+            : GTK_GL_SWAP_UNDEFINED;
+
+    // Unsupported attributes fail to query and read as zero
+    out->srgb_capable = QUERY(FRAMEBUFFER_SRGB_CAPABLE);
+    value = QUERY(PIXEL_TYPE);
+    out->float_color = value == WGL_TYPE_RGBA_FLOAT_ARB
+            || value == WGL_TYPE_RGBA_UNSIGNED_FLOAT_EXT;
+    out->buffer_age = FALSE;
+
 #undef QUERY
 }
 
 
+// The persistent cache is not implemented for WGL yet
+GtkGLVisual *
+gtk_gl_canvas_native_lookup_decision(GtkGLCanvas *canvas,
+        const GtkGLRequirement *requirements, guint ver_major,
+        guint ver_minor, GtkGLProfile profile) {
+    return NULL;
+}
+
+
+void
+gtk_gl_canvas_native_store_decision(GtkGLCanvas *canvas,
+        const GtkGLRequirement *requirements, const GtkGLVisual *visual,
+        guint ver_major, guint ver_minor, GtkGLProfile profile) {
+}
+
+
+void
+gtk_gl_describe_visual(const GtkGLVisual *visual, GtkGLFramebufferConfig *out) {
+    assert(visual);
+    assert(out);
+
+    describe_pixel_format(visual, epoxy_has_wgl_extension(visual->dc,
+            "WGL_ARB_multisample"), out);
+}
+
+
+void
+gtk_gl_describe_visuals(const GtkGLVisualList *visuals,
+        GtkGLFramebufferConfig *out) {
+    HDC dc = NULL;
+    gboolean has_multisample = FALSE;
+    size_t i;
+
+    assert(visuals);
+    assert(out || !visuals->count);
+
+    for (i = 0; i < visuals->count; ++i) {
+        const GtkGLVisual *visual = visuals->entries[i];
+
+        // Extensions are only resolved once per device context
+        if (visual->dc != dc) {
+            dc = visual->dc;
+            has_multisample = epoxy_has_wgl_extension(dc,
+                    "WGL_ARB_multisample");
+        }
+        describe_pixel_format(visual, has_multisample, &out[i]);
+    }
+}
+
+
+// Pixel formats are described as a whole, WGL has no cheaper per-attribute
+// path worth the extra attribute mapping
+void
+gtk_gl_describe_visuals_attribute(const GtkGLVisualList *visuals,
+        GtkGLAttribute attr, gint *out) {
+    GtkGLFramebufferConfig *configs;
+    size_t i;
+
+    assert(visuals);
+    assert(out || !visuals->count);
+
+    configs = g_new(GtkGLFramebufferConfig, visuals->count);
+    gtk_gl_describe_visuals(visuals, configs);
+    for (i = 0; i < visuals->count; ++i) {
+        out[i] = gtk_gl_framebuffer_config_get(&configs[i], attr);
+    }
+    g_free(configs);
+}
+
+
 static gboolean
 gtk_gl_canvas_native_before_create_context(GtkGLCanvas *canvas,
         const GtkGLVisual *visual) {
@@ -329,6 +417,14 @@ gtk_gl_canvas_native_after_create_context(GtkGLCanvas *canvas,
 }
 
 
+// Returns the context to share objects with, see gtk_gl_canvas_set_share_group()
+static HGLRC
+get_share_context(GtkGLCanvas *canvas) {
+    GtkGLCanvas *peer = gtk_gl_canvas_get_share_peer(canvas);
+    return peer ? GTK_GL_CANVAS_GET_PRIV(peer)->native->glc : NULL;
+}
+
+
 gboolean
 gtk_gl_canvas_native_create_context(GtkGLCanvas *canvas,
         const GtkGLVisual *visual) {
@@ -340,6 +436,10 @@ gtk_gl_canvas_native_create_context(GtkGLCanvas *canvas,
 		return FALSE;
 	}
 	native->glc = wglCreateContext(native->dc);
+	if (native->glc && get_share_context(canvas)
+			&& !wglShareLists(get_share_context(canvas), native->glc)) {
+		g_warning("wglShareLists() failed");
+	}
 	return gtk_gl_canvas_native_after_create_context(canvas, visual);
 }
 
@@ -347,15 +447,28 @@ gtk_gl_canvas_native_create_context(GtkGLCanvas *canvas,
 gboolean
 gtk_gl_canvas_native_create_context_with_version(GtkGLCanvas *canvas,
         const GtkGLVisual *visual, guint ver_major, guint ver_minor,
-        GtkGLProfile profile) {
+        GtkGLProfile profile, GtkGLContextFlags flags) {
     GtkGLCanvas_Priv *priv = GTK_GL_CANVAS_GET_PRIV(canvas);
     GtkGLCanvas_NativePriv *native = priv->native;
+    GtkGLDisplayCaps caps = gtk_gl_canvas_native_get_display_caps(canvas);
     const char *cxt_version;
     guint cxt_major, cxt_minor;
 
+    // Drop what the device context or the version cannot honor
+    if (!(caps & GTK_GL_DISPLAY_CREATE_CONTEXT)) flags = 0;
+    if (ver_major < 3) flags &= ~GTK_GL_CONTEXT_FORWARD_COMPATIBLE;
+    if (!(caps & GTK_GL_DISPLAY_CREATE_CONTEXT_NO_ERROR)
+            || (flags & GTK_GL_CONTEXT_DEBUG)) {
+        flags &= ~GTK_GL_CONTEXT_NO_ERROR;
+    }
+    if (!(caps & GTK_GL_DISPLAY_CONTEXT_FLUSH_CONTROL)) {
+        flags &= ~GTK_GL_CONTEXT_NO_FLUSH_ON_RELEASE;
+    }
+
     if ((ver_major < 3 || (ver_major == 3 && ver_minor == 0))
             && (profile == GTK_GL_CORE_PROFILE
-                || profile == GTK_GL_COMPATIBILITY_PROFILE)) {
+                || profile == GTK_GL_COMPATIBILITY_PROFILE)
+            && !flags) {
         // Use legacy function for legacy contexts
         if (!gtk_gl_canvas_native_create_context(canvas, visual)) {
             return FALSE;
@@ -368,21 +481,23 @@ gtk_gl_canvas_native_create_context_with_version(GtkGLCanvas *canvas,
         gint attrib_list[] = {
                 WGL_CONTEXT_MAJOR_VERSION_ARB, ver_major,
                 WGL_CONTEXT_MINOR_VERSION_ARB, ver_minor,
-                0, 0, 0
+                0, 0, 0, 0, 0, 0, 0, 0, 0
         };
+        size_t n = 4;
+
         /* OpenGL 3.1 does not know about compatibility profiles, so
          * compatibility is checked later via WGL_ARB_compatibility in that
          * case
          */
         if (epoxy_has_wgl_extension(visual->dc, "WGL_ARB_create_context_profile")) {
-            attrib_list[4] = WGL_CONTEXT_PROFILE_MASK_ARB;
+            attrib_list[n++] = WGL_CONTEXT_PROFILE_MASK_ARB;
             switch (profile) {
                 case GTK_GL_CORE_PROFILE:
-                    attrib_list[5] = WGL_CONTEXT_CORE_PROFILE_BIT_ARB;
+                    attrib_list[n++] = WGL_CONTEXT_CORE_PROFILE_BIT_ARB;
                     break;
 
                 case GTK_GL_COMPATIBILITY_PROFILE:
-                    attrib_list[5] = WGL_CONTEXT_COMPATIBILITY_PROFILE_BIT_ARB;
+                    attrib_list[n++] = WGL_CONTEXT_COMPATIBILITY_PROFILE_BIT_ARB;
                     break;
 
                 case GTK_GL_ES_PROFILE:
@@ -390,18 +505,34 @@ gtk_gl_canvas_native_create_context_with_version(GtkGLCanvas *canvas,
                             "WGL_ARB_create_context_es_profile")) {
                         return FALSE;
                     }
-                    attrib_list[5] = WGL_CONTEXT_ES_PROFILE_BIT_EXT;
+                    attrib_list[n++] = WGL_CONTEXT_ES_PROFILE_BIT_EXT;
                     break;
 
                 default:
                     return FALSE;
             }
         };
+        if (flags & (GTK_GL_CONTEXT_DEBUG | GTK_GL_CONTEXT_FORWARD_COMPATIBLE)) {
+            attrib_list[n++] = WGL_CONTEXT_FLAGS_ARB;
+            attrib_list[n++] = (flags & GTK_GL_CONTEXT_DEBUG
+                        ? WGL_CONTEXT_DEBUG_BIT_ARB : 0)
+                    | (flags & GTK_GL_CONTEXT_FORWARD_COMPATIBLE
+                        ? WGL_CONTEXT_FORWARD_COMPATIBLE_BIT_ARB : 0);
+        }
+        if (flags & GTK_GL_CONTEXT_NO_ERROR) {
+            attrib_list[n++] = WGL_CONTEXT_OPENGL_NO_ERROR_ARB;
+            attrib_list[n++] = TRUE;
+        }
+        if (flags & GTK_GL_CONTEXT_NO_FLUSH_ON_RELEASE) {
+            attrib_list[n++] = WGL_CONTEXT_RELEASE_BEHAVIOR_ARB;
+            attrib_list[n++] = WGL_CONTEXT_RELEASE_BEHAVIOR_NONE_ARB;
+        }
 
         if (!gtk_gl_canvas_native_before_create_context(canvas, visual)) {
             return FALSE;
         }
-        native->glc = wglCreateContextAttribsARB(native->dc, NULL, attrib_list);
+        native->glc = wglCreateContextAttribsARB(native->dc,
+                get_share_context(canvas), attrib_list);
         if (!gtk_gl_canvas_native_after_create_context(canvas, visual)) {
             return FALSE;
         }
@@ -440,13 +571,96 @@ gtk_gl_canvas_native_destroy_context(GtkGLCanvas *canvas) {
 }
 
 
+// WGL extensions are per device context, so the snapshot is kept per canvas
+GtkGLDisplayCaps
+gtk_gl_canvas_native_get_display_caps(GtkGLCanvas *canvas) {
+	GtkGLCanvas_Priv *priv = GTK_GL_CANVAS_GET_PRIV(canvas);
+    GtkGLCanvas_NativePriv *native = priv->native;
+
+	if (!native->win) create_child_window(canvas);
+	if (!native->dc || native->caps) return native->caps;
+
+#define HAS_EXTENSION(name) epoxy_has_wgl_extension(native->dc, name)
+
+	if (HAS_EXTENSION("WGL_ARB_pixel_format")) {
+		// The swap method is a core attribute of WGL_ARB_pixel_format
+		native->caps |= GTK_GL_DISPLAY_FBCONFIG | GTK_GL_DISPLAY_SWAP_METHOD;
+	}
+	if (HAS_EXTENSION("WGL_ARB_multisample")) {
+		native->caps |= GTK_GL_DISPLAY_MULTISAMPLE;
+	}
+	if (HAS_EXTENSION("WGL_ARB_create_context")) {
+		native->caps |= GTK_GL_DISPLAY_CREATE_CONTEXT;
+	}
+	if (HAS_EXTENSION("WGL_ARB_create_context_profile")) {
+		native->caps |= GTK_GL_DISPLAY_CREATE_CONTEXT_PROFILE;
+	}
+	if (HAS_EXTENSION("WGL_EXT_create_context_es_profile")) {
+		native->caps |= GTK_GL_DISPLAY_CREATE_CONTEXT_ES_PROFILE;
+	}
+	if (HAS_EXTENSION("WGL_ARB_framebuffer_sRGB")
+			|| HAS_EXTENSION("WGL_EXT_framebuffer_sRGB")) {
+		native->caps |= GTK_GL_DISPLAY_FRAMEBUFFER_SRGB;
+	}
+	if (HAS_EXTENSION("WGL_ARB_create_context_no_error")) {
+		native->caps |= GTK_GL_DISPLAY_CREATE_CONTEXT_NO_ERROR;
+	}
+	if (HAS_EXTENSION("WGL_ARB_context_flush_control")) {
+		native->caps |= GTK_GL_DISPLAY_CONTEXT_FLUSH_CONTROL;
+	}
+
+#undef HAS_EXTENSION
+
+	return native->caps;
+}
+
+
+// Windows are owned by the thread that created them, so asynchronous creation
+// always runs from an idle callback on the main thread.
+gboolean
+gtk_gl_canvas_native_prepare_async(GtkGLCanvas *canvas) {
+	return FALSE;
+}
+
+
+void
+gtk_gl_canvas_native_clear_current(GtkGLCanvas *canvas) {
+	GtkGLCanvas_Priv *priv = GTK_GL_CANVAS_GET_PRIV(canvas);
+    GtkGLCanvas_NativePriv *native = priv->native;
+	if (native->glc && wglGetCurrentContext() == native->glc) {
+		wglMakeCurrent(NULL, NULL);
+	}
+}
+
+
+// The child window follows the canvas in on_size_allocate(). Contexts are not
+// pooled on WGL yet.
+void
+gtk_gl_canvas_native_resize(GtkGLCanvas *canvas, gint width, gint height) {
+}
+
+
+guint
+gtk_gl_canvas_native_get_framebuffer(GtkGLCanvas *canvas) {
+    // Single-context mode is not implemented for WGL
+    return 0;
+}
+
+
 void
 gtk_gl_canvas_native_make_current(GtkGLCanvas *canvas) {
 	GtkGLCanvas_Priv *priv = GTK_GL_CANVAS_GET_PRIV(canvas);
     GtkGLCanvas_NativePriv *native = priv->native;
 	if (native->glc) {
 		assert(native->dc);
+		// WGL keeps the current context per thread on the client side
+		if (wglGetCurrentContext() == native->glc
+				&& wglGetCurrentDC() == native->dc) {
+			gtk_gl_count_make_current(TRUE);
+			return;
+		}
     	wglMakeCurrent(native->dc, native->glc);
+		gtk_gl_count_make_current(FALSE);
 	}
 }
 
@@ -467,3 +681,8 @@ gtk_gl_get_proc_address(const char *name) {
     return wglGetProcAddress(name);
 }
 
+
+const gchar *
+gtk_gl_get_backend_name(void) {
+    return "wgl";
+}
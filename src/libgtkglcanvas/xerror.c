@@ -0,0 +1,264 @@
+/**
+ * Copyright (c) 2014-2015, Fabian Knorr
+ *
+ * This file is part of libgtkglcanvas.
+ *
+ * libgtkglcanvas is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libgtkglcanvas is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libgtkglcanvas. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * This file is based on the work of André Diego Piske,
+ * see <https://github.com/andrepiske/tegtkgl>. To retain André's licensing
+ * conditions on the parts of the software authored by him, the following
+ * copyright notice shall be included in this and all derived files:
+ */
+
+/**
+ * Copyright (c) 2013 André Diego Piske
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ **/
+
+
+#include <assert.h>
+
+#include <X11/Xlib.h>
+#include <glib.h>
+
+#include "xerror.h"
+
+
+typedef gint (*XErrorHandler)(Display *dpy, XErrorEvent *ev);
+
+typedef struct _XErrorTrap {
+    Display *dpy;
+    GThread *owner;  // The thread that began the capture
+    gulong start_serial;
+    gulong end_serial;  // One past the last covered request, 0 while open
+    guchar error_code;  // Of the first error in range, 0 if none
+    const gchar *warning;  // For deferred captures, logged on error
+} XErrorTrap;
+
+static XErrorHandler old_xerror_handler;
+static gboolean xerror_handler_installed;
+static GList *xerror_traps;  // of XErrorTrap, most recently begun first
+static GMutex xerror_mutex;
+static GPrivate thread_xerror_traps;  // GSList of the thread's open captures
+
+
+// An open capture only covers errors read by its own thread. That thread
+// holds the display lock, so no other thread can read them anyway.
+static gboolean
+xerror_trap_covers(const XErrorTrap *trap, Display *dpy, gulong serial) {
+    if (trap->dpy != dpy || serial < trap->start_serial) return FALSE;
+    return trap->end_serial ? serial < trap->end_serial
+            : trap->owner == g_thread_self();
+}
+
+
+// Whether the server has processed all requests of a closed capture, which
+// means that all errors in its range have been handled already
+static gboolean
+xerror_trap_complete(const XErrorTrap *trap) {
+    return trap->end_serial == trap->start_serial
+            || LastKnownRequestProcessed(trap->dpy) + 1 >= trap->end_serial;
+}
+
+
+static gint
+trapping_xerror_handler(Display *dpy, XErrorEvent *ev) {
+    const gchar *warning = NULL;
+    gboolean trapped = FALSE;
+    GList *it;
+
+    g_mutex_lock(&xerror_mutex);
+    for (it = xerror_traps; it && !trapped; it = it->next) {
+        XErrorTrap *trap = it->data;
+        if (xerror_trap_covers(trap, dpy, ev->serial)) {
+            if (!trap->error_code) trap->error_code = ev->error_code;
+            warning = trap->warning;
+            trapped = TRUE;
+        }
+    }
+    g_mutex_unlock(&xerror_mutex);
+
+    if (warning) g_warning("%s", warning);
+    if (!trapped && old_xerror_handler) return old_xerror_handler(dpy, ev);
+    return 0;
+}
+
+
+// Drops deferred captures of a display whose range has been processed. Must
+// be called with xerror_mutex and the display lock held.
+static void
+prune_deferred_xerror_traps(Display *dpy) {
+    GList *it = xerror_traps;
+    while (it) {
+        XErrorTrap *trap = it->data;
+        GList *next = it->next;
+        if (trap->dpy == dpy && trap->end_serial
+                && xerror_trap_complete(trap)) {
+            xerror_traps = g_list_delete_link(xerror_traps, it);
+            g_free(trap);
+        }
+        it = next;
+    }
+}
+
+
+void
+gtk_gl_forget_xerror_traps(Display *dpy) {
+    GList *it;
+
+    g_mutex_lock(&xerror_mutex);
+    it = xerror_traps;
+    while (it) {
+        XErrorTrap *trap = it->data;
+        GList *next = it->next;
+        if (trap->dpy == dpy) {
+            xerror_traps = g_list_delete_link(xerror_traps, it);
+            g_free(trap);
+        }
+        it = next;
+    }
+    g_mutex_unlock(&xerror_mutex);
+}
+
+
+void
+gtk_gl_begin_capture_xerrors(Display *dpy) {
+    XErrorTrap *trap = g_malloc0(sizeof *trap);
+
+    // Released in close_xerror_trap(). Nested captures lock recursively.
+    XLockDisplay(dpy);
+    trap->dpy = dpy;
+    trap->owner = g_thread_self();
+    trap->start_serial = NextRequest(dpy);
+
+    g_mutex_lock(&xerror_mutex);
+    if (!xerror_handler_installed) {
+        old_xerror_handler = XSetErrorHandler(trapping_xerror_handler);
+        xerror_handler_installed = TRUE;
+    }
+    prune_deferred_xerror_traps(dpy);
+    xerror_traps = g_list_prepend(xerror_traps, trap);
+    g_mutex_unlock(&xerror_mutex);
+
+    g_private_set(&thread_xerror_traps, g_slist_prepend(
+            g_private_get(&thread_xerror_traps), trap));
+}
+
+
+// Closes the innermost capture of the calling thread at the next request.
+// The caller must release the display lock once done with the server.
+static XErrorTrap *
+close_xerror_trap(Display *dpy) {
+    GSList *traps = g_private_get(&thread_xerror_traps);
+    XErrorTrap *trap;
+    gulong end_serial = NextRequest(dpy);
+
+    assert(traps);
+    trap = traps->data;
+    assert(trap->dpy == dpy && trap->owner == g_thread_self());
+    g_private_set(&thread_xerror_traps, g_slist_delete_link(traps, traps));
+
+    g_mutex_lock(&xerror_mutex);
+    trap->end_serial = end_serial;
+    g_mutex_unlock(&xerror_mutex);
+    return trap;
+}
+
+
+gboolean
+gtk_gl_have_xerror(Display *dpy) {
+    GSList *traps = g_private_get(&thread_xerror_traps);
+    XErrorTrap *trap;
+    gboolean had_xerror;
+
+    assert(traps);
+    trap = traps->data;
+    if (LastKnownRequestProcessed(dpy) + 1 < NextRequest(dpy)) {
+        XSync(dpy, False);
+    }
+    g_mutex_lock(&xerror_mutex);
+    had_xerror = trap->error_code != 0;
+    g_mutex_unlock(&xerror_mutex);
+    return had_xerror;
+}
+
+
+gboolean
+gtk_gl_is_capturing_xerrors(Display *dpy) {
+    GSList *it;
+
+    for (it = g_private_get(&thread_xerror_traps); it; it = it->next) {
+        if (((XErrorTrap*) it->data)->dpy == dpy) return TRUE;
+    }
+    return FALSE;
+}
+
+
+gboolean
+gtk_gl_end_capture_xerrors(Display *dpy) {
+    XErrorTrap *trap = close_xerror_trap(dpy);
+    gboolean had_xerror;
+
+    if (!xerror_trap_complete(trap)) XSync(dpy, False);
+    XUnlockDisplay(dpy);
+
+    g_mutex_lock(&xerror_mutex);
+    xerror_traps = g_list_remove(xerror_traps, trap);
+    g_mutex_unlock(&xerror_mutex);
+
+    had_xerror = trap->error_code != 0;
+    g_free(trap);
+    return had_xerror;
+}
+
+
+void
+gtk_gl_end_capture_xerrors_deferred(Display *dpy, const gchar *warning) {
+    XErrorTrap *trap = close_xerror_trap(dpy);
+    gboolean had_xerror = FALSE;
+
+    XFlush(dpy);
+    g_mutex_lock(&xerror_mutex);
+    if (trap->error_code || xerror_trap_complete(trap)) {
+        had_xerror = trap->error_code != 0;
+        xerror_traps = g_list_remove(xerror_traps, trap);
+        g_free(trap);
+    } else {
+        trap->warning = warning;
+    }
+    g_mutex_unlock(&xerror_mutex);
+    XUnlockDisplay(dpy);
+
+    if (had_xerror) g_warning("%s", warning);
+}
@@ -0,0 +1,71 @@
+/**
+ * Copyright (c) 2014-2015, Fabian Knorr
+ *
+ * This file is part of libgtkglcanvas.
+ *
+ * libgtkglcanvas is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libgtkglcanvas is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libgtkglcanvas. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include <X11/Xlib.h>
+#include <glib.h>
+
+
+/* X Error handling routines:
+ * X generates errors asynchronously, and a single error will usually terminate
+ * the application. GLX and EGL functions may generate X Errors if a
+ * non-existing context type was requested or a visual does not match the
+ * context - things we cannot detect in advance.
+ * To allow the gtk_gl_* functions to handle X Errors gracefully, they can be
+ * "muted" via gtk_gl_begin_capture_xerrors() / gtk_gl_end_capture_xerrors().
+ *
+ * Like GDK's error traps, a capture covers the range of request serials
+ * issued on its display between begin and end, and errors are attributed to
+ * the innermost capture whose range contains their serial. Captures belong to
+ * the thread that began them and may nest. While a capture is open, its
+ * thread holds XLockDisplay(), so that other threads sharing the display
+ * (e.g. GTK while a worker creates a context) cannot issue requests inside
+ * its range. Requests that other threads send through XCB directly bypass
+ * that lock and are not excluded. Code that makes X calls while holding one
+ * of its own mutexes must take XLockDisplay() before that mutex, as a capture
+ * may take the mutex while it holds the display lock.
+ * The error handler is installed once and passes errors outside of all
+ * captures on to the previous handler; xerror_mutex is only held to link,
+ * unlink and look up captures.
+ * Ending a capture synchronizes with the server only if some of its requests
+ * have not been processed yet. gtk_gl_end_capture_xerrors_deferred() never
+ * synchronizes, the capture stays registered until its range has been
+ * processed.
+ */
+void gtk_gl_begin_capture_xerrors(Display *dpy);
+
+// Returns whether the calling thread's innermost capture has seen an error
+// so far, synchronizing if necessary
+gboolean gtk_gl_have_xerror(Display *dpy);
+
+// Whether the calling thread has a capture open on the display
+gboolean gtk_gl_is_capturing_xerrors(Display *dpy);
+
+// Ends muting of X Errors, returning whether there was an error
+gboolean gtk_gl_end_capture_xerrors(Display *dpy);
+
+// Ends muting of X Errors without waiting for the server. Errors in the
+// capture's range are logged with the given (static) warning whenever they
+// arrive.
+void gtk_gl_end_capture_xerrors_deferred(Display *dpy, const gchar *warning);
+
+// Drops the deferred captures of a display that is being closed
+void gtk_gl_forget_xerror_traps(Display *dpy);